@@ -1,5 +1,9 @@
 #include "image.h"
 
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
 namespace image {
 
 /**
@@ -162,8 +166,6 @@ void histogram(unsigned char* src,
   int counts[image::LEVELS];
   // Track maximum achieved count
   int maxCount = 0;
-  // Cursor for destination image buffer
-  unsigned char* ptrDest = dest;
 
   // Initialize counts buffer
   for (int i = 0; i < image::LEVELS; i++) {
@@ -184,35 +186,37 @@ void histogram(unsigned char* src,
     }
   }
 
+  // Columns with a bar, ordered by the row at which their bar starts
+  std::vector<std::pair<int, int>> bars;
+
   // Transform counts buffer values from range [0, maxCount] to [0, 255]
   for (int i = 0; i < image::LEVELS; i++) {
     counts[i] = ((double)counts[i] / maxCount) * (image::LEVELS - 1);
+
+    // A column has a bar from the row rows - 1 - count down to the last row
+    if (i < cols && counts[i] != 0) {
+      bars.push_back({std::max(rows - 1 - counts[i], 0), i});
+    }
   }
 
-  // Current row and column in destination image
-  int row = 0;
-  int col = 0;
+  std::sort(bars.begin(), bars.end());
 
-  // Convert character counts to histogram in destination image buffer
-  for (int i = 0; i < rows * cols; i++) {
-    // Use foreground colour if count for current column is equal to or higher
-    // than current row value. Otherwise, use background colour.
-    if (counts[col] != 0 && counts[col] >= (rows - 1 - row)) {
-      *ptrDest = image::LEVEL_FOREGROUND;
-    } else {
-      *ptrDest = image::LEVEL_BACKGROUND;
-    }
+  std::vector<std::pair<int, int>>::iterator bar = bars.begin();
 
-    // Increment destination image buffer cursor
-    ptrDest++;
+  // Bars only widen from one row to the next one down, so each row is a copy
+  // of the row above it with the columns of the bars starting in it set
+  for (int row = 0; row < rows; row++) {
+    // Cursor for the current row of the destination image buffer
+    unsigned char* ptrDest = dest + row * cols;
 
-    // Increment column in destination image
-    col++;
+    if (row == 0) {
+      std::memset(ptrDest, image::LEVEL_BACKGROUND, cols);
+    } else {
+      std::memcpy(ptrDest, ptrDest - cols, cols);
+    }
 
-    // Increment row if reached end of current row
-    if (col >= cols) {
-      row++;
-      col = 0;
+    for (; bar != bars.end() && bar->first == row; bar++) {
+      ptrDest[bar->second] = image::LEVEL_FOREGROUND;
     }
   }
 }
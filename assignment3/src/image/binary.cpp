@@ -0,0 +1,482 @@
+#include "binary.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace image {
+
+// Words with every bit unset and every bit set
+const unsigned long long WORD_ZEROS = 0ULL;
+const unsigned long long WORD_ONES = ~0ULL;
+
+/**
+ * Creates a binary image of the given dimensions with every pixel unset.
+ *
+ * @param ROWS Number of rows in image
+ * @param COLS Number of columns in image
+ */
+BinaryImage::BinaryImage(const int ROWS, const int COLS)
+    : rows(ROWS),
+      cols(COLS),
+      wordsPerRow((COLS + BINARY_WORD_BITS - 1) / BINARY_WORD_BITS),
+      words((long)ROWS * wordsPerRow, WORD_ZEROS) {}
+
+/**
+ * @returns Number of rows in image
+ */
+int BinaryImage::getRows() const {
+  return rows;
+}
+
+/**
+ * @returns Number of columns in image
+ */
+int BinaryImage::getCols() const {
+  return cols;
+}
+
+/**
+ * @returns Number of words used to store each row
+ */
+int BinaryImage::getWordsPerRow() const {
+  return wordsPerRow;
+}
+
+/**
+ * Returns the packed words of the given row.
+ *
+ * @param ROW Row of the image
+ * @returns   Pointer to the first word of the row
+ */
+unsigned long long* BinaryImage::getRow(const int ROW) {
+  return &words[(long)wordsPerRow * ROW];
+}
+
+/**
+ * Returns the packed words of the given row.
+ *
+ * @param ROW Row of the image
+ * @returns   Pointer to the first word of the row
+ */
+const unsigned long long* BinaryImage::getRow(const int ROW) const {
+  return &words[(long)wordsPerRow * ROW];
+}
+
+/**
+ * Returns whether the pixel at the given position is set.
+ *
+ * @param ROW Row of the pixel
+ * @param COL Column of the pixel
+ * @returns   Value of the pixel
+ */
+bool BinaryImage::get(const int ROW, const int COL) const {
+  const unsigned long long WORD = getRow(ROW)[COL / BINARY_WORD_BITS];
+
+  return (WORD >> (COL % BINARY_WORD_BITS)) & 1;
+}
+
+/**
+ * Sets or unsets the pixel at the given position.
+ *
+ * @param ROW   Row of the pixel
+ * @param COL   Column of the pixel
+ * @param VALUE New value of the pixel
+ */
+void BinaryImage::set(const int ROW, const int COL, const bool VALUE) {
+  unsigned long long& word = getRow(ROW)[COL / BINARY_WORD_BITS];
+  const unsigned long long MASK = 1ULL << (COL % BINARY_WORD_BITS);
+
+  word = VALUE ? word | MASK : word & ~MASK;
+}
+
+/**
+ * Unsets the bits past the last column of every row, restoring the invariant
+ * after operations that act on whole words.
+ */
+void BinaryImage::clearPadding() {
+  if (cols % BINARY_WORD_BITS == 0) {
+    return;
+  }
+
+  const unsigned long long MASK = (1ULL << (cols % BINARY_WORD_BITS)) - 1;
+
+  for (int i = 0; i < rows; i++) {
+    getRow(i)[wordsPerRow - 1] &= MASK;
+  }
+}
+
+/**
+ * Produces a binary image where each pixel is set if the respective pixel of
+ * the given image is greater than or equal to the threshold, as with the
+ * NEW_HIGH level of image::applyThreshold. Pixels are compared and packed 16 at
+ * a time when SSE2 is available. The source image has the dimensions of the
+ * destination image.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination binary image
+ * @param THRESHOLD Chosen threshold intensity value
+ */
+void applyThreshold(const unsigned char* SRC,
+                    BinaryImage& dest,
+                    const unsigned char THRESHOLD) {
+  const int COLS = dest.getCols();
+
+  for (int i = 0; i < dest.getRows(); i++) {
+    const unsigned char* ROW = &SRC[(long)COLS * i];
+    unsigned long long* out = dest.getRow(i);
+
+    for (int w = 0; w < dest.getWordsPerRow(); w++) {
+      const int FIRST = BINARY_WORD_BITS * w;
+      unsigned long long word = 0;
+      int k = 0;
+
+#ifdef __SSE2__
+      // Pixel >= THRESHOLD exactly when max(pixel, THRESHOLD) == pixel
+      const __m128i LIMIT = _mm_set1_epi8((char)THRESHOLD);
+
+      for (; k + 16 <= BINARY_WORD_BITS && FIRST + k + 16 <= COLS; k += 16) {
+        const __m128i PIXELS =
+            _mm_loadu_si128((const __m128i*)&ROW[FIRST + k]);
+        const __m128i ABOVE =
+            _mm_cmpeq_epi8(_mm_max_epu8(PIXELS, LIMIT), PIXELS);
+
+        word |= (unsigned long long)(unsigned)_mm_movemask_epi8(ABOVE) << k;
+      }
+#endif
+
+      for (; k < BINARY_WORD_BITS && FIRST + k < COLS; k++) {
+        word |= (unsigned long long)(ROW[FIRST + k] >= THRESHOLD) << k;
+      }
+
+      out[w] = word;
+    }
+  }
+}
+
+/**
+ * Unpacks a binary image into an image with one byte per pixel, mapping unset
+ * pixels to NEW_LOW and set pixels to NEW_HIGH.
+ *
+ * @param SRC      Binary image
+ * @param dest     Destination buffer for image
+ * @param NEW_LOW  Value for unset pixels
+ * @param NEW_HIGH Value for set pixels
+ */
+void genImage(const BinaryImage& SRC,
+              unsigned char* dest,
+              const unsigned char NEW_LOW,
+              const unsigned char NEW_HIGH) {
+  const int COLS = SRC.getCols();
+
+  for (int i = 0; i < SRC.getRows(); i++) {
+    const unsigned long long* ROW = SRC.getRow(i);
+    unsigned char* out = &dest[(long)COLS * i];
+
+    for (int j = 0; j < COLS; j++) {
+      const unsigned long long WORD = ROW[j / BINARY_WORD_BITS];
+
+      out[j] = (WORD >> (j % BINARY_WORD_BITS)) & 1 ? NEW_HIGH : NEW_LOW;
+    }
+  }
+}
+
+/**
+ * Shifts a packed row so that bit j of the destination is bit j + SHIFT of the
+ * source. Bits shifted in from outside of the row are taken from FILL.
+ *
+ * @param SRC   Packed source row
+ * @param dest  Packed destination row, must not be SRC
+ * @param WORDS Number of words in each row
+ * @param SHIFT Number of columns to shift by, negative to shift the other way
+ * @param FILL  Word whose bits are shifted in from outside of the row
+ */
+static void shiftRow(const unsigned long long* SRC,
+                     unsigned long long* dest,
+                     const int WORDS,
+                     const int SHIFT,
+                     const unsigned long long FILL) {
+  // Returns word w of the source, extended with FILL on both sides
+  auto word = [&](const int W) { return W >= 0 && W < WORDS ? SRC[W] : FILL; };
+
+  const int WORD_SHIFT =
+      SHIFT >= 0 ? SHIFT / BINARY_WORD_BITS
+                 : -((-SHIFT + BINARY_WORD_BITS - 1) / BINARY_WORD_BITS);
+  const int BIT_SHIFT = SHIFT - WORD_SHIFT * BINARY_WORD_BITS;
+
+  for (int w = 0; w < WORDS; w++) {
+    const unsigned long long LOW = word(w + WORD_SHIFT);
+
+    if (BIT_SHIFT == 0) {
+      dest[w] = LOW;
+    } else {
+      const unsigned long long HIGH = word(w + WORD_SHIFT + 1);
+
+      dest[w] = (LOW >> BIT_SHIFT) | (HIGH << (BINARY_WORD_BITS - BIT_SHIFT));
+    }
+  }
+}
+
+/**
+ * Combines every pixel of a binary image with the pixels in a window of
+ * HEIGHT x WIDTH pixels around it, using AND for erosion and OR for dilation.
+ * Runs of 2, 4, 8, ... pixels are built by doubling, so a window of any size
+ * costs O(log WIDTH + log HEIGHT) word-wide operations per 64 pixels. Pixels
+ * outside of the image are treated as FILL, the identity of the operation.
+ *
+ * @param SRC    Binary image
+ * @param dest   Destination binary image
+ * @param HEIGHT Height of the structuring element
+ * @param WIDTH  Width of the structuring element
+ * @param ABOVE  Number of rows of the window above its anchor
+ * @param LEFT   Number of columns of the window to the left of its anchor
+ * @param ERODE  Whether to erode (AND) rather than dilate (OR)
+ */
+static void applyRectangle(const BinaryImage& SRC,
+                           BinaryImage& dest,
+                           const int HEIGHT,
+                           const int WIDTH,
+                           const int ABOVE,
+                           const int LEFT,
+                           const bool ERODE) {
+  // Ensure that the structuring element is not empty
+  if (HEIGHT <= 0 || WIDTH <= 0) {
+    throw "ERROR: Structuring element must not be empty!";
+  }
+
+  const int ROWS = SRC.getRows();
+  const int WORDS = SRC.getWordsPerRow();
+  const unsigned long long FILL = ERODE ? WORD_ONES : WORD_ZEROS;
+  const int PADDING = SRC.getCols() % BINARY_WORD_BITS;
+  const unsigned long long PADDING_MASK =
+      PADDING == 0 ? WORD_ZEROS : ~((1ULL << PADDING) - 1);
+  // Words in a row extended by LEFT columns, so that no column is shifted out
+  const int EXTENDED_WORDS =
+      (SRC.getCols() + LEFT + BINARY_WORD_BITS - 1) / BINARY_WORD_BITS;
+
+  auto combine = [&](const unsigned long long A, const unsigned long long B) {
+    return ERODE ? A & B : A | B;
+  };
+
+  std::vector<unsigned long long> row(EXTENDED_WORDS);
+  std::vector<unsigned long long> run(EXTENDED_WORDS);
+  std::vector<unsigned long long> acc(EXTENDED_WORDS);
+  std::vector<unsigned long long> shifted(EXTENDED_WORDS);
+
+  // Rows combined horizontally, padded with ABOVE rows of FILL at the top and
+  // HEIGHT - 1 - ABOVE rows at the bottom
+  const int PADDED_ROWS = ROWS + HEIGHT - 1;
+  std::vector<unsigned long long> runRows((long)PADDED_ROWS * WORDS, FILL);
+
+  // Combine along each row. Bit p of the shifted row holds column p - LEFT, so
+  // that the window [j - LEFT, j - LEFT + WIDTH - 1] of column j starts at p.
+  for (int i = 0; i < ROWS; i++) {
+    const unsigned long long* SRC_ROW = SRC.getRow(i);
+
+    // Pixels past the last column are outside of the image
+    for (int w = 0; w < EXTENDED_WORDS; w++) {
+      row[w] = w < WORDS ? SRC_ROW[w] : FILL;
+      acc[w] = FILL;
+    }
+
+    if (ERODE) {
+      row[WORDS - 1] |= PADDING_MASK;
+    }
+
+    shiftRow(&row[0], &run[0], EXTENDED_WORDS, -LEFT, FILL);
+
+    int runLength = 1;
+    int offset = 0;
+
+    for (int remaining = WIDTH; remaining > 0; remaining /= 2) {
+      // acc covers [p, p + offset - 1], run covers [p, p + runLength - 1]
+      if (remaining % 2 == 1) {
+        shiftRow(&run[0], &shifted[0], EXTENDED_WORDS, offset, FILL);
+
+        for (int w = 0; w < EXTENDED_WORDS; w++) {
+          acc[w] = combine(acc[w], shifted[w]);
+        }
+
+        offset += runLength;
+      }
+
+      if (remaining > 1) {
+        shiftRow(&run[0], &shifted[0], EXTENDED_WORDS, runLength, FILL);
+
+        for (int w = 0; w < EXTENDED_WORDS; w++) {
+          run[w] = combine(run[w], shifted[w]);
+        }
+
+        runLength *= 2;
+      }
+    }
+
+    for (int w = 0; w < WORDS; w++) {
+      runRows[(long)WORDS * (i + ABOVE) + w] = acc[w];
+    }
+  }
+
+  // Combine down each column in the same way, doubling runs of whole rows.
+  // Row i of the result covers padded rows [i, i + HEIGHT - 1].
+  std::vector<unsigned long long> accRows((long)ROWS * WORDS, FILL);
+  int runLength = 1;
+  int offset = 0;
+
+  for (int remaining = HEIGHT; remaining > 0; remaining /= 2) {
+    if (remaining % 2 == 1) {
+      for (int i = 0; i < ROWS; i++) {
+        for (int w = 0; w < WORDS; w++) {
+          accRows[(long)WORDS * i + w] =
+              combine(accRows[(long)WORDS * i + w],
+                      runRows[(long)WORDS * (i + offset) + w]);
+        }
+      }
+
+      offset += runLength;
+    }
+
+    if (remaining > 1) {
+      // Rows are updated top to bottom, reading only rows below
+      for (int i = 0; i + runLength < PADDED_ROWS; i++) {
+        for (int w = 0; w < WORDS; w++) {
+          runRows[(long)WORDS * i + w] =
+              combine(runRows[(long)WORDS * i + w],
+                      runRows[(long)WORDS * (i + runLength) + w]);
+        }
+      }
+
+      runLength *= 2;
+    }
+  }
+
+  for (int i = 0; i < ROWS; i++) {
+    unsigned long long* out = dest.getRow(i);
+
+    for (int w = 0; w < WORDS; w++) {
+      out[w] = accRows[(long)WORDS * i + w];
+    }
+  }
+
+  dest.clearPadding();
+}
+
+/**
+ * Produces the erosion of a binary image with a rectangular structuring element
+ * of HEIGHT x WIDTH pixels centered on each pixel. A pixel stays set only if
+ * every pixel of the image under the element is set. Matches
+ * image::applyErosion on the unpacked image.
+ *
+ * @param SRC    Binary image
+ * @param dest   Destination binary image of the same dimensions
+ * @param HEIGHT Height of the structuring element
+ * @param WIDTH  Width of the structuring element
+ */
+void applyErosion(const BinaryImage& SRC,
+                  BinaryImage& dest,
+                  const int HEIGHT,
+                  const int WIDTH) {
+  applyRectangle(SRC, dest, HEIGHT, WIDTH, (HEIGHT - 1) / 2, (WIDTH - 1) / 2,
+                 true);
+}
+
+/**
+ * Produces the dilation of a binary image with a rectangular structuring
+ * element of HEIGHT x WIDTH pixels centered on each pixel. A pixel is set if
+ * any pixel of the image under the element is set. Matches
+ * image::applyDilation on the unpacked image.
+ *
+ * @param SRC    Binary image
+ * @param dest   Destination binary image of the same dimensions
+ * @param HEIGHT Height of the structuring element
+ * @param WIDTH  Width of the structuring element
+ */
+void applyDilation(const BinaryImage& SRC,
+                   BinaryImage& dest,
+                   const int HEIGHT,
+                   const int WIDTH) {
+  applyRectangle(SRC, dest, HEIGHT, WIDTH, HEIGHT / 2, WIDTH / 2, false);
+}
+
+/**
+ * Produces the pixel-wise AND of two binary images of the same dimensions.
+ *
+ * @param A    First binary image
+ * @param B    Second binary image
+ * @param dest Destination binary image, may be A or B
+ */
+void applyAnd(const BinaryImage& A, const BinaryImage& B, BinaryImage& dest) {
+  for (int i = 0; i < A.getRows(); i++) {
+    for (int w = 0; w < A.getWordsPerRow(); w++) {
+      dest.getRow(i)[w] = A.getRow(i)[w] & B.getRow(i)[w];
+    }
+  }
+}
+
+/**
+ * Produces the pixel-wise OR of two binary images of the same dimensions.
+ *
+ * @param A    First binary image
+ * @param B    Second binary image
+ * @param dest Destination binary image, may be A or B
+ */
+void applyOr(const BinaryImage& A, const BinaryImage& B, BinaryImage& dest) {
+  for (int i = 0; i < A.getRows(); i++) {
+    for (int w = 0; w < A.getWordsPerRow(); w++) {
+      dest.getRow(i)[w] = A.getRow(i)[w] | B.getRow(i)[w];
+    }
+  }
+}
+
+/**
+ * Produces the pixel-wise XOR of two binary images of the same dimensions.
+ *
+ * @param A    First binary image
+ * @param B    Second binary image
+ * @param dest Destination binary image, may be A or B
+ */
+void applyXor(const BinaryImage& A, const BinaryImage& B, BinaryImage& dest) {
+  for (int i = 0; i < A.getRows(); i++) {
+    for (int w = 0; w < A.getWordsPerRow(); w++) {
+      dest.getRow(i)[w] = A.getRow(i)[w] ^ B.getRow(i)[w];
+    }
+  }
+}
+
+/**
+ * Produces the pixel-wise complement of a binary image.
+ *
+ * @param SRC  Binary image
+ * @param dest Destination binary image, may be SRC
+ */
+void applyNot(const BinaryImage& SRC, BinaryImage& dest) {
+  for (int i = 0; i < SRC.getRows(); i++) {
+    for (int w = 0; w < SRC.getWordsPerRow(); w++) {
+      dest.getRow(i)[w] = ~SRC.getRow(i)[w];
+    }
+  }
+
+  dest.clearPadding();
+}
+
+/**
+ * Returns the number of set pixels in a binary image, counting 64 pixels at a
+ * time with a population count.
+ *
+ * @param SRC Binary image
+ * @returns   Number of set pixels
+ */
+long countArea(const BinaryImage& SRC) {
+  long area = 0;
+
+  for (int i = 0; i < SRC.getRows(); i++) {
+    const unsigned long long* ROW = SRC.getRow(i);
+
+    for (int w = 0; w < SRC.getWordsPerRow(); w++) {
+      area += __builtin_popcountll(ROW[w]);
+    }
+  }
+
+  return area;
+}
+
+}  // namespace image
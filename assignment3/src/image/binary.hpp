@@ -0,0 +1,74 @@
+#ifndef IMAGE_BINARY_H
+#define IMAGE_BINARY_H
+
+#include <vector>
+
+namespace image {
+
+// Number of pixels packed into each word of a binary image
+const int BINARY_WORD_BITS = 64;
+
+/**
+ * Two-level image storing one bit per pixel. Each row is packed into whole
+ * 64-bit words, with column j of a row stored in bit j % 64 of word j / 64.
+ * Bits past the last column of a row are always 0.
+ */
+class BinaryImage {
+ public:
+  BinaryImage(const int ROWS, const int COLS);
+
+  int getRows() const;
+
+  int getCols() const;
+
+  int getWordsPerRow() const;
+
+  unsigned long long* getRow(const int ROW);
+
+  const unsigned long long* getRow(const int ROW) const;
+
+  bool get(const int ROW, const int COL) const;
+
+  void set(const int ROW, const int COL, const bool VALUE);
+
+  void clearPadding();
+
+ private:
+  int rows;
+  int cols;
+  int wordsPerRow;
+  std::vector<unsigned long long> words;
+};
+
+void applyThreshold(const unsigned char* SRC,
+                    BinaryImage& dest,
+                    const unsigned char THRESHOLD);
+
+void genImage(const BinaryImage& SRC,
+              unsigned char* dest,
+              const unsigned char NEW_LOW,
+              const unsigned char NEW_HIGH);
+
+void applyErosion(const BinaryImage& SRC,
+                  BinaryImage& dest,
+                  const int HEIGHT,
+                  const int WIDTH);
+
+void applyDilation(const BinaryImage& SRC,
+                   BinaryImage& dest,
+                   const int HEIGHT,
+                   const int WIDTH);
+
+void applyAnd(const BinaryImage& A, const BinaryImage& B, BinaryImage& dest);
+
+void applyOr(const BinaryImage& A, const BinaryImage& B, BinaryImage& dest);
+
+void applyXor(const BinaryImage& A, const BinaryImage& B, BinaryImage& dest);
+
+void applyNot(const BinaryImage& SRC, BinaryImage& dest);
+
+long countArea(const BinaryImage& SRC);
+
+}  // namespace image
+
+#endif  // IMAGE_BINARY_H
@@ -0,0 +1,311 @@
+#include "binned.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <mutex>
+
+#include "buffer.hpp"
+
+namespace image {
+
+/**
+ * Creates an empty histogram of BINS bins over the range [MIN, MAX]. For
+ * integer pixels, each bin covers the same number of integer values when BINS
+ * divides MAX - MIN + 1, so a histogram of 65536 bins over [0, 65535] has one
+ * bin per value of a 16-bit image.
+ *
+ * @param BINS Number of bins
+ * @param MIN  Lowest value of the first bin
+ * @param MAX  Highest value of the last bin
+ */
+template <class T>
+BinnedHistogram<T>::BinnedHistogram(const int BINS, const T MIN, const T MAX)
+    : bins(BINS),
+      min(MIN),
+      max(MAX),
+      total(0),
+      fine(BINS > 0 ? BINS : 0, 0),
+      coarse(BINS > 0 ? (BINS + BINNED_COARSE_SIZE - 1) / BINNED_COARSE_SIZE
+                      : 0,
+             0) {
+  // Ensure that the bins and range are valid
+  if (BINS <= 0 || !(MIN < MAX)) {
+    throw "ERROR: Histogram needs BINS > 0 and MIN < MAX!";
+  }
+
+  // Integer ranges include the value MAX itself
+  const double WIDTH = (double)MAX - (double)MIN +
+                       (std::numeric_limits<T>::is_integer ? 1 : 0);
+
+  scale = BINS / WIDTH;
+}
+
+/**
+ * Returns the bin of the given value. Values below the range, including
+ * negative infinity and NaN, fall in the first bin, and values above the range,
+ * including positive infinity, in the last bin.
+ *
+ * @param VALUE Pixel value
+ * @returns     Index of the bin
+ */
+template <class T>
+int BinnedHistogram<T>::getBin(const T VALUE) const {
+  if (!(VALUE > min)) {
+    return 0;
+  }
+
+  // Compare before converting, since a huge or infinite value does not fit in
+  // an int
+  const double POSITION = ((double)VALUE - (double)min) * scale;
+
+  return POSITION < bins ? (int)POSITION : bins - 1;
+}
+
+/**
+ * Adds the bins of COUNT pixels to the given bins.
+ *
+ * @param SRC   Buffer containing pixels
+ * @param dest  Bins to add to
+ * @param COUNT Number of pixels
+ */
+template <class T>
+void BinnedHistogram<T>::countRows(const T* SRC,
+                                   unsigned int dest[],
+                                   const long COUNT) const {
+  for (long i = 0; i < COUNT; i++) {
+    dest[getBin(SRC[i])]++;
+  }
+}
+
+/**
+ * Replaces the histogram with the histogram of the given image.
+ *
+ * @param SRC  Buffer containing image
+ * @param ROWS Number of rows in image
+ * @param COLS Number of columns in image
+ */
+template <class T>
+void BinnedHistogram<T>::count(const T* SRC, const int ROWS, const int COLS) {
+  parallel::Executor serial(1);
+
+  count(SRC, ROWS, COLS, serial);
+}
+
+/**
+ * Replaces the histogram with the histogram of the given image, counting bands
+ * of rows in parallel with the given executor. Each band counts into its own
+ * bins, and the bins of all bands are summed as they finish.
+ *
+ * @param SRC      Buffer containing image
+ * @param ROWS     Number of rows in image
+ * @param COLS     Number of columns in image
+ * @param executor Executor that counts the bands
+ */
+template <class T>
+void BinnedHistogram<T>::count(const T* SRC,
+                               const int ROWS,
+                               const int COLS,
+                               parallel::Executor& executor) {
+  std::mutex mutex;
+
+  std::fill(fine.begin(), fine.end(), 0);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    // 32-bit bins keep a dense histogram of 65536 bins within 256 KiB
+    Buffer<unsigned int> bandBins(bins);
+
+    std::fill(bandBins.get(), bandBins.get() + bins, 0);
+
+    countRows(&SRC[(long)COLS * ROW_BEGIN], bandBins.get(),
+              (long)COLS * (ROW_END - ROW_BEGIN));
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (int i = 0; i < bins; i++) {
+      fine[i] += bandBins.get()[i];
+    }
+  });
+
+  // Sum the coarse bins and total
+  std::fill(coarse.begin(), coarse.end(), 0);
+  total = 0;
+
+  for (int i = 0; i < bins; i++) {
+    coarse[i / BINNED_COARSE_SIZE] += fine[i];
+    total += fine[i];
+  }
+}
+
+/**
+ * Returns the number of bins of the histogram.
+ *
+ * @returns Number of bins
+ */
+template <class T>
+int BinnedHistogram<T>::getBinCount() const {
+  return bins;
+}
+
+/**
+ * Returns the number of pixels counted by the histogram.
+ *
+ * @returns Number of pixels
+ */
+template <class T>
+long BinnedHistogram<T>::getTotal() const {
+  return total;
+}
+
+/**
+ * Returns the number of pixels in the given bin.
+ *
+ * @param BIN Index of the bin
+ * @returns   Frequency of the bin
+ */
+template <class T>
+long BinnedHistogram<T>::getFrequency(const int BIN) const {
+  return fine[BIN];
+}
+
+/**
+ * Returns the number of pixels in the bins up to and including the given bin,
+ * summing whole coarse bins before the coarse bin of BIN.
+ *
+ * @param BIN Index of the bin
+ * @returns   Cumulative frequency of the bin
+ */
+template <class T>
+long BinnedHistogram<T>::getCumulative(const int BIN) const {
+  const int GROUP = BIN / BINNED_COARSE_SIZE;
+  long cumulative = 0;
+
+  for (int i = 0; i < GROUP; i++) {
+    cumulative += coarse[i];
+  }
+
+  for (int i = GROUP * BINNED_COARSE_SIZE; i <= BIN; i++) {
+    cumulative += fine[i];
+  }
+
+  return cumulative;
+}
+
+/**
+ * Returns the bin of the pixel at the given rank, counting the lowest pixel as
+ * rank 0. The coarse bins are searched first.
+ *
+ * @param RANK Rank in [0, getTotal())
+ * @returns    Index of the bin
+ */
+template <class T>
+int BinnedHistogram<T>::getBinAtRank(const long RANK) const {
+  const int GROUPS = coarse.size();
+  long remaining = RANK;
+  int group = 0;
+
+  while (group + 1 < GROUPS && remaining >= coarse[group]) {
+    remaining -= coarse[group];
+    group++;
+  }
+
+  int bin = group * BINNED_COARSE_SIZE;
+
+  while (bin + 1 < bins && remaining >= fine[bin]) {
+    remaining -= fine[bin];
+    bin++;
+  }
+
+  return bin;
+}
+
+/**
+ * Returns the lowest value of the given bin.
+ *
+ * @param BIN Index of the bin
+ * @returns   Value at the start of the bin
+ */
+template <class T>
+T BinnedHistogram<T>::getBinStart(const int BIN) const {
+  return (T)((double)min + BIN / scale);
+}
+
+/**
+ * Produces the cumulative histogram into the destination buffer, which must
+ * hold getBinCount() values.
+ *
+ * @param dest Destination buffer for cumulative histogram
+ */
+template <class T>
+void BinnedHistogram<T>::genCumulativeHistogram(long dest[]) const {
+  long cumulative = 0;
+
+  for (int i = 0; i < bins; i++) {
+    cumulative += fine[i];
+    dest[i] = cumulative;
+  }
+}
+
+/**
+ * Produces a new image by equalizing the given image with this histogram,
+ * which is usually the histogram of the same image. Each pixel is mapped to
+ * the cumulative frequency of its bin, scaled from [0, getTotal()] to
+ * [MIN, MAX], which is what genEqualizedHistogramImage does for 8-bit images
+ * with a histogram of 256 bins over [0, 255].
+ *
+ * @param SRC  Buffer containing original image
+ * @param dest Destination buffer for equalized image
+ * @param ROWS Number of rows in original image
+ * @param COLS Number of columns in original image
+ */
+template <class T>
+void BinnedHistogram<T>::equalize(const T* SRC,
+                                  T* dest,
+                                  const int ROWS,
+                                  const int COLS) const {
+  parallel::Executor serial(1);
+
+  equalize(SRC, dest, ROWS, COLS, serial);
+}
+
+/**
+ * Produces the same image as BinnedHistogram::equalize, mapping bands of rows
+ * in parallel with the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for equalized image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that maps the bands
+ */
+template <class T>
+void BinnedHistogram<T>::equalize(const T* SRC,
+                                  T* dest,
+                                  const int ROWS,
+                                  const int COLS,
+                                  parallel::Executor& executor) const {
+  if (total == 0) {
+    return;
+  }
+
+  // New value of each bin
+  std::vector<T> table(bins);
+  const double S = ((double)max - (double)min) / total;
+  long cumulative = 0;
+
+  for (int i = 0; i < bins; i++) {
+    cumulative += fine[i];
+    table[i] = (T)((double)min + cumulative * S);
+  }
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    for (long i = (long)COLS * ROW_BEGIN; i < (long)COLS * ROW_END; i++) {
+      dest[i] = table[getBin(SRC[i])];
+    }
+  });
+}
+
+template class BinnedHistogram<unsigned char>;
+template class BinnedHistogram<unsigned short>;
+template class BinnedHistogram<float>;
+
+}  // namespace image
@@ -0,0 +1,74 @@
+#ifndef IMAGE_BINNED_H
+#define IMAGE_BINNED_H
+
+#include <vector>
+
+#include "../parallel/executor.hpp"
+
+namespace image {
+
+// Number of fine bins summed by each coarse bin of a BinnedHistogram
+const int BINNED_COARSE_SIZE = 256;
+
+/**
+ * Histogram of an image with pixels of type T, such as 16-bit or floating
+ * point images, that divides a range of values [MIN, MAX] into a configurable
+ * number of equal bins. Values outside of the range are counted in the first
+ * or last bin. Besides the fine bins, every run of BINNED_COARSE_SIZE bins is
+ * summed into a coarse bin, so that cumulative and rank queries on dense
+ * histograms of up to 65536 bins only visit a few hundred bins.
+ *
+ * Instantiated for unsigned char, unsigned short and float pixels.
+ */
+template <class T>
+class BinnedHistogram {
+ public:
+  BinnedHistogram(const int BINS, const T MIN, const T MAX);
+
+  void count(const T* SRC, const int ROWS, const int COLS);
+
+  void count(const T* SRC,
+             const int ROWS,
+             const int COLS,
+             parallel::Executor& executor);
+
+  int getBin(const T VALUE) const;
+
+  int getBinCount() const;
+
+  long getTotal() const;
+
+  long getFrequency(const int BIN) const;
+
+  long getCumulative(const int BIN) const;
+
+  int getBinAtRank(const long RANK) const;
+
+  T getBinStart(const int BIN) const;
+
+  void genCumulativeHistogram(long dest[]) const;
+
+  void equalize(const T* SRC, T* dest, const int ROWS, const int COLS) const;
+
+  void equalize(const T* SRC,
+                T* dest,
+                const int ROWS,
+                const int COLS,
+                parallel::Executor& executor) const;
+
+ private:
+  void countRows(const T* SRC, unsigned int dest[], const long COUNT) const;
+
+  int bins;
+  T min;
+  T max;
+  // Bins per unit of value
+  double scale;
+  long total;
+  std::vector<long> fine;
+  std::vector<long> coarse;
+};
+
+}  // namespace image
+
+#endif  // IMAGE_BINNED_H
@@ -0,0 +1,105 @@
+#include "buffer.hpp"
+
+#include <new>
+
+namespace image {
+
+/**
+ * Returns the given size in bytes rounded up to a multiple of
+ * BUFFER_GRANULARITY.
+ *
+ * @param SIZE Size in bytes
+ * @returns    Rounded size in bytes
+ */
+static unsigned long roundSize(const unsigned long SIZE) {
+  const unsigned long BLOCKS =
+      (SIZE + BUFFER_GRANULARITY - 1) / BUFFER_GRANULARITY;
+
+  return (BLOCKS > 0 ? BLOCKS : 1) * BUFFER_GRANULARITY;
+}
+
+/**
+ * Creates an empty buffer pool.
+ *
+ * @param LIMIT Maximum total size in bytes of released buffers to keep
+ */
+BufferPool::BufferPool(const unsigned long LIMIT) : retained(0), limit(LIMIT) {}
+
+/**
+ * Frees all buffers that were released to the pool.
+ */
+BufferPool::~BufferPool() {
+  for (const auto& entry : available) {
+    ::operator delete(entry.second, std::align_val_t(BUFFER_ALIGNMENT));
+  }
+}
+
+/**
+ * Returns a buffer of at least the given size, aligned to BUFFER_ALIGNMENT
+ * bytes. The smallest released buffer that fits the rounded size is reused if
+ * it is at most twice that size, otherwise a new buffer is allocated.
+ *
+ * @param SIZE     Size of the buffer in bytes
+ * @param capacity Set to the size in bytes of the returned buffer, which has to
+ *                 be passed to release
+ * @returns        Pointer to the buffer
+ */
+void* BufferPool::acquire(const unsigned long SIZE, unsigned long& capacity) {
+  const unsigned long ROUNDED_SIZE = roundSize(SIZE);
+
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    auto entry = available.lower_bound(ROUNDED_SIZE);
+
+    // Do not tie up a much larger buffer in a small request
+    if (entry != available.end() && entry->first / 2 <= ROUNDED_SIZE) {
+      void* buffer = entry->second;
+
+      capacity = entry->first;
+      retained -= capacity;
+      available.erase(entry);
+
+      return buffer;
+    }
+  }
+
+  capacity = ROUNDED_SIZE;
+
+  return ::operator new(ROUNDED_SIZE, std::align_val_t(BUFFER_ALIGNMENT));
+}
+
+/**
+ * Returns a buffer obtained from acquire to the pool so that it can be reused.
+ * The buffer is freed instead if keeping it would exceed the limit of the
+ * pool.
+ *
+ * @param buffer   Buffer to release
+ * @param CAPACITY Capacity that acquire returned for this buffer
+ */
+void BufferPool::release(void* buffer, const unsigned long CAPACITY) {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+
+    if (retained + CAPACITY <= limit) {
+      available.emplace(CAPACITY, buffer);
+      retained += CAPACITY;
+
+      return;
+    }
+  }
+
+  ::operator delete(buffer, std::align_val_t(BUFFER_ALIGNMENT));
+}
+
+/**
+ * Returns a buffer pool shared by the whole program.
+ *
+ * @returns Shared buffer pool
+ */
+BufferPool& BufferPool::shared() {
+  static BufferPool pool;
+
+  return pool;
+}
+
+}  // namespace image
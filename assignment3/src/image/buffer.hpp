@@ -0,0 +1,77 @@
+#ifndef IMAGE_BUFFER_H
+#define IMAGE_BUFFER_H
+
+#include <map>
+#include <mutex>
+
+namespace image {
+
+// Alignment of buffers handed out by a BufferPool, in bytes
+const unsigned long BUFFER_ALIGNMENT = 64;
+// Buffer sizes are rounded up to a multiple of this many bytes so that buffers
+// of similar sizes can be reused for each other
+const unsigned long BUFFER_GRANULARITY = 4096;
+// Default number of bytes of released buffers that a BufferPool keeps for
+// reuse, buffers released beyond it are freed
+const unsigned long BUFFER_POOL_LIMIT = 128UL << 20;
+
+/**
+ * Pool of heap-allocated scratch buffers. Released buffers are kept, up to a
+ * limit on their total size, and handed out again to later requests that fit
+ * in them, so that intermediate images of a pipeline that runs on every frame
+ * are only allocated once.
+ */
+class BufferPool {
+ public:
+  explicit BufferPool(const unsigned long LIMIT = BUFFER_POOL_LIMIT);
+  ~BufferPool();
+
+  BufferPool(const BufferPool&) = delete;
+  BufferPool& operator=(const BufferPool&) = delete;
+
+  void* acquire(const unsigned long SIZE, unsigned long& capacity);
+
+  void release(void* buffer, const unsigned long CAPACITY);
+
+  static BufferPool& shared();
+
+ private:
+  // Released buffers keyed by their capacity in bytes
+  std::multimap<unsigned long, void*> available;
+  // Total capacity of the released buffers in bytes
+  unsigned long retained;
+  // Maximum total capacity of released buffers to keep, in bytes
+  unsigned long limit;
+  std::mutex mutex;
+};
+
+/**
+ * Scratch buffer of COUNT elements of type T acquired from a BufferPool and
+ * returned to it when the buffer goes out of scope. The contents of a newly
+ * acquired buffer are undefined.
+ */
+template <class T>
+class Buffer {
+ public:
+  explicit Buffer(const unsigned long COUNT,
+                  BufferPool& pool = BufferPool::shared())
+      : pool(pool), data((T*)pool.acquire(sizeof(T) * COUNT, capacity)) {}
+
+  ~Buffer() { pool.release(data, capacity); }
+
+  Buffer(const Buffer&) = delete;
+  Buffer& operator=(const Buffer&) = delete;
+
+  T* get() { return data; }
+
+  const T* get() const { return data; }
+
+ private:
+  BufferPool& pool;
+  unsigned long capacity;
+  T* data;
+};
+
+}  // namespace image
+
+#endif  // IMAGE_BUFFER_H
@@ -0,0 +1,297 @@
+#include "canny.hpp"
+
+#include <vector>
+
+#include "buffer.hpp"
+#include "filter.hpp"
+#include "image.hpp"
+
+namespace image {
+
+// Labels of pixels after non-maximum suppression. Weak edges are only kept if
+// they are connected to a strong edge.
+const unsigned char CANNY_NONE = LEVEL_BLACK;
+const unsigned char CANNY_WEAK = LEVEL_BLACK + 1;
+const unsigned char CANNY_STRONG = LEVEL_WHITE;
+
+/**
+ * Thins the gradient of the rows in the range [ROW_BEGIN, ROW_END) of the
+ * image to ridges one pixel wide and classifies the remaining pixels. The
+ * gradient direction is quantized to horizontal, vertical and the two
+ * diagonals, and a pixel is kept only if its magnitude is a maximum along that
+ * direction. Squared magnitudes are compared, so no square roots are taken.
+ *
+ * @param X         Horizontal derivatives of the image
+ * @param Y         Vertical derivatives of the image
+ * @param dest      Destination buffer for pixel labels
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param LOW       Squared magnitude of weak edges
+ * @param HIGH      Squared magnitude of strong edges
+ * @param ROW_BEGIN First row to compute
+ * @param ROW_END   Row after the last row to compute
+ */
+static void applyNonMaximumSuppressionRows(const short* X,
+                                           const short* Y,
+                                           unsigned char* dest,
+                                           const int ROWS,
+                                           const int COLS,
+                                           const int LOW,
+                                           const int HIGH,
+                                           const int ROW_BEGIN,
+                                           const int ROW_END) {
+  // Squared magnitudes of the band and one row above and below it, with rows
+  // outside of the image left at 0
+  const int BAND_ROWS = ROW_END - ROW_BEGIN + 2;
+  Buffer<int> magnitude((unsigned long)BAND_ROWS * COLS);
+  int* m = magnitude.get();
+
+  for (int r = 0; r < BAND_ROWS; r++) {
+    const int ROW = ROW_BEGIN - 1 + r;
+
+    for (int j = 0; j < COLS; j++) {
+      if (ROW < 0 || ROW >= ROWS) {
+        m[(long)COLS * r + j] = 0;
+      } else {
+        const int DX = X[(long)COLS * ROW + j];
+        const int DY = Y[(long)COLS * ROW + j];
+
+        m[(long)COLS * r + j] = DX * DX + DY * DY;
+      }
+    }
+  }
+
+  // Squared magnitude at an offset from a pixel, 0 outside of the image
+  auto at = [&](const int R, const int COL) {
+    return COL < 0 || COL >= COLS ? 0 : m[(long)COLS * R + COL];
+  };
+
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
+    const int R = i - ROW_BEGIN + 1;
+
+    for (int j = 0; j < COLS; j++) {
+      const int MAGNITUDE = m[(long)COLS * R + j];
+
+      if (MAGNITUDE < LOW || MAGNITUDE == 0) {
+        dest[(long)COLS * i + j] = CANNY_NONE;
+        continue;
+      }
+
+      const int DX = X[(long)COLS * i + j];
+      const int DY = Y[(long)COLS * i + j];
+      const int ABS_X = DX < 0 ? -DX : DX;
+      const int ABS_Y = DY < 0 ? -DY : DY;
+
+      // Step towards the neighbour along the gradient, using
+      // tan(22.5 deg) ~= 29 / 70 to bound the sectors
+      int stepRow;
+      int stepCol;
+
+      if (70 * ABS_Y <= 29 * ABS_X) {
+        stepRow = 0;
+        stepCol = 1;
+      } else if (29 * ABS_Y >= 70 * ABS_X) {
+        stepRow = 1;
+        stepCol = 0;
+      } else {
+        stepRow = 1;
+        stepCol = (DX < 0) == (DY < 0) ? 1 : -1;
+      }
+
+      const int AHEAD = at(R + stepRow, j + stepCol);
+      const int BEHIND = at(R - stepRow, j - stepCol);
+
+      if (MAGNITUDE > AHEAD && MAGNITUDE >= BEHIND) {
+        dest[(long)COLS * i + j] =
+            MAGNITUDE >= HIGH ? CANNY_STRONG : CANNY_WEAK;
+      } else {
+        dest[(long)COLS * i + j] = CANNY_NONE;
+      }
+    }
+  }
+}
+
+/**
+ * Promotes every weak edge connected to the given strong edge to a strong
+ * edge, following 8-connected neighbours in the rows in the range
+ * [ROW_BEGIN, ROW_END). Uses an explicit stack rather than recursion, so long
+ * edges do not overflow the call stack.
+ *
+ * @param labels    Pixel labels
+ * @param COLS      Number of columns in original image
+ * @param ROW_BEGIN First row that may be followed
+ * @param ROW_END   Row after the last row that may be followed
+ * @param SEED      Index of a strong edge pixel
+ * @param stack     Scratch stack of pixel indices, empty on return
+ */
+static void linkEdges(unsigned char* labels,
+                      const int COLS,
+                      const int ROW_BEGIN,
+                      const int ROW_END,
+                      const long SEED,
+                      std::vector<long>& stack) {
+  stack.push_back(SEED);
+
+  while (!stack.empty()) {
+    const long INDEX = stack.back();
+    const int ROW = INDEX / COLS;
+    const int COL = INDEX % COLS;
+
+    stack.pop_back();
+
+    for (int k = -1; k <= 1; k++) {
+      for (int l = -1; l <= 1; l++) {
+        // Ensure that the neighbour is within bounds
+        if (ROW + k < ROW_BEGIN || ROW + k >= ROW_END || COL + l < 0 ||
+            COL + l >= COLS) {
+          continue;
+        }
+
+        const long NEIGHBOUR = INDEX + (long)COLS * k + l;
+
+        if (labels[NEIGHBOUR] == CANNY_WEAK) {
+          labels[NEIGHBOUR] = CANNY_STRONG;
+          stack.push_back(NEIGHBOUR);
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Produces a binary edge map of the given image using the Canny edge detector
+ * and outputs the result to the destination buffer, with edges set to
+ * LEVEL_WHITE and other pixels to LEVEL_BLACK.
+ *
+ * @param SRC            Buffer containing original image
+ * @param dest           Destination buffer for edge map
+ * @param ROWS           Number of rows in original image
+ * @param COLS           Number of columns in original image
+ * @param SIGMA          Standard deviation of the Gaussian used to smooth the
+ *                       image first, at least 0.5, or 0 to skip smoothing
+ * @param LOW_THRESHOLD  Smallest Sobel gradient magnitude of weak edges
+ * @param HIGH_THRESHOLD Smallest Sobel gradient magnitude of strong edges
+ */
+void applyCannyEdgeDetector(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const double SIGMA,
+                            const int LOW_THRESHOLD,
+                            const int HIGH_THRESHOLD) {
+  parallel::Executor serial(1);
+
+  applyCannyEdgeDetector(SRC, dest, ROWS, COLS, SIGMA, LOW_THRESHOLD,
+                         HIGH_THRESHOLD, serial);
+}
+
+/**
+ * Produces the same edge map as applyCannyEdgeDetector, running each stage on
+ * bands of rows in parallel with the given executor. Intermediate images are
+ * taken from the shared buffer pool.
+ *
+ * The image is smoothed with applyGaussianFilter and differentiated with
+ * genSobelGradient. Non-maximum suppression and classification into weak and
+ * strong edges are then done in a single pass per band. Hysteresis links weak
+ * edges to strong edges within each band first, and then follows the edges
+ * that cross the boundaries between bands.
+ *
+ * @param SRC            Buffer containing original image
+ * @param dest           Destination buffer for edge map
+ * @param ROWS           Number of rows in original image
+ * @param COLS           Number of columns in original image
+ * @param SIGMA          Standard deviation of the Gaussian used to smooth the
+ *                       image first, at least 0.5, or 0 to skip smoothing
+ * @param LOW_THRESHOLD  Smallest Sobel gradient magnitude of weak edges
+ * @param HIGH_THRESHOLD Smallest Sobel gradient magnitude of strong edges
+ * @param executor       Executor that runs the bands
+ */
+void applyCannyEdgeDetector(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const double SIGMA,
+                            const int LOW_THRESHOLD,
+                            const int HIGH_THRESHOLD,
+                            parallel::Executor& executor) {
+  // Ensure that the thresholds are ordered
+  if (LOW_THRESHOLD < 0 || LOW_THRESHOLD > HIGH_THRESHOLD) {
+    throw "ERROR: Canny thresholds must satisfy 0 <= low <= high!";
+  }
+
+  if (ROWS <= 0 || COLS <= 0) {
+    return;
+  }
+
+  const unsigned long SIZE = (unsigned long)ROWS * COLS;
+  Buffer<unsigned char> smoothed(SIZE);
+  Buffer<short> gradientX(SIZE);
+  Buffer<short> gradientY(SIZE);
+
+  // Smooth the image, unless disabled
+  const unsigned char* input = SRC;
+
+  if (SIGMA != 0) {
+    applyGaussianFilter(SRC, smoothed.get(), ROWS, COLS, SIGMA, executor);
+    input = smoothed.get();
+  }
+
+  SobelGradient gradient;
+  gradient.x = gradientX.get();
+  gradient.y = gradientY.get();
+
+  genSobelGradient(input, gradient, ROWS, COLS, MAGNITUDE_EXACT, 0, executor);
+
+  // Rows at the top and bottom of a band, where edges may continue into the
+  // neighbouring band. Each band writes only its own rows.
+  std::vector<char> boundary(ROWS, 0);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    applyNonMaximumSuppressionRows(
+        gradientX.get(), gradientY.get(), dest, ROWS, COLS,
+        LOW_THRESHOLD * LOW_THRESHOLD, HIGH_THRESHOLD * HIGH_THRESHOLD,
+        ROW_BEGIN, ROW_END);
+  });
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    std::vector<long> stack;
+
+    for (long index = (long)COLS * ROW_BEGIN; index < (long)COLS * ROW_END;
+         index++) {
+      if (dest[index] == CANNY_STRONG) {
+        linkEdges(dest, COLS, ROW_BEGIN, ROW_END, index, stack);
+      }
+    }
+
+    boundary[ROW_BEGIN] = 1;
+    boundary[ROW_END - 1] = 1;
+  });
+
+  // Any weak edge still unlinked but connected to a strong edge is reached
+  // through a strong edge on a band boundary
+  std::vector<long> stack;
+
+  for (int i = 0; i < ROWS; i++) {
+    if (!boundary[i]) {
+      continue;
+    }
+
+    for (long index = (long)COLS * i; index < (long)COLS * (i + 1); index++) {
+      if (dest[index] == CANNY_STRONG) {
+        linkEdges(dest, COLS, 0, ROWS, index, stack);
+      }
+    }
+  }
+
+  // Discard the remaining weak edges
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    for (long index = (long)COLS * ROW_BEGIN; index < (long)COLS * ROW_END;
+         index++) {
+      if (dest[index] == CANNY_WEAK) {
+        dest[index] = CANNY_NONE;
+      }
+    }
+  });
+}
+
+}  // namespace image
@@ -0,0 +1,27 @@
+#ifndef IMAGE_CANNY_H
+#define IMAGE_CANNY_H
+
+#include "../parallel/executor.hpp"
+
+namespace image {
+
+void applyCannyEdgeDetector(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const double SIGMA,
+                            const int LOW_THRESHOLD,
+                            const int HIGH_THRESHOLD);
+
+void applyCannyEdgeDetector(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const double SIGMA,
+                            const int LOW_THRESHOLD,
+                            const int HIGH_THRESHOLD,
+                            parallel::Executor& executor);
+
+}  // namespace image
+
+#endif  // IMAGE_CANNY_H
@@ -0,0 +1,517 @@
+#include "corner.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include "buffer.hpp"
+#include "filter.hpp"
+
+namespace image {
+
+/**
+ * Returns the weights of a window of 2 * RADIUS + 1 taps along one axis,
+ * normalized to sum to 1. The window is a box if SIGMA is 0, and a sampled
+ * Gaussian of the given standard deviation otherwise.
+ *
+ * @param RADIUS Radius of the window
+ * @param SIGMA  Standard deviation of the Gaussian, or 0 for a box
+ * @returns      Weights of the window
+ */
+static std::vector<float> genWindow(const int RADIUS, const double SIGMA) {
+  std::vector<float> weights(2 * RADIUS + 1);
+  double sum = 0;
+
+  for (int k = -RADIUS; k <= RADIUS; k++) {
+    const double WEIGHT =
+        SIGMA == 0 ? 1 : std::exp(-k * k / (2 * SIGMA * SIGMA));
+
+    weights[RADIUS + k] = WEIGHT;
+    sum += WEIGHT;
+  }
+
+  for (float& weight : weights) {
+    weight /= sum;
+  }
+
+  return weights;
+}
+
+/**
+ * Computes the corner response for the rows in the range [ROW_BEGIN, ROW_END)
+ * of the image. The products of the derivatives are smoothed along the rows
+ * for the band and RADIUS rows above and below it, and then along the columns.
+ * The image is extended beyond its border by repeating the border pixels.
+ *
+ * @param X         Horizontal derivatives of the image
+ * @param Y         Vertical derivatives of the image
+ * @param dest      Destination buffer for the response
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param MEASURE   Corner measure to compute
+ * @param WINDOW    Weights of the smoothing window along one axis
+ * @param K         Sensitivity of the Harris measure
+ * @param ROW_BEGIN First row to compute
+ * @param ROW_END   Row after the last row to compute
+ */
+static void genCornerResponseRows(const short* X,
+                                  const short* Y,
+                                  float* dest,
+                                  const int ROWS,
+                                  const int COLS,
+                                  const CornerMeasure MEASURE,
+                                  const std::vector<float>& WINDOW,
+                                  const double K,
+                                  const int ROW_BEGIN,
+                                  const int ROW_END) {
+  const int RADIUS = WINDOW.size() / 2;
+  const int BAND_ROWS = ROW_END - ROW_BEGIN + 2 * RADIUS;
+  // Horizontally smoothed Ix^2, Iy^2 and IxIy of the band, interleaved
+  Buffer<float> smoothed((unsigned long)3 * BAND_ROWS * COLS);
+  float* s = smoothed.get();
+
+  for (int r = 0; r < BAND_ROWS; r++) {
+    const int ROW = std::min(std::max(ROW_BEGIN - RADIUS + r, 0), ROWS - 1);
+    const short* ROW_X = &X[(long)COLS * ROW];
+    const short* ROW_Y = &Y[(long)COLS * ROW];
+
+    for (int j = 0; j < COLS; j++) {
+      float xx = 0;
+      float yy = 0;
+      float xy = 0;
+
+      for (int k = -RADIUS; k <= RADIUS; k++) {
+        const int COL = std::min(std::max(j + k, 0), COLS - 1);
+        const float DX = ROW_X[COL];
+        const float DY = ROW_Y[COL];
+        const float WEIGHT = WINDOW[RADIUS + k];
+
+        xx += WEIGHT * DX * DX;
+        yy += WEIGHT * DY * DY;
+        xy += WEIGHT * DX * DY;
+      }
+
+      float* out = &s[3 * ((long)COLS * r + j)];
+      out[0] = xx;
+      out[1] = yy;
+      out[2] = xy;
+    }
+  }
+
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
+    const int R = i - ROW_BEGIN + RADIUS;
+
+    for (int j = 0; j < COLS; j++) {
+      float a = 0;
+      float c = 0;
+      float b = 0;
+
+      for (int k = -RADIUS; k <= RADIUS; k++) {
+        const float* IN = &s[3 * ((long)COLS * (R + k) + j)];
+        const float WEIGHT = WINDOW[RADIUS + k];
+
+        a += WEIGHT * IN[0];
+        c += WEIGHT * IN[1];
+        b += WEIGHT * IN[2];
+      }
+
+      // Structure tensor M = [a b; b c]
+      if (MEASURE == CORNER_SHI_TOMASI) {
+        const float HALF_DIFFERENCE = (a - c) / 2;
+
+        dest[(long)COLS * i + j] =
+            (a + c) / 2 -
+            std::sqrt(HALF_DIFFERENCE * HALF_DIFFERENCE + b * b);
+      } else {
+        dest[(long)COLS * i + j] = a * c - b * b - K * (a + c) * (a + c);
+      }
+    }
+  }
+}
+
+/**
+ * Computes the corner response of every pixel of the given image and outputs
+ * the result to the destination buffer. The structure tensor of a pixel is
+ * built from the signed Sobel derivatives Ix and Iy, whose products Ix^2, Iy^2
+ * and IxIy are smoothed with a separable window of (2 * RADIUS + 1) x
+ * (2 * RADIUS + 1) pixels.
+ *
+ * @param SRC     Buffer containing original image
+ * @param dest    Destination buffer for the response
+ * @param ROWS    Number of rows in original image
+ * @param COLS    Number of columns in original image
+ * @param MEASURE Corner measure to compute
+ * @param RADIUS  Radius of the smoothing window
+ * @param SIGMA   Standard deviation of a Gaussian window, or 0 for a box
+ * @param K       Sensitivity of the Harris measure, typically 0.04 to 0.06
+ */
+void genCornerResponse(const unsigned char* SRC,
+                       float* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const CornerMeasure MEASURE,
+                       const int RADIUS,
+                       const double SIGMA,
+                       const double K) {
+  parallel::Executor serial(1);
+
+  genCornerResponse(SRC, dest, ROWS, COLS, MEASURE, RADIUS, SIGMA, K, serial);
+}
+
+/**
+ * Produces the same response as genCornerResponse, splitting the image into
+ * bands of rows that are computed in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for the response
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param MEASURE  Corner measure to compute
+ * @param RADIUS   Radius of the smoothing window
+ * @param SIGMA    Standard deviation of a Gaussian window, or 0 for a box
+ * @param K        Sensitivity of the Harris measure, typically 0.04 to 0.06
+ * @param executor Executor that runs the bands
+ */
+void genCornerResponse(const unsigned char* SRC,
+                       float* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const CornerMeasure MEASURE,
+                       const int RADIUS,
+                       const double SIGMA,
+                       const double K,
+                       parallel::Executor& executor) {
+  // Ensure that the window is valid
+  if (RADIUS < 0 || SIGMA < 0) {
+    throw "ERROR: Corner window radius and sigma must not be negative!";
+  }
+
+  if (ROWS <= 0 || COLS <= 0) {
+    return;
+  }
+
+  const std::vector<float> WINDOW = genWindow(RADIUS, SIGMA);
+  Buffer<short> gradientX((unsigned long)ROWS * COLS);
+  Buffer<short> gradientY((unsigned long)ROWS * COLS);
+
+  SobelGradient gradient;
+  gradient.x = gradientX.get();
+  gradient.y = gradientY.get();
+
+  genSobelGradient(SRC, gradient, ROWS, COLS, MAGNITUDE_EXACT, 0, executor);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    genCornerResponseRows(gradientX.get(), gradientY.get(), dest, ROWS, COLS,
+                          MEASURE, WINDOW, K, ROW_BEGIN, ROW_END);
+  });
+}
+
+/**
+ * Returns whether corner A should be ranked before corner B: stronger corners
+ * first, then in raster order.
+ *
+ * @param A First corner
+ * @param B Second corner
+ * @returns Whether A is ranked before B
+ */
+static bool isStrongerCorner(const Corner& A, const Corner& B) {
+  if (A.response != B.response) {
+    return A.response > B.response;
+  }
+
+  return A.row != B.row ? A.row < B.row : A.col < B.col;
+}
+
+/**
+ * Returns the larger of two values, ignoring B if it is NaN.
+ *
+ * @param A First value
+ * @param B Second value
+ * @returns Larger value
+ */
+static float getLarger(const float A, const float B) {
+  return B > A ? B : A;
+}
+
+/**
+ * Returns the number of elements of a sequence of COUNT elements padded by
+ * RADIUS empty elements on both sides and rounded up to a whole number of
+ * windows of 2 * RADIUS + 1 elements, as scanned by genWindowMaxima.
+ *
+ * @param COUNT  Number of elements in the sequence
+ * @param RADIUS Radius of the window
+ * @returns      Number of elements in the padded sequence
+ */
+static int getPaddedCount(const int COUNT, const int RADIUS) {
+  const int SIZE = 2 * RADIUS + 1;
+
+  return (COUNT + 2 * RADIUS + SIZE - 1) / SIZE * SIZE;
+}
+
+/**
+ * Computes the maximum of every window of 2 * RADIUS + 1 consecutive elements
+ * of a sequence, clipped to the ends of the sequence, with the algorithm of
+ * van Herk and Gil and Werman. The padded sequence is split into blocks of the
+ * window size, and every window is covered by a suffix of one block and a
+ * prefix of the next, so the cost does not depend on the radius. Each element
+ * is a vector of WIDTH floats, and NaN values are ignored.
+ *
+ * @param SRC    Sequence of COUNT vectors of WIDTH floats
+ * @param dest   Destination for the COUNT vectors of window maxima
+ * @param COUNT  Number of elements in the sequence
+ * @param WIDTH  Number of floats in each element
+ * @param RADIUS Radius of the window
+ * @param prefix Scratch buffer of getPaddedCount(COUNT, RADIUS) * WIDTH floats
+ * @param suffix Scratch buffer of the same size as prefix
+ */
+static void genWindowMaxima(const float* SRC,
+                            float* dest,
+                            const int COUNT,
+                            const int WIDTH,
+                            const int RADIUS,
+                            float* prefix,
+                            float* suffix) {
+  const int SIZE = 2 * RADIUS + 1;
+  const int PADDED = getPaddedCount(COUNT, RADIUS);
+  const float EMPTY = -HUGE_VALF;
+
+  // Copy the sequence between the padding, dropping NaN values
+  for (int x = 0; x < PADDED; x++) {
+    const int SOURCE = x - RADIUS;
+    float* row = &prefix[(long)WIDTH * x];
+
+    if (SOURCE < 0 || SOURCE >= COUNT) {
+      std::fill(row, row + WIDTH, EMPTY);
+      continue;
+    }
+
+    for (int c = 0; c < WIDTH; c++) {
+      row[c] = getLarger(EMPTY, SRC[(long)WIDTH * SOURCE + c]);
+    }
+  }
+
+  // Running maxima from the end of each block, then from its start
+  for (int block = 0; block < PADDED; block += SIZE) {
+    const int END = block + SIZE - 1;
+
+    std::copy(&prefix[(long)WIDTH * END], &prefix[(long)WIDTH * (END + 1)],
+              &suffix[(long)WIDTH * END]);
+
+    for (int x = END - 1; x >= block; x--) {
+      float* row = &suffix[(long)WIDTH * x];
+      const float* VALUES = &prefix[(long)WIDTH * x];
+
+      for (int c = 0; c < WIDTH; c++) {
+        row[c] = getLarger(row[c + WIDTH], VALUES[c]);
+      }
+    }
+
+    for (int x = block + 1; x <= END; x++) {
+      float* row = &prefix[(long)WIDTH * x];
+
+      for (int c = 0; c < WIDTH; c++) {
+        row[c] = getLarger(row[c - WIDTH], row[c]);
+      }
+    }
+  }
+
+  // The window of element x covers padded elements [x, x + SIZE - 1]
+  for (int x = 0; x < COUNT; x++) {
+    const float* SUFFIX = &suffix[(long)WIDTH * x];
+    const float* PREFIX = &prefix[(long)WIDTH * (x + SIZE - 1)];
+
+    for (int c = 0; c < WIDTH; c++) {
+      dest[(long)WIDTH * x + c] = getLarger(SUFFIX[c], PREFIX[c]);
+    }
+  }
+}
+
+/**
+ * Returns whether a pixel of the (2 * RADIUS + 1) x (2 * RADIUS + 1) window
+ * around pixel (I, J) that comes before it in raster order has the given
+ * value. The nearest pixels are checked first, since equal responses usually
+ * form small plateaus.
+ *
+ * @param RESPONSE Corner response of the image
+ * @param COLS     Number of columns in original image
+ * @param RADIUS   Radius of the suppression window
+ * @param I        Row of the pixel
+ * @param J        Column of the pixel
+ * @param VALUE    Response of the pixel
+ * @returns        Whether an earlier pixel of the window has the same value
+ */
+static bool hasEarlierEqual(const float* RESPONSE,
+                            const int COLS,
+                            const int RADIUS,
+                            const int I,
+                            const int J,
+                            const float VALUE) {
+  const int FIRST_COL = std::max(J - RADIUS, 0);
+  const int LAST_COL = std::min(J + RADIUS, COLS - 1);
+
+  for (int l = J - 1; l >= FIRST_COL; l--) {
+    if (RESPONSE[(long)COLS * I + l] == VALUE) {
+      return true;
+    }
+  }
+
+  for (int k = I - 1; k >= std::max(I - RADIUS, 0); k--) {
+    for (int l = FIRST_COL; l <= LAST_COL; l++) {
+      if (RESPONSE[(long)COLS * k + l] == VALUE) {
+        return true;
+      }
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Appends the local maxima of the corner response in the rows in the range
+ * [ROW_BEGIN, ROW_END) to the given list. A pixel is a local maximum if its
+ * response is greater than MIN_RESPONSE and not less than any pixel in the
+ * (2 * RADIUS + 1) x (2 * RADIUS + 1) window around it, with ties won by the
+ * first pixel in raster order. The maximum of every window is computed by a
+ * running maximum along the columns and then along the rows, so the cost per
+ * pixel does not depend on the radius, and only pixels that equal the maximum
+ * of their window are checked for ties.
+ *
+ * @param RESPONSE     Corner response of the image
+ * @param ROWS         Number of rows in original image
+ * @param COLS         Number of columns in original image
+ * @param RADIUS       Radius of the suppression window
+ * @param MIN_RESPONSE Response that corners must exceed
+ * @param ROW_BEGIN    First row to search
+ * @param ROW_END      Row after the last row to search
+ * @param corners      Receives the local maxima
+ */
+static void genCornersRows(const float* RESPONSE,
+                           const int ROWS,
+                           const int COLS,
+                           const int RADIUS,
+                           const float MIN_RESPONSE,
+                           const int ROW_BEGIN,
+                           const int ROW_END,
+                           std::vector<Corner>& corners) {
+  // Rows whose responses reach the windows of the band
+  const int FIRST = std::max(ROW_BEGIN - RADIUS, 0);
+  const int LAST = std::min(ROW_END + RADIUS, ROWS);
+  const unsigned long SCRATCH =
+      std::max((unsigned long)getPaddedCount(LAST - FIRST, RADIUS) * COLS,
+               (unsigned long)getPaddedCount(COLS, RADIUS));
+  Buffer<float> columnMaxima((unsigned long)(LAST - FIRST) * COLS);
+  Buffer<float> windowMaxima(COLS);
+  Buffer<float> prefix(SCRATCH);
+  Buffer<float> suffix(SCRATCH);
+
+  // Maxima of the windows along the columns, then along each row of the band
+  genWindowMaxima(&RESPONSE[(long)COLS * FIRST], columnMaxima.get(),
+                  LAST - FIRST, COLS, RADIUS, prefix.get(), suffix.get());
+
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
+    const float* MAXIMA = windowMaxima.get();
+
+    genWindowMaxima(&columnMaxima.get()[(long)COLS * (i - FIRST)],
+                    windowMaxima.get(), COLS, 1, RADIUS, prefix.get(),
+                    suffix.get());
+
+    // Only pixels that equal the maximum of their window can be corners
+    for (int j = 0; j < COLS; j++) {
+      const float VALUE = RESPONSE[(long)COLS * i + j];
+
+      if (VALUE > MIN_RESPONSE && VALUE == MAXIMA[j] &&
+          !hasEarlierEqual(RESPONSE, COLS, RADIUS, i, j, VALUE)) {
+        corners.push_back({i, j, VALUE});
+      }
+    }
+  }
+}
+
+/**
+ * Keeps only the first COUNT corners of the given list in ranked order.
+ *
+ * @param corners List of corners
+ * @param COUNT   Number of corners to keep
+ */
+static void keepStrongestCorners(std::vector<Corner>& corners,
+                                 const int COUNT) {
+  if ((int)corners.size() > COUNT) {
+    std::nth_element(corners.begin(), corners.begin() + COUNT, corners.end(),
+                     isStrongerCorner);
+    corners.resize(COUNT);
+  }
+
+  std::sort(corners.begin(), corners.end(), isStrongerCorner);
+}
+
+/**
+ * Extracts the strongest corners from a corner response produced by
+ * genCornerResponse, applying non-maximum suppression over a window of
+ * (2 * RADIUS + 1) x (2 * RADIUS + 1) pixels.
+ *
+ * @param RESPONSE     Corner response of the image
+ * @param ROWS         Number of rows in original image
+ * @param COLS         Number of columns in original image
+ * @param RADIUS       Radius of the suppression window
+ * @param MIN_RESPONSE Response that corners must exceed
+ * @param MAX_CORNERS  Maximum number of corners to return
+ * @returns            Corners ordered from strongest to weakest
+ */
+std::vector<Corner> genCorners(const float* RESPONSE,
+                               const int ROWS,
+                               const int COLS,
+                               const int RADIUS,
+                               const float MIN_RESPONSE,
+                               const int MAX_CORNERS) {
+  parallel::Executor serial(1);
+
+  return genCorners(RESPONSE, ROWS, COLS, RADIUS, MIN_RESPONSE, MAX_CORNERS,
+                    serial);
+}
+
+/**
+ * Returns the same corners as genCorners, splitting the image into bands of
+ * rows that are searched in parallel by the given executor. Each band keeps
+ * only its MAX_CORNERS strongest corners before the bands are merged.
+ *
+ * @param RESPONSE     Corner response of the image
+ * @param ROWS         Number of rows in original image
+ * @param COLS         Number of columns in original image
+ * @param RADIUS       Radius of the suppression window
+ * @param MIN_RESPONSE Response that corners must exceed
+ * @param MAX_CORNERS  Maximum number of corners to return
+ * @param executor     Executor that runs the bands
+ * @returns            Corners ordered from strongest to weakest
+ */
+std::vector<Corner> genCorners(const float* RESPONSE,
+                               const int ROWS,
+                               const int COLS,
+                               const int RADIUS,
+                               const float MIN_RESPONSE,
+                               const int MAX_CORNERS,
+                               parallel::Executor& executor) {
+  // Ensure that the window and count are valid
+  if (RADIUS < 0 || MAX_CORNERS < 0) {
+    throw "ERROR: Corner radius and count must not be negative!";
+  }
+
+  std::vector<Corner> corners;
+  std::mutex mutex;
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    std::vector<Corner> band;
+
+    genCornersRows(RESPONSE, ROWS, COLS, RADIUS, MIN_RESPONSE, ROW_BEGIN,
+                   ROW_END, band);
+    keepStrongestCorners(band, MAX_CORNERS);
+
+    std::lock_guard<std::mutex> lock(mutex);
+    corners.insert(corners.end(), band.begin(), band.end());
+  });
+
+  keepStrongestCorners(corners, MAX_CORNERS);
+
+  return corners;
+}
+
+}  // namespace image
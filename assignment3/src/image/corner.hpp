@@ -0,0 +1,63 @@
+#ifndef IMAGE_CORNER_H
+#define IMAGE_CORNER_H
+
+#include <vector>
+
+#include "../parallel/executor.hpp"
+
+namespace image {
+
+// Measures of how corner-like the neighbourhood of a pixel is
+enum CornerMeasure {
+  // det(M) - k * trace(M)^2
+  CORNER_HARRIS,
+  // Smallest eigenvalue of M
+  CORNER_SHI_TOMASI
+};
+
+/**
+ * Corner found by genCorners.
+ */
+struct Corner {
+  int row;
+  int col;
+  float response;
+};
+
+void genCornerResponse(const unsigned char* SRC,
+                       float* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const CornerMeasure MEASURE,
+                       const int RADIUS,
+                       const double SIGMA,
+                       const double K);
+
+void genCornerResponse(const unsigned char* SRC,
+                       float* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const CornerMeasure MEASURE,
+                       const int RADIUS,
+                       const double SIGMA,
+                       const double K,
+                       parallel::Executor& executor);
+
+std::vector<Corner> genCorners(const float* RESPONSE,
+                               const int ROWS,
+                               const int COLS,
+                               const int RADIUS,
+                               const float MIN_RESPONSE,
+                               const int MAX_CORNERS);
+
+std::vector<Corner> genCorners(const float* RESPONSE,
+                               const int ROWS,
+                               const int COLS,
+                               const int RADIUS,
+                               const float MIN_RESPONSE,
+                               const int MAX_CORNERS,
+                               parallel::Executor& executor);
+
+}  // namespace image
+
+#endif  // IMAGE_CORNER_H
@@ -1,28 +1,102 @@
 #include "filter.hpp"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <climits>
+#include <cmath>
+#include <vector>
+
 #include "../util/util.hpp"
+#include "buffer.hpp"
 #include "image.hpp"
 
 namespace image {
 
 /**
- * Produces a new image by scanning through the given image with the given mask
- * and outputs the result to the destination buffer. The mask is of size
- * MASK_SIZE x MASK_SIZE.
+ * Stores a filtered value as a grey level, truncated and clamped to
+ * [0, LEVEL_WHITE].
  *
- * @param SRC  Buffer containing original image
- * @param MASK Mask or filter to scan through original image with
- * @param dest Destination buffer for filtered image
- * @param ROWS Number of rows in original image
- * @param COLS Number of columns in original image
+ * @param VALUE Filtered value
+ * @param pixel Destination pixel
  */
-void applyLinearFilter(const unsigned char* SRC,
-                       const double MASK[MASK_SIZE][MASK_SIZE],
-                       unsigned char* dest,
-                       const int ROWS,
-                       const int COLS) {
-  // Iterate through the image
-  for (int i = 0; i < ROWS; i++) {
+static inline void storeFiltered(const double VALUE, unsigned char& pixel) {
+  int output = VALUE;
+
+  // Clamp output value if out of bounds
+  if (output < 0) {
+    output = 0;
+  }
+
+  if (output > image::LEVEL_WHITE) {
+    output = image::LEVEL_WHITE;
+  }
+
+  pixel = output;
+}
+
+/**
+ * Stores a filtered value as a 16-bit signed integer, truncated and saturated
+ * to the range of the type.
+ *
+ * @param VALUE Filtered value
+ * @param pixel Destination pixel
+ */
+static inline void storeFiltered(const double VALUE, short& pixel) {
+  pixel = VALUE < SHRT_MIN ? SHRT_MIN : VALUE > SHRT_MAX ? SHRT_MAX : VALUE;
+}
+
+/**
+ * Stores a filtered value as a 32-bit signed integer, truncated and saturated
+ * to the range of the type.
+ *
+ * @param VALUE Filtered value
+ * @param pixel Destination pixel
+ */
+static inline void storeFiltered(const double VALUE, int& pixel) {
+  pixel = VALUE < INT_MIN ? INT_MIN : VALUE > INT_MAX ? INT_MAX : VALUE;
+}
+
+/**
+ * Stores a filtered value as a float, without clamping. The value is rounded
+ * toward zero, so that truncating the float with genClampedImage gives the
+ * same grey level as truncating the value itself.
+ *
+ * @param VALUE Filtered value
+ * @param pixel Destination pixel
+ */
+static inline void storeFiltered(const double VALUE, float& pixel) {
+  const float ROUNDED = VALUE;
+
+  pixel = std::fabs(ROUNDED) > std::fabs(VALUE)
+              ? std::nextafter(ROUNDED, 0.0f)
+              : ROUNDED;
+}
+
+/**
+ * Applies the given mask to the rows in the range [ROW_BEGIN, ROW_END) of the
+ * image.
+ *
+ * @param SRC       Buffer containing original image
+ * @param MASK      Mask or filter to scan through original image with
+ * @param dest      Destination buffer for filtered image
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param ROW_BEGIN First row to filter
+ * @param ROW_END   Row after the last row to filter
+ */
+template <class T>
+static void applyLinearFilterRows(const unsigned char* SRC,
+                                  const double MASK[MASK_SIZE][MASK_SIZE],
+                                  T* dest,
+                                  const int ROWS,
+                                  const int COLS,
+                                  const int ROW_BEGIN,
+                                  const int ROW_END) {
+  // Iterate through the rows of the band
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
     for (int j = 0; j < COLS; j++) {
       // Sum of pixels inside the bounds of the mask
       double sum = 0;
@@ -55,23 +129,175 @@ void applyLinearFilter(const unsigned char* SRC,
         }
       }
 
-      // Calculate weighted sum and re-normalize based on number of pixels that
-      // were out of bounds
-      int output = sum * MASK_SIZE * MASK_SIZE / count;
+      // Calculate weighted sum, re-normalize based on number of pixels that
+      // were out of bounds and output it into the output image at the same
+      // pixel
+      storeFiltered(sum * MASK_SIZE * MASK_SIZE / count, dest[COLS * i + j]);
+    }
+  }
+}
 
-      // Clamp output value if out of bounds
-      if (output < 0) {
-        output = 0;
-      }
+/**
+ * Produces a new image by scanning through the given image with the given mask
+ * and outputs the result to the destination buffer. The mask is of size
+ * MASK_SIZE x MASK_SIZE.
+ *
+ * @param SRC  Buffer containing original image
+ * @param MASK Mask or filter to scan through original image with
+ * @param dest Destination buffer for filtered image
+ * @param ROWS Number of rows in original image
+ * @param COLS Number of columns in original image
+ */
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS) {
+  applyLinearFilterRows(SRC, MASK, dest, ROWS, COLS, 0, ROWS);
+}
 
-      if (output > image::LEVEL_WHITE) {
-        output = image::LEVEL_WHITE;
-      }
+/**
+ * Produces the same image as applyLinearFilter, splitting the image into bands
+ * of rows that are filtered in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param MASK     Mask or filter to scan through original image with
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that runs the bands
+ */
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    applyLinearFilterRows(SRC, MASK, dest, ROWS, COLS, ROW_BEGIN, ROW_END);
+  });
+}
 
-      // Output the weighted sum into the output image at the same pixel
-      dest[COLS * i + j] = output;
-    }
-  }
+/**
+ * Produces the same image as applyLinearFilter without clamping, so that
+ * negative responses such as those of derivative masks keep their sign. Values
+ * are truncated and saturated to the range of a 16-bit signed integer.
+ *
+ * @param SRC  Buffer containing original image
+ * @param MASK Mask or filter to scan through original image with
+ * @param dest Destination buffer for filtered image
+ * @param ROWS Number of rows in original image
+ * @param COLS Number of columns in original image
+ */
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       short* dest,
+                       const int ROWS,
+                       const int COLS) {
+  applyLinearFilterRows(SRC, MASK, dest, ROWS, COLS, 0, ROWS);
+}
+
+/**
+ * Produces the same image as the 16-bit applyLinearFilter, splitting the image
+ * into bands of rows that are filtered in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param MASK     Mask or filter to scan through original image with
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that runs the bands
+ */
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       short* dest,
+                       const int ROWS,
+                       const int COLS,
+                       parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    applyLinearFilterRows(SRC, MASK, dest, ROWS, COLS, ROW_BEGIN, ROW_END);
+  });
+}
+
+/**
+ * Produces the same image as applyLinearFilter without clamping, for masks
+ * whose responses do not fit in 16 bits. Values are truncated and saturated to
+ * the range of a 32-bit signed integer.
+ *
+ * @param SRC  Buffer containing original image
+ * @param MASK Mask or filter to scan through original image with
+ * @param dest Destination buffer for filtered image
+ * @param ROWS Number of rows in original image
+ * @param COLS Number of columns in original image
+ */
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       int* dest,
+                       const int ROWS,
+                       const int COLS) {
+  applyLinearFilterRows(SRC, MASK, dest, ROWS, COLS, 0, ROWS);
+}
+
+/**
+ * Produces the same image as the 32-bit applyLinearFilter, splitting the image
+ * into bands of rows that are filtered in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param MASK     Mask or filter to scan through original image with
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that runs the bands
+ */
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       int* dest,
+                       const int ROWS,
+                       const int COLS,
+                       parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    applyLinearFilterRows(SRC, MASK, dest, ROWS, COLS, ROW_BEGIN, ROW_END);
+  });
+}
+
+/**
+ * Produces the same image as applyLinearFilter without truncating or clamping
+ * the weighted sums.
+ *
+ * @param SRC  Buffer containing original image
+ * @param MASK Mask or filter to scan through original image with
+ * @param dest Destination buffer for filtered image
+ * @param ROWS Number of rows in original image
+ * @param COLS Number of columns in original image
+ */
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       float* dest,
+                       const int ROWS,
+                       const int COLS) {
+  applyLinearFilterRows(SRC, MASK, dest, ROWS, COLS, 0, ROWS);
+}
+
+/**
+ * Produces the same image as the float applyLinearFilter, splitting the image
+ * into bands of rows that are filtered in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param MASK     Mask or filter to scan through original image with
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that runs the bands
+ */
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       float* dest,
+                       const int ROWS,
+                       const int COLS,
+                       parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    applyLinearFilterRows(SRC, MASK, dest, ROWS, COLS, ROW_BEGIN, ROW_END);
+  });
 }
 
 /**
@@ -88,211 +314,2597 @@ void applyMedianFilter(const unsigned char* SRC,
                        unsigned char* dest,
                        const int ROWS,
                        const int COLS) {
-  // Iterate through the image
-  for (int i = 0; i < ROWS; i++) {
-    for (int j = 0; j < COLS; j++) {
-      // Buffer of pixels inside the bounds of the mask
-      unsigned char maskPixels[MASK_SIZE * MASK_SIZE];
-      // Count of pixels inside the bounds of the mask
-      int count = 0;
+  applyMedianFilter(SRC, dest, ROWS, COLS, MASK_SIZE_HALF);
+}
 
-      // Iterate through the mask
-      for (int k = -MASK_SIZE_HALF; k <= MASK_SIZE_HALF; k++) {
-        for (int l = -MASK_SIZE_HALF; l <= MASK_SIZE_HALF; l++) {
-          // Ensure that the current pixel is not out of bounds
-          if ((i + k) < 0 || (i + k) >= ROWS) {
-            continue;
-          }
+/**
+ * Produces the same image as applyMedianFilter, splitting the image into bands
+ * of rows that are filtered in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that runs the bands
+ */
+void applyMedianFilter(const unsigned char* SRC,
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       parallel::Executor& executor) {
+  applyMedianFilter(SRC, dest, ROWS, COLS, MASK_SIZE_HALF, executor);
+}
 
-          if ((j + l) < 0 || (j + l) >= COLS) {
-            continue;
-          }
+/**
+ * Returns the median of the pixels inside the bounds of a square window of the
+ * given radius centered on pixel (ROW, COL). Pixels outside of the image are
+ * skipped, so windows near the border contain fewer pixels.
+ *
+ * @param SRC    Buffer containing original image
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param ROW    Row of the window center
+ * @param COL    Column of the window center
+ * @param RADIUS Radius of the window, at most MEDIAN_NETWORK_MAX_RADIUS
+ * @returns      Median of the pixels inside the window
+ */
+static unsigned char medianOfWindow(const unsigned char* SRC,
+                                    const int ROWS,
+                                    const int COLS,
+                                    const int ROW,
+                                    const int COL,
+                                    const int RADIUS) {
+  // Buffers of pixels inside the bounds of the mask
+  const int MAX_SIZE = (2 * MEDIAN_NETWORK_MAX_RADIUS + 1) *
+                       (2 * MEDIAN_NETWORK_MAX_RADIUS + 1);
+  unsigned char maskPixels[MAX_SIZE];
+  unsigned char sortedMaskPixels[MAX_SIZE];
+  // Count of pixels inside the bounds of the mask
+  int count = 0;
 
-          // Using row major order indexing
-          unsigned char pixel = SRC[COLS * (i + k) + j + l];
+  for (int k = -RADIUS; k <= RADIUS; k++) {
+    for (int l = -RADIUS; l <= RADIUS; l++) {
+      // Ensure that the current pixel is not out of bounds
+      if ((ROW + k) < 0 || (ROW + k) >= ROWS) {
+        continue;
+      }
 
-          // Add this pixel to the mask pixels buffer
-          maskPixels[count] = pixel;
+      if ((COL + l) < 0 || (COL + l) >= COLS) {
+        continue;
+      }
 
-          // Increment count of pixels inside the bounds of the mask
-          count++;
+      maskPixels[count] = SRC[COLS * (ROW + k) + COL + l];
+      count++;
+    }
+  }
+
+  util::insertionSort(maskPixels, sortedMaskPixels, count);
+
+  return util::median(sortedMaskPixels, count);
+}
+
+/**
+ * Orders two scalar pixels so that the first holds the smaller value.
+ *
+ * @param a First pixel, receives the minimum
+ * @param b Second pixel, receives the maximum
+ */
+static inline void compareExchange(unsigned char& a, unsigned char& b) {
+  const unsigned char LOW = a < b ? a : b;
+
+  b = a < b ? b : a;
+  a = LOW;
+}
+
+#ifdef __SSE2__
+/**
+ * Orders two vectors of 16 pixels lane by lane so that the first holds the
+ * smaller values.
+ *
+ * @param a First vector, receives the minimums
+ * @param b Second vector, receives the maximums
+ */
+static inline void compareExchange(__m128i& a, __m128i& b) {
+  const __m128i LOW = _mm_min_epu8(a, b);
+
+  b = _mm_max_epu8(a, b);
+  a = LOW;
+}
+#endif
+
+/**
+ * Generates the comparators of Batcher's odd-even merge sorting network for a
+ * buffer of SIZE elements. SIZE must be a power of 2. Each comparator is stored
+ * as a pair of consecutive indices into the buffer.
+ *
+ * @param SIZE Number of elements sorted by the network
+ * @returns    Indices of the elements compared by each comparator, in order
+ */
+static std::vector<int> genSortingNetwork(const int SIZE) {
+  std::vector<int> comparators;
+
+  for (int p = 1; p < SIZE; p *= 2) {
+    for (int k = p; k >= 1; k /= 2) {
+      for (int j = k % p; j <= SIZE - 1 - k; j += 2 * k) {
+        for (int i = 0; i <= k - 1 && i <= SIZE - j - k - 1; i++) {
+          // Only compare elements that belong to the same merge block
+          if ((i + j) / (2 * p) == (i + j + k) / (2 * p)) {
+            comparators.push_back(i + j);
+            comparators.push_back(i + j + k);
+          }
         }
       }
+    }
+  }
 
-      // Sort the buffer of pixels inside the mask to get the median value
-      unsigned char sortedMaskPixels[MASK_SIZE * MASK_SIZE];
-      util::insertionSort(maskPixels, sortedMaskPixels, count);
+  return comparators;
+}
 
-      // Output the median into the output image at the same pixel
-      dest[i * COLS + j] = util::median(sortedMaskPixels, count);
-    }
+/**
+ * Sorts a buffer in place by applying the given sorting network. The sequence
+ * of comparisons does not depend on the data, so the same network sorts one
+ * pixel per element or one pixel per vector lane.
+ *
+ * @param v           Buffer to sort
+ * @param COMPARATORS Sorting network generated by genSortingNetwork
+ */
+template <class T>
+static void applySortingNetwork(T v[], const std::vector<int>& COMPARATORS) {
+  const int* ptr = &COMPARATORS[0];
+  const int* END = ptr + COMPARATORS.size();
+
+  for (; ptr != END; ptr += 2) {
+    compareExchange(v[ptr[0]], v[ptr[1]]);
   }
 }
 
 /**
- * Produces a new image containing the gradient of the given image and outputs
- * the result to the destination buffer.
+ * Computes the median filter for the rows in the range [ROW_BEGIN, ROW_END) of
+ * the image using a sorting network for all pixels whose window lies entirely
+ * inside the image. The window of K x K pixels is padded with 3 black and
+ * enough white elements to fill a power of 2 so that the median always lands on
+ * a fixed index of the sorted network. With SSE2 available, 16 neighbouring
+ * pixels of a row are filtered at once.
  *
- * @param SRC  Buffer containing original image
- * @param dest Destination buffer for filtered image
- * @param ROWS Number of rows in original image
- * @param COLS Number of columns in original image
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for filtered image
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param RADIUS    Radius of the window, at most MEDIAN_NETWORK_MAX_RADIUS
+ * @param ROW_BEGIN First row to filter
+ * @param ROW_END   Row after the last row to filter
  */
-void genGradient(const unsigned char* SRC,
-                 unsigned char* dest,
-                 const int ROWS,
-                 const int COLS) {
-  // Filter mask for gradient
-  const double MASK_GRADIENT[image::MASK_SIZE] = {-0.5, 0, 0.5};
+static void applyMedianNetwork(const unsigned char* SRC,
+                               unsigned char* dest,
+                               const int ROWS,
+                               const int COLS,
+                               const int RADIUS,
+                               const int ROW_BEGIN,
+                               const int ROW_END) {
+  // Number of elements in the sorting network, K * K + 7 rounded to 16 or 32
+  const int K = 2 * RADIUS + 1;
+  const int SIZE = K * K <= 9 ? 16 : 32;
+  const int PAD_LOW = 3;
+  const int MEDIAN = PAD_LOW + (K * K - 1) / 2;
+  const std::vector<int> COMPARATORS = genSortingNetwork(SIZE);
 
-  // Iterate through the image
-  for (int i = 0; i < ROWS; i++) {
-    for (int j = 0; j < COLS; j++) {
-      // Sum of pixels for horizontal partial derivative approximation
-      double sumX = 0;
-      // Count of pixels for horizontal partial derivative approximation
-      int countX = 0;
+  for (int i = std::max(ROW_BEGIN, RADIUS);
+       i < std::min(ROW_END, ROWS - RADIUS); i++) {
+    int j = RADIUS;
 
-      // Iterate through the mask for the current pixel's horizontal neighbours
-      // and calculate horizontal partial derivative approximation
-      for (int k = -MASK_SIZE_HALF; k <= MASK_SIZE_HALF; k++) {
-        // Ensure that the pixel is within bounds
-        if ((j + k) < 0 || (j + k) >= COLS) {
-          continue;
+#ifdef __SSE2__
+    // Filter 16 pixels of the current row at a time
+    for (; j + 16 <= COLS - RADIUS; j += 16) {
+      __m128i v[32];
+      int count = 0;
+
+      for (int k = 0; k < PAD_LOW; k++) {
+        v[count++] = _mm_set1_epi8((char)LEVEL_BLACK);
+      }
+
+      for (int k = -RADIUS; k <= RADIUS; k++) {
+        for (int l = -RADIUS; l <= RADIUS; l++) {
+          v[count++] = _mm_loadu_si128(
+              (const __m128i*)&SRC[COLS * (i + k) + j + l]);
         }
+      }
 
-        // Add current pixel and weight to weighted sum
-        sumX += SRC[COLS * i + j + k] * MASK_GRADIENT[MASK_SIZE_HALF + k];
-        countX++;
+      while (count < SIZE) {
+        v[count++] = _mm_set1_epi8((char)LEVEL_WHITE);
       }
 
-      // Re-normalize based on number of pixels that were out of bounds
-      sumX *= MASK_SIZE / countX;
+      applySortingNetwork(v, COMPARATORS);
 
-      // Sum of pixels for vertical partial derivative approximation
-      double sumY = 0;
-      // Count of pixels for vertical partial derivative approximation
-      int countY = 0;
+      _mm_storeu_si128((__m128i*)&dest[COLS * i + j], v[MEDIAN]);
+    }
+#endif
 
-      // Iterate through the mask for the current pixel's vertical neighbours
-      for (int k = -MASK_SIZE_HALF; k <= MASK_SIZE_HALF; k++) {
-        // Ensure that the pixel is within bounds
-        if ((i + k) < 0 || (i + k) >= ROWS) {
-          continue;
-        }
+    // Filter the remaining pixels of the row one at a time
+    for (; j < COLS - RADIUS; j++) {
+      unsigned char v[32];
+      int count = 0;
 
-        // Add current pixel and weight to weighted sum
-        sumY += SRC[COLS * (i + k) + j] * MASK_GRADIENT[MASK_SIZE_HALF + k];
-        countY++;
+      for (int k = 0; k < PAD_LOW; k++) {
+        v[count++] = LEVEL_BLACK;
       }
 
-      // Re-normalize based on number of pixels that were out of bounds
-      sumY *= MASK_SIZE / countY;
-
-      // Calculate magnitude using horizontal (x) and vertical (y) partial
-      // derivatives
-      int output = util::magnitude(sumX, sumY);
+      for (int k = -RADIUS; k <= RADIUS; k++) {
+        for (int l = -RADIUS; l <= RADIUS; l++) {
+          v[count++] = SRC[COLS * (i + k) + j + l];
+        }
+      }
 
-      // Clamp output value if out of bounds
-      if (output < 0) {
-        output = 0;
+      while (count < SIZE) {
+        v[count++] = LEVEL_WHITE;
       }
 
-      if (output > image::LEVEL_WHITE) {
-        output = image::LEVEL_WHITE;
+      applySortingNetwork(v, COMPARATORS);
+
+      dest[COLS * i + j] = v[MEDIAN];
+    }
+  }
+
+  // Pixels whose window crosses the border of the image
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
+    for (int j = 0; j < COLS; j++) {
+      if (i >= RADIUS && i < ROWS - RADIUS && j >= RADIUS &&
+          j < COLS - RADIUS) {
+        // Skip over the interior of the row
+        j = COLS - RADIUS - 1;
+        continue;
       }
 
-      // Output the weighted sum into the output image at the same pixel
-      dest[COLS * i + j] = output;
+      dest[COLS * i + j] = medianOfWindow(SRC, ROWS, COLS, i, j, RADIUS);
     }
   }
 }
 
+// Two-level histogram of grey levels. The coarse level counts pixels in groups
+// of MEDIAN_FINE_BINS consecutive grey levels and the fine level counts each
+// grey level on its own.
+const int MEDIAN_FINE_BINS = 16;
+const int MEDIAN_COARSE_BINS = LEVELS / MEDIAN_FINE_BINS;
+
 /**
- * Produces a new image that is sharpened using the Laplace filter. The given
- * weight controls the strength of sharpening.
+ * Returns the grey level at the given rank (0-based position in sorted order)
+ * of the window described by the kernel histogram. The fine level of the
+ * kernel histogram is only brought up to date for the coarse bin that contains
+ * the rank, by adding and removing the column histograms that entered and left
+ * the window since that bin was last used.
  *
- * @param SRC    Buffer containing original image
- * @param dest   Destination buffer for filtered image
- * @param ROWS   Number of rows in original image
- * @param COLS   Number of columns in original image
- * @param WEIGHT Strength of sharpening, a higher value produces a sharper image
+ * @param coarse    Coarse kernel histogram, always up to date
+ * @param fine      Fine kernel histogram, updated lazily per coarse bin
+ * @param binFirst  First column reflected by each fine bin of the kernel
+ * @param binLast   Last column reflected by each fine bin of the kernel
+ * @param COL_FINE  Fine column histograms
+ * @param FIRST_COL First column inside the current window
+ * @param LAST_COL  Last column inside the current window
+ * @param RANK      Rank of the grey level to find
+ * @returns         Grey level at the given rank
  */
-void applyLaplaceSharpening(const unsigned char* SRC,
-                            unsigned char* dest,
+static unsigned char selectRank(const int coarse[],
+                                int fine[],
+                                int binFirst[],
+                                int binLast[],
+                                const unsigned short* COL_FINE,
+                                const int FIRST_COL,
+                                const int LAST_COL,
+                                int rank) {
+  // Find the coarse bin containing the rank
+  int bin = 0;
+
+  while (rank >= coarse[bin]) {
+    rank -= coarse[bin];
+    bin++;
+  }
+
+  int* binFine = &fine[MEDIAN_FINE_BINS * bin];
+
+  if (binLast[bin] < FIRST_COL) {
+    // The fine bin does not overlap the window, rebuild it from scratch
+    for (int k = 0; k < MEDIAN_FINE_BINS; k++) {
+      binFine[k] = 0;
+    }
+
+    binFirst[bin] = FIRST_COL;
+    binLast[bin] = FIRST_COL - 1;
+  }
+
+  // Remove columns that left the window since the fine bin was last used
+  for (int c = binFirst[bin]; c < FIRST_COL; c++) {
+    const unsigned short* COL = &COL_FINE[LEVELS * c + MEDIAN_FINE_BINS * bin];
+
+    for (int k = 0; k < MEDIAN_FINE_BINS; k++) {
+      binFine[k] -= COL[k];
+    }
+  }
+
+  // Add columns that entered the window since the fine bin was last used
+  for (int c = binLast[bin] + 1; c <= LAST_COL; c++) {
+    const unsigned short* COL = &COL_FINE[LEVELS * c + MEDIAN_FINE_BINS * bin];
+
+    for (int k = 0; k < MEDIAN_FINE_BINS; k++) {
+      binFine[k] += COL[k];
+    }
+  }
+
+  binFirst[bin] = FIRST_COL;
+  binLast[bin] = LAST_COL;
+
+  // Find the grey level containing the rank inside the coarse bin
+  int level = 0;
+
+  while (rank >= binFine[level]) {
+    rank -= binFine[level];
+    level++;
+  }
+
+  return MEDIAN_FINE_BINS * bin + level;
+}
+
+/**
+ * Adds the pixels of a row to the column histograms of the constant-time
+ * median, or removes them if DELTA is -1.
+ *
+ * @param ROW       Pixels of the row
+ * @param colCoarse Coarse column histograms
+ * @param colFine   Fine column histograms
+ * @param COLS      Number of columns in row
+ * @param DELTA     1 to add the row, -1 to remove it
+ */
+static void updateColumnHistograms(const unsigned char* ROW,
+                                   unsigned short* colCoarse,
+                                   unsigned short* colFine,
+                                   const int COLS,
+                                   const int DELTA) {
+  for (int j = 0; j < COLS; j++) {
+    const unsigned char PIXEL = ROW[j];
+
+    colCoarse[MEDIAN_COARSE_BINS * j + PIXEL / MEDIAN_FINE_BINS] += DELTA;
+    colFine[LEVELS * j + PIXEL] += DELTA;
+  }
+}
+
+/**
+ * Computes one row of the median filter from column histograms that cover the
+ * rows of its window, by sliding the window histogram across the row and
+ * adding and removing whole column histograms.
+ *
+ * @param COL_COARSE  Coarse column histograms
+ * @param COL_FINE    Fine column histograms
+ * @param dest        Destination buffer for filtered row
+ * @param COLS        Number of columns in row
+ * @param RADIUS      Radius of the window
+ * @param WINDOW_ROWS Number of rows covered by the column histograms
+ */
+static void applyMedianHistogramRow(const unsigned short* COL_COARSE,
+                                    const unsigned short* COL_FINE,
+                                    unsigned char* dest,
+                                    const int COLS,
+                                    const int RADIUS,
+                                    const int WINDOW_ROWS) {
+  // Kernel histogram of the window, the fine level is updated lazily
+  int coarse[MEDIAN_COARSE_BINS] = {0};
+  int fine[LEVELS];
+  int binFirst[MEDIAN_COARSE_BINS];
+  int binLast[MEDIAN_COARSE_BINS];
+
+  for (int k = 0; k < MEDIAN_COARSE_BINS; k++) {
+    binFirst[k] = 0;
+    binLast[k] = -1;
+  }
+
+  // Columns currently added to the coarse kernel histogram
+  int firstCol = 0;
+  int lastCol = -1;
+
+  for (int j = 0; j < COLS; j++) {
+    const int FIRST_COL = std::max(j - RADIUS, 0);
+    const int LAST_COL = std::min(j + RADIUS, COLS - 1);
+
+    // Slide the coarse kernel histogram to cover the window
+    for (int c = lastCol + 1; c <= LAST_COL; c++) {
+      for (int k = 0; k < MEDIAN_COARSE_BINS; k++) {
+        coarse[k] += COL_COARSE[MEDIAN_COARSE_BINS * c + k];
+      }
+    }
+
+    for (int c = firstCol; c < FIRST_COL; c++) {
+      for (int k = 0; k < MEDIAN_COARSE_BINS; k++) {
+        coarse[k] -= COL_COARSE[MEDIAN_COARSE_BINS * c + k];
+      }
+    }
+
+    firstCol = FIRST_COL;
+    lastCol = LAST_COL;
+
+    // Number of pixels inside the window, and the rank of its median using
+    // the same convention as util::median
+    const int COUNT = WINDOW_ROWS * (LAST_COL - FIRST_COL + 1);
+    const int RANK = (COUNT - 1) / 2;
+
+    int output = selectRank(coarse, fine, binFirst, binLast, COL_FINE,
+                            FIRST_COL, LAST_COL, RANK);
+
+    // If the count is even, average the two middle elements
+    if (COUNT % 2 == 0) {
+      output = (output + selectRank(coarse, fine, binFirst, binLast, COL_FINE,
+                                    FIRST_COL, LAST_COL, RANK - 1)) /
+               2;
+    }
+
+    dest[j] = output;
+  }
+}
+
+/**
+ * Computes the median filter for the rows in the range [ROW_BEGIN, ROW_END) of
+ * the image using the constant-time median algorithm of Perreault and Hebert.
+ * One histogram is kept per column of the image and slid down by one row at a
+ * time, and the window histogram is slid across the row by adding and removing
+ * whole column histograms. Histograms are split into coarse and fine levels so
+ * that the cost per pixel does not depend on the radius. Windows are clipped at
+ * the border of the image, matching the results of the sorting network path.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for filtered image
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param RADIUS    Radius of the window
+ * @param ROW_BEGIN First row to filter
+ * @param ROW_END   Row after the last row to filter
+ */
+static void applyMedianHistogram(const unsigned char* SRC,
+                                 unsigned char* dest,
+                                 const int ROWS,
+                                 const int COLS,
+                                 const int RADIUS,
+                                 const int ROW_BEGIN,
+                                 const int ROW_END) {
+  // Coarse and fine histograms of every column over the rows inside the window
+  std::vector<unsigned short> colCoarse(MEDIAN_COARSE_BINS * COLS, 0);
+  std::vector<unsigned short> colFine(LEVELS * COLS, 0);
+
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
+    // Slide the column histograms down to cover rows [i - RADIUS, i + RADIUS]
+    if (i == ROW_BEGIN) {
+      for (int k = std::max(i - RADIUS, 0); k <= i + RADIUS && k < ROWS; k++) {
+        updateColumnHistograms(&SRC[COLS * k], &colCoarse[0], &colFine[0],
+                               COLS, 1);
+      }
+    } else {
+      if (i - RADIUS - 1 >= 0) {
+        updateColumnHistograms(&SRC[COLS * (i - RADIUS - 1)], &colCoarse[0],
+                               &colFine[0], COLS, -1);
+      }
+
+      if (i + RADIUS < ROWS) {
+        updateColumnHistograms(&SRC[COLS * (i + RADIUS)], &colCoarse[0],
+                               &colFine[0], COLS, 1);
+      }
+    }
+
+    // Number of rows inside the window for this row
+    const int WINDOW_ROWS = std::min(i + RADIUS, ROWS - 1) -
+                            std::max(i - RADIUS, 0) + 1;
+
+    applyMedianHistogramRow(&colCoarse[0], &colFine[0], &dest[COLS * i], COLS,
+                            RADIUS, WINDOW_ROWS);
+  }
+}
+
+/**
+ * Produces a new image by replacing every pixel with the median of the pixels
+ * inside a square window of size (2 * RADIUS + 1) x (2 * RADIUS + 1) and
+ * outputs the result to the destination buffer. Windows are clipped at the
+ * border of the image.
+ *
+ * Radii up to MEDIAN_NETWORK_MAX_RADIUS (3x3 and 5x5 windows) use a sorting
+ * network that filters a whole row of pixels at once. Larger radii use a
+ * histogram-based median whose cost per pixel does not depend on the radius.
+ *
+ * @param SRC    Buffer containing original image
+ * @param dest   Destination buffer for filtered image
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param RADIUS Radius of the window
+ */
+void applyMedianFilter(const unsigned char* SRC,
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const int RADIUS) {
+  // Ensure that the window has a valid size
+  if (RADIUS < 0) {
+    throw "ERROR: Median filter radius must not be negative!";
+  }
+
+  if (RADIUS <= MEDIAN_NETWORK_MAX_RADIUS) {
+    applyMedianNetwork(SRC, dest, ROWS, COLS, RADIUS, 0, ROWS);
+  } else {
+    applyMedianHistogram(SRC, dest, ROWS, COLS, RADIUS, 0, ROWS);
+  }
+}
+
+/**
+ * Produces the same image as applyMedianFilter, splitting the image into bands
+ * of rows that are filtered in parallel by the given executor. Each band of
+ * the histogram-based path builds its own column histograms from the rows
+ * around the band.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param RADIUS   Radius of the window
+ * @param executor Executor that runs the bands
+ */
+void applyMedianFilter(const unsigned char* SRC,
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const int RADIUS,
+                       parallel::Executor& executor) {
+  // Ensure that the window has a valid size
+  if (RADIUS < 0) {
+    throw "ERROR: Median filter radius must not be negative!";
+  }
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    if (RADIUS <= MEDIAN_NETWORK_MAX_RADIUS) {
+      applyMedianNetwork(SRC, dest, ROWS, COLS, RADIUS, ROW_BEGIN, ROW_END);
+    } else {
+      applyMedianHistogram(SRC, dest, ROWS, COLS, RADIUS, ROW_BEGIN, ROW_END);
+    }
+  });
+}
+
+/**
+ * Returns a table of the gradient magnitudes sqrt(x^2 + y^2) of derivatives
+ * with absolute values x and y in [0, LEVELS), rounded down, indexed by
+ * LEVELS * x + y. The table is built on first use.
+ *
+ * @returns Table of LEVELS x LEVELS magnitudes
+ */
+static const unsigned short* getMagnitudeTable() {
+  static const std::vector<unsigned short> TABLE = [] {
+    std::vector<unsigned short> table(LEVELS * LEVELS);
+
+    for (int x = 0; x < LEVELS; x++) {
+      for (int y = 0; y < LEVELS; y++) {
+        table[LEVELS * x + y] = util::magnitude<double>(x, y);
+      }
+    }
+
+    return table;
+  }();
+
+  return &TABLE[0];
+}
+
+/**
+ * Stores the gradient of central differences DX and DY as a grey level, using
+ * the magnitude table since both differences are within (-LEVELS, LEVELS).
+ * sqrt((DX / 2)^2 + (DY / 2)^2) rounded down is the tabulated magnitude halved.
+ *
+ * @param TABLE Table from getMagnitudeTable
+ * @param DX    Horizontal central difference
+ * @param DY    Vertical central difference
+ * @param pixel Destination pixel
+ */
+static inline void storeGradient(const unsigned short* TABLE,
+                                 const int DX,
+                                 const int DY,
+                                 unsigned char& pixel) {
+  pixel = TABLE[LEVELS * (DX < 0 ? -DX : DX) + (DY < 0 ? -DY : DY)] / 2;
+}
+
+/**
+ * Stores the gradient of central differences DX and DY as a float.
+ *
+ * @param TABLE Unused
+ * @param DX    Horizontal central difference
+ * @param DY    Vertical central difference
+ * @param pixel Destination pixel
+ */
+static inline void storeGradient(const unsigned short*,
+                                 const int DX,
+                                 const int DY,
+                                 float& pixel) {
+  pixel = util::magnitude(0.5 * DX, 0.5 * DY);
+}
+
+/**
+ * Computes the gradient for the rows in the range [ROW_BEGIN, ROW_END) of the
+ * image. The partial derivatives are half of the central differences, with
+ * neighbours outside of the image skipped.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for filtered image
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param ROW_BEGIN First row to compute
+ * @param ROW_END   Row after the last row to compute
+ */
+template <class T>
+static void genGradientRows(const unsigned char* SRC,
+                            T* dest,
                             const int ROWS,
                             const int COLS,
-                            const double WEIGHT) {
-  // Filter mask for Laplacian filter
-  const double MASK_LAPLACIAN[image::MASK_SIZE][image::MASK_SIZE] = {
-      0, 1, 0, 1, -4, 1, 0, 1, 0};
-  // Buffer to hold Laplacian filter of image
-  int laplacian[ROWS][COLS];
+                            const int ROW_BEGIN,
+                            const int ROW_END) {
+  const unsigned short* TABLE = getMagnitudeTable();
+
+  // Iterate through the rows of the band
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
+    const unsigned char* ROW = &SRC[COLS * i];
+    // Rows above and below are only read when they are inside the image
+    const unsigned char* ABOVE = i > 0 ? ROW - COLS : nullptr;
+    const unsigned char* BELOW = i < ROWS - 1 ? ROW + COLS : nullptr;
 
-  // Iterate through the image to generate Laplacian buffer
-  for (int i = 0; i < ROWS; i++) {
     for (int j = 0; j < COLS; j++) {
-      // Sum of pixels inside the bounds of the mask
-      double sum = 0;
-      // Count of pixels inside the bounds of the mask
-      int count = 0;
+      // Horizontal and vertical central differences
+      const int DX = (j < COLS - 1 ? ROW[j + 1] : 0) - (j > 0 ? ROW[j - 1] : 0);
+      const int DY = (BELOW != nullptr ? BELOW[j] : 0) -
+                     (ABOVE != nullptr ? ABOVE[j] : 0);
 
-      // Iterate through the mask
-      for (int k = -MASK_SIZE_HALF; k <= MASK_SIZE_HALF; k++) {
-        for (int l = -MASK_SIZE_HALF; l <= MASK_SIZE_HALF; l++) {
-          // Ensure that the current pixel is not out of bounds
-          if ((i + k) < 0 || (i + k) >= ROWS) {
-            continue;
-          }
+      storeGradient(TABLE, DX, DY, dest[COLS * i + j]);
+    }
+  }
+}
 
-          if ((j + l) < 0 || (j + l) >= COLS) {
-            continue;
-          }
+/**
+ * Produces a new image containing the gradient of the given image and outputs
+ * the result to the destination buffer.
+ *
+ * @param SRC  Buffer containing original image
+ * @param dest Destination buffer for filtered image
+ * @param ROWS Number of rows in original image
+ * @param COLS Number of columns in original image
+ */
+void genGradient(const unsigned char* SRC,
+                 unsigned char* dest,
+                 const int ROWS,
+                 const int COLS) {
+  genGradientRows(SRC, dest, ROWS, COLS, 0, ROWS);
+}
 
-          // Using row major order indexing
-          unsigned char pixel = SRC[COLS * (i + k) + j + l];
+/**
+ * Produces the same image as genGradient, splitting the image into bands of
+ * rows that are computed in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that runs the bands
+ */
+void genGradient(const unsigned char* SRC,
+                 unsigned char* dest,
+                 const int ROWS,
+                 const int COLS,
+                 parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    genGradientRows(SRC, dest, ROWS, COLS, ROW_BEGIN, ROW_END);
+  });
+}
 
-          // The weight of the mask at this pixel
-          double weight =
-              MASK_LAPLACIAN[k + MASK_SIZE_HALF][l + MASK_SIZE_HALF];
+/**
+ * Produces the same gradient as genGradient without truncating or clamping the
+ * magnitudes.
+ *
+ * @param SRC  Buffer containing original image
+ * @param dest Destination buffer for gradient magnitudes
+ * @param ROWS Number of rows in original image
+ * @param COLS Number of columns in original image
+ */
+void genGradient(const unsigned char* SRC,
+                 float* dest,
+                 const int ROWS,
+                 const int COLS) {
+  genGradientRows(SRC, dest, ROWS, COLS, 0, ROWS);
+}
 
-          // Update the sum with this pixel and its weight
-          sum += pixel * weight;
+/**
+ * Produces the same gradient as the float genGradient, splitting the image
+ * into bands of rows that are computed in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for gradient magnitudes
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that runs the bands
+ */
+void genGradient(const unsigned char* SRC,
+                 float* dest,
+                 const int ROWS,
+                 const int COLS,
+                 parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    genGradientRows(SRC, dest, ROWS, COLS, ROW_BEGIN, ROW_END);
+  });
+}
 
-          // Increment count of pixels inside the bounds of the mask
-          count++;
-        }
+/**
+ * Returns the magnitude of a gradient with the given horizontal and vertical
+ * derivatives, clamped to [0, LEVEL_WHITE].
+ *
+ * @param X    Horizontal derivative
+ * @param Y    Vertical derivative
+ * @param MODE Method used to compute the magnitude
+ * @returns    Clamped gradient magnitude
+ */
+static unsigned char combineGradient(const int X,
+                                     const int Y,
+                                     const MagnitudeMode MODE) {
+  const int ABS_X = X < 0 ? -X : X;
+  const int ABS_Y = Y < 0 ? -Y : Y;
+  int output;
+
+  switch (MODE) {
+    case MAGNITUDE_L1:
+      output = ABS_X + ABS_Y;
+      break;
+    case MAGNITUDE_APPROX:
+      // alpha * max + beta * min with alpha = 15 / 16 and beta = 15 / 32
+      output = ABS_X > ABS_Y ? (30 * ABS_X + 15 * ABS_Y) / 32
+                             : (30 * ABS_Y + 15 * ABS_X) / 32;
+      break;
+    default:
+      // Magnitudes are at least max(|x|, |y|), so only smaller derivatives
+      // need the table
+      output = ABS_X < LEVELS && ABS_Y < LEVELS
+                   ? getMagnitudeTable()[LEVELS * ABS_X + ABS_Y]
+                   : LEVEL_WHITE;
+      break;
+  }
+
+  return output > LEVEL_WHITE ? LEVEL_WHITE : output;
+}
+
+/**
+ * Combines rows of horizontal and vertical derivatives into gradient
+ * magnitudes clamped to [0, LEVEL_WHITE], giving the same results as
+ * combineGradient. When SSE2 is available, 8 pixels are combined at a time,
+ * with a packed square root for the exact magnitude.
+ *
+ * @param X     Horizontal derivatives
+ * @param Y     Vertical derivatives
+ * @param dest  Destination buffer for magnitudes
+ * @param COUNT Number of pixels
+ * @param MODE  Method used to compute the magnitude
+ */
+static void combineGradientRow(const short* X,
+                               const short* Y,
+                               unsigned char* dest,
+                               const long COUNT,
+                               const MagnitudeMode MODE) {
+  long j = 0;
+
+#ifdef __SSE2__
+  const __m128i ZERO = _mm_setzero_si128();
+  const __m128i WHITE = _mm_set1_epi16(LEVEL_WHITE);
+  // Derivatives at least this large give a saturated approximate magnitude
+  const __m128i APPROX_LIMIT = _mm_set1_epi16(2 * LEVELS - 1);
+
+  for (; j + 8 <= COUNT; j += 8) {
+    const __m128i DX = _mm_loadu_si128((const __m128i*)&X[j]);
+    const __m128i DY = _mm_loadu_si128((const __m128i*)&Y[j]);
+    __m128i output;
+
+    if (MODE == MAGNITUDE_EXACT) {
+      // Sign-extend to 32 bits, then square and add in single precision, which
+      // is exact below 2^24
+      const __m128 X_LOW =
+          _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(DX, DX), 16));
+      const __m128 X_HIGH =
+          _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(DX, DX), 16));
+      const __m128 Y_LOW =
+          _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(DY, DY), 16));
+      const __m128 Y_HIGH =
+          _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(DY, DY), 16));
+      const __m128 LOW = _mm_sqrt_ps(
+          _mm_add_ps(_mm_mul_ps(X_LOW, X_LOW), _mm_mul_ps(Y_LOW, Y_LOW)));
+      const __m128 HIGH = _mm_sqrt_ps(
+          _mm_add_ps(_mm_mul_ps(X_HIGH, X_HIGH), _mm_mul_ps(Y_HIGH, Y_HIGH)));
+
+      output = _mm_packs_epi32(_mm_cvttps_epi32(LOW), _mm_cvttps_epi32(HIGH));
+    } else {
+      // Absolute values as unsigned 16-bit integers
+      const __m128i ABS_X = _mm_max_epi16(DX, _mm_sub_epi16(ZERO, DX));
+      const __m128i ABS_Y = _mm_max_epi16(DY, _mm_sub_epi16(ZERO, DY));
+
+      if (MODE == MAGNITUDE_L1) {
+        output = _mm_adds_epu16(ABS_X, ABS_Y);
+        // Unsigned minimum with LEVEL_WHITE, so the signed pack clamps right
+        output = _mm_sub_epi16(output, _mm_subs_epu16(output, WHITE));
+      } else {
+        // Clamping the derivatives keeps the products within 16 bits without
+        // changing the clamped result
+        const __m128i CLAMPED_X =
+            _mm_sub_epi16(ABS_X, _mm_subs_epu16(ABS_X, APPROX_LIMIT));
+        const __m128i CLAMPED_Y =
+            _mm_sub_epi16(ABS_Y, _mm_subs_epu16(ABS_Y, APPROX_LIMIT));
+        const __m128i MAX = _mm_max_epi16(CLAMPED_X, CLAMPED_Y);
+        const __m128i MIN = _mm_min_epi16(CLAMPED_X, CLAMPED_Y);
+
+        output = _mm_srli_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(MAX, _mm_set1_epi16(30)),
+                          _mm_mullo_epi16(MIN, _mm_set1_epi16(15))),
+            5);
+      }
+    }
+
+    _mm_storel_epi64((__m128i*)&dest[j], _mm_packus_epi16(output, output));
+  }
+#endif
+
+  for (; j < COUNT; j++) {
+    dest[j] = combineGradient(X[j], Y[j], MODE);
+  }
+}
+
+/**
+ * Thresholds a row of gradient magnitudes to LEVEL_BLACK and LEVEL_WHITE, 16
+ * pixels at a time when SSE2 is available.
+ *
+ * @param MAGNITUDE Gradient magnitudes
+ * @param dest      Destination buffer for edges
+ * @param COUNT     Number of pixels
+ * @param THRESHOLD Magnitudes lower than the threshold are mapped to
+ *                  LEVEL_BLACK, others to LEVEL_WHITE
+ */
+static void thresholdGradientRow(const unsigned char* MAGNITUDE,
+                                 unsigned char* dest,
+                                 const int COUNT,
+                                 const unsigned char THRESHOLD) {
+  int j = 0;
+
+#ifdef __SSE2__
+  const __m128i LIMIT = _mm_set1_epi8(THRESHOLD);
+
+  for (; j + 16 <= COUNT; j += 16) {
+    const __m128i VALUES = _mm_loadu_si128((const __m128i*)&MAGNITUDE[j]);
+
+    // All ones where max(value, threshold) == value, i.e. value >= threshold
+    _mm_storeu_si128(
+        (__m128i*)&dest[j],
+        _mm_cmpeq_epi8(_mm_max_epu8(VALUES, LIMIT), VALUES));
+  }
+#endif
+
+  for (; j < COUNT; j++) {
+    dest[j] = MAGNITUDE[j] < THRESHOLD ? LEVEL_BLACK : LEVEL_WHITE;
+  }
+}
+
+/**
+ * Computes the Sobel derivatives of a pixel whose 3x3 neighbourhood crosses the
+ * border of the image. Pixels outside of the image are skipped and the sums
+ * are re-normalized based on the number of pixels inside the bounds of the
+ * mask, as in applyLinearFilter.
+ *
+ * @param SRC  Buffer containing original image
+ * @param ROWS Number of rows in original image
+ * @param COLS Number of columns in original image
+ * @param ROW  Row of the pixel
+ * @param COL  Column of the pixel
+ * @param x    Receives the horizontal derivative
+ * @param y    Receives the vertical derivative
+ */
+static void genSobelBorderPixel(const unsigned char* SRC,
+                                const int ROWS,
+                                const int COLS,
+                                const int ROW,
+                                const int COL,
+                                int& x,
+                                int& y) {
+  // Sobel masks for horizontal (d/dx) and vertical (d/dy) derivatives
+  const int MASK_X[MASK_SIZE][MASK_SIZE] = {-1, 0, 1, -2, 0, 2, -1, 0, 1};
+  const int MASK_Y[MASK_SIZE][MASK_SIZE] = {-1, -2, -1, 0, 0, 0, 1, 2, 1};
+
+  int sumX = 0;
+  int sumY = 0;
+  int count = 0;
+
+  for (int k = -MASK_SIZE_HALF; k <= MASK_SIZE_HALF; k++) {
+    for (int l = -MASK_SIZE_HALF; l <= MASK_SIZE_HALF; l++) {
+      // Ensure that the current pixel is not out of bounds
+      if ((ROW + k) < 0 || (ROW + k) >= ROWS) {
+        continue;
+      }
+
+      if ((COL + l) < 0 || (COL + l) >= COLS) {
+        continue;
       }
 
-      // Calculate weighted sum and re-normalize based on number of pixels that
-      // were out of bounds
-      int output = sum * MASK_SIZE * MASK_SIZE / count;
+      const unsigned char PIXEL = SRC[COLS * (ROW + k) + COL + l];
 
-      // Output the weighted sum into the output image at the same pixel
-      laplacian[i][j] = output;
+      sumX += PIXEL * MASK_X[k + MASK_SIZE_HALF][l + MASK_SIZE_HALF];
+      sumY += PIXEL * MASK_Y[k + MASK_SIZE_HALF][l + MASK_SIZE_HALF];
+      count++;
     }
   }
 
-  // Sharpen image using Laplacian following the formula:
-  //   I' = I - w * (Hl * I)
-  // Where I is the original image, w is the given weight, and (Hl * I) is the
-  // image with the Laplacian filter applied to it.
-  for (int i = 0; i < ROWS; i++) {
+  x = sumX * MASK_SIZE * MASK_SIZE / count;
+  y = sumY * MASK_SIZE * MASK_SIZE / count;
+}
+
+/**
+ * Computes the requested Sobel gradient outputs for the rows in the range
+ * [ROW_BEGIN, ROW_END) of the image.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffers for the requested outputs
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param MODE      Method used to compute the magnitude
+ * @param THRESHOLD Magnitude threshold for the edges output
+ * @param ROW_BEGIN First row to compute
+ * @param ROW_END   Row after the last row to compute
+ */
+static void genSobelGradientRows(const unsigned char* SRC,
+                                 const SobelGradient& dest,
+                                 const int ROWS,
+                                 const int COLS,
+                                 const MagnitudeMode MODE,
+                                 const unsigned char THRESHOLD,
+                                 const int ROW_BEGIN,
+                                 const int ROW_END) {
+  const double PI = 3.14159265359;
+  const bool NEEDS_MAGNITUDE =
+      dest.magnitude != nullptr || dest.edges != nullptr;
+
+  // Rows of outputs that were not requested but are needed for others
+  Buffer<short> scratchX(COLS);
+  Buffer<short> scratchY(COLS);
+  Buffer<unsigned char> scratchMagnitude(COLS);
+
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
+    const bool BORDER_ROW = i == 0 || i == ROWS - 1;
+    // Rows above and below are only read when they are inside the image
+    const unsigned char* ROW = &SRC[COLS * i];
+    const unsigned char* ABOVE = BORDER_ROW ? ROW : ROW - COLS;
+    const unsigned char* BELOW = BORDER_ROW ? ROW : ROW + COLS;
+
+    short* x = dest.x != nullptr ? &dest.x[COLS * i] : scratchX.get();
+    short* y = dest.y != nullptr ? &dest.y[COLS * i] : scratchY.get();
+
     for (int j = 0; j < COLS; j++) {
-      int output = SRC[COLS * i + j] - WEIGHT * laplacian[i][j];
+      if (BORDER_ROW || j == 0 || j == COLS - 1) {
+        int borderX;
+        int borderY;
 
-      // Clamp output value if out of bounds
-      if (output < 0) {
-        output = 0;
+        genSobelBorderPixel(SRC, ROWS, COLS, i, j, borderX, borderY);
+        x[j] = borderX;
+        y[j] = borderY;
+      } else {
+        x[j] = (ABOVE[j + 1] - ABOVE[j - 1]) + 2 * (ROW[j + 1] - ROW[j - 1]) +
+               (BELOW[j + 1] - BELOW[j - 1]);
+        y[j] = (BELOW[j - 1] - ABOVE[j - 1]) + 2 * (BELOW[j] - ABOVE[j]) +
+               (BELOW[j + 1] - ABOVE[j + 1]);
       }
+    }
 
-      if (output > image::LEVEL_WHITE) {
-        output = image::LEVEL_WHITE;
+    // Combine the whole row of derivatives at once
+    if (NEEDS_MAGNITUDE) {
+      unsigned char* magnitude = dest.magnitude != nullptr
+                                     ? &dest.magnitude[COLS * i]
+                                     : scratchMagnitude.get();
+
+      combineGradientRow(x, y, magnitude, COLS, MODE);
+
+      if (dest.edges != nullptr) {
+        thresholdGradientRow(magnitude, &dest.edges[COLS * i], COLS,
+                             THRESHOLD);
       }
+    }
 
-      dest[COLS * i + j] = output;
+    if (dest.direction != nullptr) {
+      for (int j = 0; j < COLS; j++) {
+        // Map the angle from [-pi, pi) to [0, LEVELS)
+        const int ANGLE =
+            std::floor((std::atan2(y[j], x[j]) + PI) * LEVELS / (2 * PI));
+
+        dest.direction[COLS * i + j] = ANGLE % LEVELS;
+      }
     }
   }
 }
 
+/**
+ * Computes the 3x3 Sobel gradient of the given image in a single pass over the
+ * source buffer. The signed horizontal and vertical derivatives, the gradient
+ * magnitude, the thresholded magnitude and the gradient direction are written
+ * to the respective buffers of the destination, skipping any that are null.
+ *
+ * Near the border of the image, derivatives are re-normalized based on the
+ * number of pixels inside the bounds of the mask in the same way as
+ * applyLinearFilter, so clamping the derivatives to [0, LEVEL_WHITE] gives the
+ * same images as applying the Sobel masks with applyLinearFilter.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffers for the requested outputs
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param MODE      Method used to compute the magnitude
+ * @param THRESHOLD Magnitudes lower than the threshold are mapped to
+ *                  LEVEL_BLACK in the edges output, others to LEVEL_WHITE
+ */
+void genSobelGradient(const unsigned char* SRC,
+                      const SobelGradient& dest,
+                      const int ROWS,
+                      const int COLS,
+                      const MagnitudeMode MODE,
+                      const unsigned char THRESHOLD) {
+  genSobelGradientRows(SRC, dest, ROWS, COLS, MODE, THRESHOLD, 0, ROWS);
+}
+
+/**
+ * Computes the same outputs as genSobelGradient, splitting the image into
+ * bands of rows that are computed in parallel by the given executor.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffers for the requested outputs
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param MODE      Method used to compute the magnitude
+ * @param THRESHOLD Magnitudes lower than the threshold are mapped to
+ *                  LEVEL_BLACK in the edges output, others to LEVEL_WHITE
+ * @param executor  Executor that runs the bands
+ */
+void genSobelGradient(const unsigned char* SRC,
+                      const SobelGradient& dest,
+                      const int ROWS,
+                      const int COLS,
+                      const MagnitudeMode MODE,
+                      const unsigned char THRESHOLD,
+                      parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    genSobelGradientRows(SRC, dest, ROWS, COLS, MODE, THRESHOLD, ROW_BEGIN,
+                         ROW_END);
+  });
+}
+
+/**
+ * Combines horizontal and vertical derivatives, such as those produced by
+ * genSobelGradient, into gradient magnitudes clamped to [0, LEVEL_WHITE] and
+ * outputs the result to the destination buffer. Derivatives are combined 8 at
+ * a time when SSE2 is available.
+ *
+ * @param X    Buffer containing horizontal derivatives
+ * @param Y    Buffer containing vertical derivatives
+ * @param dest Destination buffer for gradient magnitudes
+ * @param ROWS Number of rows in image
+ * @param COLS Number of columns in image
+ * @param MODE Method used to compute the magnitude
+ */
+void genGradientMagnitude(const short* X,
+                          const short* Y,
+                          unsigned char* dest,
+                          const int ROWS,
+                          const int COLS,
+                          const MagnitudeMode MODE) {
+  combineGradientRow(X, Y, dest, (long)ROWS * COLS, MODE);
+}
+
+/**
+ * Produces the same magnitudes as genGradientMagnitude, splitting the image
+ * into bands of rows that are combined in parallel by the given executor.
+ *
+ * @param X        Buffer containing horizontal derivatives
+ * @param Y        Buffer containing vertical derivatives
+ * @param dest     Destination buffer for gradient magnitudes
+ * @param ROWS     Number of rows in image
+ * @param COLS     Number of columns in image
+ * @param MODE     Method used to compute the magnitude
+ * @param executor Executor that runs the bands
+ */
+void genGradientMagnitude(const short* X,
+                          const short* Y,
+                          unsigned char* dest,
+                          const int ROWS,
+                          const int COLS,
+                          const MagnitudeMode MODE,
+                          parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    const long BEGIN = (long)COLS * ROW_BEGIN;
+
+    combineGradientRow(&X[BEGIN], &Y[BEGIN], &dest[BEGIN],
+                       (long)COLS * (ROW_END - ROW_BEGIN), MODE);
+  });
+}
+
+// Number of pixels in a block of rows whose Laplacian is sharpened while it is
+// still in cache
+const int LAPLACE_BLOCK_PIXELS = 16384;
+
+/**
+ * Computes the Laplacian for the rows in the range [ROW_BEGIN, ROW_END) of the
+ * image.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for Laplacian
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param ROW_BEGIN First row to compute
+ * @param ROW_END   Row after the last row to compute
+ */
+static void genLaplacianRows(const unsigned char* SRC,
+                             short* dest,
+                             const int ROWS,
+                             const int COLS,
+                             const int ROW_BEGIN,
+                             const int ROW_END) {
+  // Filter mask for Laplacian filter
+  const int MASK_LAPLACIAN[image::MASK_SIZE][image::MASK_SIZE] = {
+      0, 1, 0, 1, -4, 1, 0, 1, 0};
+
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
+    const bool BORDER_ROW = i == 0 || i == ROWS - 1;
+    // Rows above and below are only read when they are inside the image
+    const unsigned char* ROW = &SRC[COLS * i];
+    const unsigned char* ABOVE = BORDER_ROW ? ROW : ROW - COLS;
+    const unsigned char* BELOW = BORDER_ROW ? ROW : ROW + COLS;
+
+    for (int j = 0; j < COLS; j++) {
+      if (!BORDER_ROW && j > 0 && j < COLS - 1) {
+        dest[COLS * i + j] =
+            ABOVE[j] + BELOW[j] + ROW[j - 1] + ROW[j + 1] - 4 * ROW[j];
+        continue;
+      }
+
+      // Sum of pixels inside the bounds of the mask
+      int sum = 0;
+      // Count of pixels inside the bounds of the mask
+      int count = 0;
+
+      // Iterate through the mask
+      for (int k = -MASK_SIZE_HALF; k <= MASK_SIZE_HALF; k++) {
+        for (int l = -MASK_SIZE_HALF; l <= MASK_SIZE_HALF; l++) {
+          // Ensure that the current pixel is not out of bounds
+          if ((i + k) < 0 || (i + k) >= ROWS) {
+            continue;
+          }
+
+          if ((j + l) < 0 || (j + l) >= COLS) {
+            continue;
+          }
+
+          sum += SRC[COLS * (i + k) + j + l] *
+                 MASK_LAPLACIAN[k + MASK_SIZE_HALF][l + MASK_SIZE_HALF];
+          count++;
+        }
+      }
+
+      // Re-normalize based on number of pixels that were out of bounds
+      dest[COLS * i + j] = sum * MASK_SIZE * MASK_SIZE / count;
+    }
+  }
+}
+
+/**
+ * Sharpens the rows in the range [ROW_BEGIN, ROW_END) of the image with every
+ * given weight, reading each pixel and its Laplacian once.
+ *
+ * @param SRC       Buffer containing original image
+ * @param LAPLACIAN Buffer containing Laplacian of original image
+ * @param dest      Destination buffers for sharpened images, one per weight
+ * @param WEIGHTS   Strengths of sharpening
+ * @param COUNT     Number of weights
+ * @param COLS      Number of columns in original image
+ * @param ROW_BEGIN First row to sharpen
+ * @param ROW_END   Row after the last row to sharpen
+ */
+static void applyLaplaceSharpeningRows(const unsigned char* SRC,
+                                       const short* LAPLACIAN,
+                                       unsigned char* const dest[],
+                                       const double WEIGHTS[],
+                                       const int COUNT,
+                                       const int COLS,
+                                       const int ROW_BEGIN,
+                                       const int ROW_END) {
+  // Sharpen image using Laplacian following the formula:
+  //   I' = I - w * (Hl * I)
+  // Where I is the original image, w is the given weight, and (Hl * I) is the
+  // image with the Laplacian filter applied to it.
+  for (int i = COLS * ROW_BEGIN; i < COLS * ROW_END; i++) {
+    const unsigned char PIXEL = SRC[i];
+    const short VALUE = LAPLACIAN[i];
+
+    for (int w = 0; w < COUNT; w++) {
+      int output = PIXEL - WEIGHTS[w] * VALUE;
+
+      // Clamp output value if out of bounds
+      if (output < 0) {
+        output = 0;
+      }
+
+      if (output > image::LEVEL_WHITE) {
+        output = image::LEVEL_WHITE;
+      }
+
+      dest[w][i] = output;
+    }
+  }
+}
+
+/**
+ * Produces the Laplacian of the given image into the destination buffer. Near
+ * the border of the image, the Laplacian is re-normalized based on the number
+ * of pixels inside the bounds of the mask.
+ *
+ * @param SRC  Buffer containing original image
+ * @param dest Destination buffer for Laplacian
+ * @param ROWS Number of rows in original image
+ * @param COLS Number of columns in original image
+ */
+void genLaplacian(const unsigned char* SRC,
+                  short* dest,
+                  const int ROWS,
+                  const int COLS) {
+  genLaplacianRows(SRC, dest, ROWS, COLS, 0, ROWS);
+}
+
+/**
+ * Produces the same Laplacian as genLaplacian, splitting the image into bands
+ * of rows that are computed in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for Laplacian
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that runs the bands
+ */
+void genLaplacian(const unsigned char* SRC,
+                  short* dest,
+                  const int ROWS,
+                  const int COLS,
+                  parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    genLaplacianRows(SRC, dest, ROWS, COLS, ROW_BEGIN, ROW_END);
+  });
+}
+
+/**
+ * Produces one sharpened image per given weight from an image and its
+ * Laplacian computed with genLaplacian, in a single pass over both buffers.
+ *
+ * @param SRC       Buffer containing original image
+ * @param LAPLACIAN Buffer containing Laplacian of original image
+ * @param dest      Destination buffers for sharpened images, one per weight
+ * @param WEIGHTS   Strengths of sharpening, a higher value produces a sharper
+ *                  image
+ * @param COUNT     Number of weights
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ */
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            const short* LAPLACIAN,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS) {
+  applyLaplaceSharpeningRows(SRC, LAPLACIAN, dest, WEIGHTS, COUNT, COLS, 0,
+                             ROWS);
+}
+
+/**
+ * Produces the same images as applyLaplaceSharpening, splitting the image into
+ * bands of rows that are sharpened in parallel by the given executor.
+ *
+ * @param SRC       Buffer containing original image
+ * @param LAPLACIAN Buffer containing Laplacian of original image
+ * @param dest      Destination buffers for sharpened images, one per weight
+ * @param WEIGHTS   Strengths of sharpening, a higher value produces a sharper
+ *                  image
+ * @param COUNT     Number of weights
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param executor  Executor that runs the bands
+ */
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            const short* LAPLACIAN,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS,
+                            parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    applyLaplaceSharpeningRows(SRC, LAPLACIAN, dest, WEIGHTS, COUNT, COLS,
+                               ROW_BEGIN, ROW_END);
+  });
+}
+
+/**
+ * Produces one sharpened image per given weight. The Laplacian is computed
+ * once into a scratch buffer from the shared BufferPool, in blocks of about
+ * LAPLACE_BLOCK_PIXELS pixels, and every block is sharpened with all weights
+ * right after its Laplacian is computed.
+ *
+ * @param SRC     Buffer containing original image
+ * @param dest    Destination buffers for sharpened images, one per weight
+ * @param WEIGHTS Strengths of sharpening, a higher value produces a sharper
+ *                image
+ * @param COUNT   Number of weights
+ * @param ROWS    Number of rows in original image
+ * @param COLS    Number of columns in original image
+ */
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS) {
+  parallel::Executor serial(1);
+
+  applyLaplaceSharpening(SRC, dest, WEIGHTS, COUNT, ROWS, COLS, serial);
+}
+
+/**
+ * Produces the same images as applyLaplaceSharpening, splitting the image into
+ * bands of rows that are processed in parallel by the given executor. Each
+ * band is computed and sharpened block by block.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffers for sharpened images, one per weight
+ * @param WEIGHTS  Strengths of sharpening, a higher value produces a sharper
+ *                 image
+ * @param COUNT    Number of weights
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that runs the bands
+ */
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS,
+                            parallel::Executor& executor) {
+  Buffer<short> laplacian((unsigned long)ROWS * COLS);
+  const int BLOCK_ROWS = std::max(LAPLACE_BLOCK_PIXELS / std::max(COLS, 1), 1);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    // Sharpen each block of rows while its Laplacian is still in cache
+    for (int begin = ROW_BEGIN; begin < ROW_END; begin += BLOCK_ROWS) {
+      const int END = std::min(begin + BLOCK_ROWS, ROW_END);
+
+      genLaplacianRows(SRC, laplacian.get(), ROWS, COLS, begin, END);
+      applyLaplaceSharpeningRows(SRC, laplacian.get(), dest, WEIGHTS, COUNT,
+                                 COLS, begin, END);
+    }
+  });
+}
+
+/**
+ * Produces a new image that is sharpened using the Laplace filter. The given
+ * weight controls the strength of sharpening.
+ *
+ * @param SRC    Buffer containing original image
+ * @param dest   Destination buffer for filtered image
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param WEIGHT Strength of sharpening, a higher value produces a sharper image
+ */
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const double WEIGHT) {
+  applyLaplaceSharpening(SRC, &dest, &WEIGHT, 1, ROWS, COLS);
+}
+
+/**
+ * Produces the same image as applyLaplaceSharpening, splitting the image into
+ * bands of rows that are sharpened in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param WEIGHT   Strength of sharpening, a higher value produces a sharper
+ *                 image
+ * @param executor Executor that runs the bands
+ */
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const double WEIGHT,
+                            parallel::Executor& executor) {
+  applyLaplaceSharpening(SRC, &dest, &WEIGHT, 1, ROWS, COLS, executor);
+}
+
+/**
+ * Coefficients of the recursive Gaussian filter of Young and van Vliet. Each
+ * pass computes
+ *
+ *   w[n] = B * x[n] + (b1 * w[n - 1] + b2 * w[n - 2] + b3 * w[n - 3]) / b0
+ *
+ * once forwards and once backwards. The coefficients are stored pre-divided by
+ * b0. The matrix m gives the initial state of the backward pass from the end of
+ * the forward pass, following Triggs and Sdika.
+ */
+struct RecursiveGaussian {
+  float b;
+  float b1;
+  float b2;
+  float b3;
+  float m[3][3];
+};
+
+/**
+ * Computes the coefficients of the recursive Gaussian filter for the given
+ * standard deviation.
+ *
+ * @param SIGMA Standard deviation of the Gaussian, at least 0.5
+ * @returns     Filter coefficients
+ */
+static RecursiveGaussian genRecursiveGaussian(const double SIGMA) {
+  const double Q = SIGMA >= 2.5
+                       ? 0.98711 * SIGMA - 0.96330
+                       : 3.97156 - 4.14554 * std::sqrt(1 - 0.26891 * SIGMA);
+  const double B0 =
+      1.57825 + 2.44413 * Q + 1.4281 * Q * Q + 0.422205 * Q * Q * Q;
+  const double B1 = 2.44413 * Q + 2.85619 * Q * Q + 1.26661 * Q * Q * Q;
+  const double B2 = -(1.4281 * Q * Q + 1.26661 * Q * Q * Q);
+  const double B3 = 0.422205 * Q * Q * Q;
+
+  RecursiveGaussian coefficients;
+
+  coefficients.b1 = B1 / B0;
+  coefficients.b2 = B2 / B0;
+  coefficients.b3 = B3 / B0;
+  coefficients.b = 1 - (coefficients.b1 + coefficients.b2 + coefficients.b3);
+
+  // Boundary matrix of Triggs and Sdika for a signal extended by repeating its
+  // last sample
+  const double A1 = B1 / B0;
+  const double A2 = B2 / B0;
+  const double A3 = B3 / B0;
+  const double SCALE =
+      coefficients.b / ((1 + A1 - A2 + A3) * (1 - A1 - A2 - A3) *
+                        (1 + A2 + (A1 - A3) * A3));
+
+  coefficients.m[0][0] = SCALE * (-A3 * A1 + 1 - A3 * A3 - A2);
+  coefficients.m[0][1] = SCALE * (A3 + A1) * (A2 + A3 * A1);
+  coefficients.m[0][2] = SCALE * A3 * (A1 + A3 * A2);
+  coefficients.m[1][0] = SCALE * (A1 + A3 * A2);
+  coefficients.m[1][1] = -SCALE * (A2 - 1) * (A2 + A3 * A1);
+  coefficients.m[1][2] = -SCALE * A3 * (A3 * A1 + A3 * A3 + A2 - 1);
+  coefficients.m[2][0] = SCALE * (A3 * A1 + A2 + A1 * A1 - A2 * A2);
+  coefficients.m[2][1] = SCALE * (A1 * A2 + A3 * A2 * A2 - A1 * A3 * A3 -
+                                  A3 * A3 * A3 - A3 * A2 + A3);
+  coefficients.m[2][2] = SCALE * A3 * (A1 + A3 * A2);
+
+  return coefficients;
+}
+
+/**
+ * Applies the recursive Gaussian along the columns [COL_BEGIN, COL_END) of an
+ * image. The recursion runs down the rows, and each step updates a whole row of
+ * columns at once so that the inner loops are vectorized by the compiler. The
+ * image is extended at the top and bottom by repeating the border rows.
+ *
+ * @param SRC          Buffer containing original image
+ * @param dest         Destination buffer for filtered image, may be SRC if both
+ *                     have type float
+ * @param ROWS         Number of rows in image
+ * @param COLS         Number of columns in image
+ * @param COEFFICIENTS Filter coefficients
+ * @param COL_BEGIN    First column to filter
+ * @param COL_END      Column after the last column to filter
+ */
+template <class T>
+static void applyRecursiveGaussianColumns(const T* SRC,
+                                          float* dest,
+                                          const int ROWS,
+                                          const int COLS,
+                                          const RecursiveGaussian& COEFFICIENTS,
+                                          const int COL_BEGIN,
+                                          const int COL_END) {
+  const float B = COEFFICIENTS.b;
+  const float B1 = COEFFICIENTS.b1;
+  const float B2 = COEFFICIENTS.b2;
+  const float B3 = COEFFICIENTS.b3;
+  const int WIDTH = COL_END - COL_BEGIN;
+
+  // Previous three outputs of the recursion for every column
+  std::vector<float> previous1(WIDTH);
+  std::vector<float> previous2(WIDTH);
+  std::vector<float> previous3(WIDTH);
+  float* w1 = &previous1[0];
+  float* w2 = &previous2[0];
+  float* w3 = &previous3[0];
+
+  // Last row of the original image, kept since dest may overwrite it
+  std::vector<float> last(WIDTH);
+
+  for (int j = 0; j < WIDTH; j++) {
+    last[j] = SRC[(long)COLS * (ROWS - 1) + COL_BEGIN + j];
+  }
+
+  // Forward pass, starting from the steady state of the first row
+  for (int j = 0; j < WIDTH; j++) {
+    w1[j] = w2[j] = w3[j] = SRC[COL_BEGIN + j];
+  }
+
+  for (int i = 0; i < ROWS; i++) {
+    const T* IN = &SRC[(long)COLS * i + COL_BEGIN];
+    float* out = &dest[(long)COLS * i + COL_BEGIN];
+
+    for (int j = 0; j < WIDTH; j++) {
+      const float W = B * IN[j] + B1 * w1[j] + B2 * w2[j] + B3 * w3[j];
+
+      w3[j] = w2[j];
+      w2[j] = w1[j];
+      w1[j] = W;
+      out[j] = W;
+    }
+  }
+
+  // Backward pass, starting from the state that the forward pass would have
+  // reached if the last row were repeated forever
+  const float* OUT1 = &dest[(long)COLS * (ROWS - 1) + COL_BEGIN];
+  const float* OUT2 = &dest[(long)COLS * std::max(ROWS - 2, 0) + COL_BEGIN];
+  const float* OUT3 = &dest[(long)COLS * std::max(ROWS - 3, 0) + COL_BEGIN];
+  const float(*M)[3] = COEFFICIENTS.m;
+
+  for (int j = 0; j < WIDTH; j++) {
+    const float U1 = OUT1[j] - last[j];
+    const float U2 = OUT2[j] - last[j];
+    const float U3 = OUT3[j] - last[j];
+
+    w1[j] = M[0][0] * U1 + M[0][1] * U2 + M[0][2] * U3 + last[j];
+    w2[j] = M[1][0] * U1 + M[1][1] * U2 + M[1][2] * U3 + last[j];
+    w3[j] = M[2][0] * U1 + M[2][1] * U2 + M[2][2] * U3 + last[j];
+  }
+
+  for (int i = ROWS - 1; i >= 0; i--) {
+    float* out = &dest[(long)COLS * i + COL_BEGIN];
+
+    for (int j = 0; j < WIDTH; j++) {
+      const float W = B * out[j] + B1 * w1[j] + B2 * w2[j] + B3 * w3[j];
+
+      w3[j] = w2[j];
+      w2[j] = w1[j];
+      w1[j] = W;
+      out[j] = W;
+    }
+  }
+}
+
+/**
+ * Transposes the rows [ROW_BEGIN, ROW_END) of an image into the respective
+ * columns of the destination, in square blocks to keep both sides in cache.
+ *
+ * @param SRC       Buffer containing image
+ * @param dest      Destination buffer of size COLS x ROWS
+ * @param ROWS      Number of rows in image
+ * @param COLS      Number of columns in image
+ * @param ROW_BEGIN First row to transpose
+ * @param ROW_END   Row after the last row to transpose
+ */
+static void transposeRows(const float* SRC,
+                          float* dest,
+                          const int ROWS,
+                          const int COLS,
+                          const int ROW_BEGIN,
+                          const int ROW_END) {
+  const int BLOCK = 32;
+
+  for (int i0 = ROW_BEGIN; i0 < ROW_END; i0 += BLOCK) {
+    for (int j0 = 0; j0 < COLS; j0 += BLOCK) {
+      for (int i = i0; i < std::min(i0 + BLOCK, ROW_END); i++) {
+        for (int j = j0; j < std::min(j0 + BLOCK, COLS); j++) {
+          dest[(long)ROWS * j + i] = SRC[(long)COLS * i + j];
+        }
+      }
+    }
+  }
+}
+
+/**
+ * Stores a smoothed value as a grey level, rounded and clamped to
+ * [0, LEVEL_WHITE].
+ *
+ * @param VALUE Smoothed value
+ * @param pixel Destination pixel
+ */
+static inline void storeSmoothed(const float VALUE, unsigned char& pixel) {
+  const float ROUNDED = VALUE + 0.5f;
+
+  pixel = ROUNDED < 0 ? 0 : ROUNDED > LEVEL_WHITE ? LEVEL_WHITE : (int)ROUNDED;
+}
+
+/**
+ * Stores a smoothed value as a float, without rounding or clamping.
+ *
+ * @param VALUE Smoothed value
+ * @param pixel Destination pixel
+ */
+static inline void storeSmoothed(const float VALUE, float& pixel) {
+  pixel = VALUE;
+}
+
+/**
+ * Smooths the given image with a recursive Gaussian, filtering bands of
+ * columns and then bands of rows in parallel with the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param SIGMA    Standard deviation of the Gaussian, at least 0.5
+ * @param executor Executor that runs the bands
+ */
+template <class T>
+static void applyGaussianFilterBands(const unsigned char* SRC,
+                                     T* dest,
+                                     const int ROWS,
+                                     const int COLS,
+                                     const double SIGMA,
+                                     parallel::Executor& executor) {
+  // Ensure that the standard deviation is within the range of the filter
+  if (SIGMA < 0.5) {
+    throw "ERROR: Gaussian standard deviation must be at least 0.5!";
+  }
+
+  if (ROWS <= 0 || COLS <= 0) {
+    return;
+  }
+
+  const RecursiveGaussian COEFFICIENTS = genRecursiveGaussian(SIGMA);
+  Buffer<float> vertical((unsigned long)ROWS * COLS);
+  Buffer<float> transposed((unsigned long)ROWS * COLS);
+
+  // Filter along columns
+  executor.forEachBand(COLS, [&](const int COL_BEGIN, const int COL_END) {
+    applyRecursiveGaussianColumns(SRC, vertical.get(), ROWS, COLS,
+                                  COEFFICIENTS, COL_BEGIN, COL_END);
+  });
+
+  // Filter along rows, as columns of the transposed image
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    transposeRows(vertical.get(), transposed.get(), ROWS, COLS, ROW_BEGIN,
+                  ROW_END);
+  });
+
+  executor.forEachBand(ROWS, [&](const int COL_BEGIN, const int COL_END) {
+    applyRecursiveGaussianColumns(transposed.get(), transposed.get(), COLS,
+                                  ROWS, COEFFICIENTS, COL_BEGIN, COL_END);
+  });
+
+  // Transpose back in square blocks, converting to the destination type
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    const int BLOCK = 32;
+    const float* FILTERED = transposed.get();
+
+    for (int j0 = 0; j0 < COLS; j0 += BLOCK) {
+      for (int i = ROW_BEGIN; i < ROW_END; i++) {
+        for (int j = j0; j < std::min(j0 + BLOCK, COLS); j++) {
+          storeSmoothed(FILTERED[(long)ROWS * j + i], dest[(long)COLS * i + j]);
+        }
+      }
+    }
+  });
+}
+
+/**
+ * Produces a new image smoothed with a Gaussian of the given standard deviation
+ * and outputs the result to the destination buffer. The Gaussian is
+ * approximated with the recursive filter of Young and van Vliet, applied
+ * separably along columns and then along rows, so the cost per pixel is the
+ * same for any standard deviation. The image is extended beyond its border by
+ * repeating the border pixels.
+ *
+ * @param SRC   Buffer containing original image
+ * @param dest  Destination buffer for filtered image
+ * @param ROWS  Number of rows in original image
+ * @param COLS  Number of columns in original image
+ * @param SIGMA Standard deviation of the Gaussian, at least 0.5
+ */
+void applyGaussianFilter(const unsigned char* SRC,
+                         unsigned char* dest,
+                         const int ROWS,
+                         const int COLS,
+                         const double SIGMA) {
+  parallel::Executor serial(1);
+
+  applyGaussianFilterBands(SRC, dest, ROWS, COLS, SIGMA, serial);
+}
+
+/**
+ * Produces the same image as applyGaussianFilter, splitting the work into
+ * bands of columns for the vertical pass and bands of rows for the horizontal
+ * pass that are processed in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param SIGMA    Standard deviation of the Gaussian, at least 0.5
+ * @param executor Executor that runs the bands
+ */
+void applyGaussianFilter(const unsigned char* SRC,
+                         unsigned char* dest,
+                         const int ROWS,
+                         const int COLS,
+                         const double SIGMA,
+                         parallel::Executor& executor) {
+  applyGaussianFilterBands(SRC, dest, ROWS, COLS, SIGMA, executor);
+}
+
+/**
+ * Produces the same image as applyGaussianFilter without rounding or clamping
+ * the smoothed values.
+ *
+ * @param SRC   Buffer containing original image
+ * @param dest  Destination buffer for filtered image
+ * @param ROWS  Number of rows in original image
+ * @param COLS  Number of columns in original image
+ * @param SIGMA Standard deviation of the Gaussian, at least 0.5
+ */
+void applyGaussianFilter(const unsigned char* SRC,
+                         float* dest,
+                         const int ROWS,
+                         const int COLS,
+                         const double SIGMA) {
+  parallel::Executor serial(1);
+
+  applyGaussianFilterBands(SRC, dest, ROWS, COLS, SIGMA, serial);
+}
+
+/**
+ * Produces the same image as the float applyGaussianFilter, splitting the work
+ * into bands that are processed in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param SIGMA    Standard deviation of the Gaussian, at least 0.5
+ * @param executor Executor that runs the bands
+ */
+void applyGaussianFilter(const unsigned char* SRC,
+                         float* dest,
+                         const int ROWS,
+                         const int COLS,
+                         const double SIGMA,
+                         parallel::Executor& executor) {
+  applyGaussianFilterBands(SRC, dest, ROWS, COLS, SIGMA, executor);
+}
+
+/**
+ * Converts the pixels in the range [BEGIN, END) of a 16-bit image to grey
+ * levels clamped to [0, LEVEL_WHITE], 16 pixels at a time when SSE2 is
+ * available.
+ *
+ * @param SRC   Buffer containing image
+ * @param dest  Destination buffer for grey levels
+ * @param begin First pixel to convert
+ * @param END   Pixel after the last pixel to convert
+ */
+static void genClampedPixels(const short* SRC,
+                             unsigned char* dest,
+                             long begin,
+                             const long END) {
+#ifdef __SSE2__
+  for (; begin + 16 <= END; begin += 16) {
+    const __m128i LOW = _mm_loadu_si128((const __m128i*)&SRC[begin]);
+    const __m128i HIGH = _mm_loadu_si128((const __m128i*)&SRC[begin + 8]);
+
+    _mm_storeu_si128((__m128i*)&dest[begin], _mm_packus_epi16(LOW, HIGH));
+  }
+#endif
+
+  for (; begin < END; begin++) {
+    dest[begin] = std::min(std::max((int)SRC[begin], 0), (int)LEVEL_WHITE);
+  }
+}
+
+/**
+ * Converts the pixels in the range [BEGIN, END) of a 32-bit image to grey
+ * levels clamped to [0, LEVEL_WHITE], 16 pixels at a time when SSE2 is
+ * available.
+ *
+ * @param SRC   Buffer containing image
+ * @param dest  Destination buffer for grey levels
+ * @param begin First pixel to convert
+ * @param END   Pixel after the last pixel to convert
+ */
+static void genClampedPixels(const int* SRC,
+                             unsigned char* dest,
+                             long begin,
+                             const long END) {
+#ifdef __SSE2__
+  for (; begin + 16 <= END; begin += 16) {
+    // Saturating to 16 bits and then to 8 bits clamps to [0, LEVEL_WHITE]
+    const __m128i* IN = (const __m128i*)&SRC[begin];
+    const __m128i LOW =
+        _mm_packs_epi32(_mm_loadu_si128(IN), _mm_loadu_si128(IN + 1));
+    const __m128i HIGH =
+        _mm_packs_epi32(_mm_loadu_si128(IN + 2), _mm_loadu_si128(IN + 3));
+
+    _mm_storeu_si128((__m128i*)&dest[begin], _mm_packus_epi16(LOW, HIGH));
+  }
+#endif
+
+  for (; begin < END; begin++) {
+    dest[begin] = std::min(std::max(SRC[begin], 0), (int)LEVEL_WHITE);
+  }
+}
+
+/**
+ * Converts the pixels in the range [BEGIN, END) of a float image to grey
+ * levels, truncated and clamped to [0, LEVEL_WHITE] like storeFiltered, 16
+ * pixels at a time when SSE2 is available.
+ *
+ * @param SRC   Buffer containing image
+ * @param dest  Destination buffer for grey levels
+ * @param begin First pixel to convert
+ * @param END   Pixel after the last pixel to convert
+ */
+static void genClampedPixels(const float* SRC,
+                             unsigned char* dest,
+                             long begin,
+                             const long END) {
+  const float MAX = LEVEL_WHITE;
+
+#ifdef __SSE2__
+  // Clamp before converting, so that values out of the range of an int do not
+  // wrap around
+  const __m128 LOWEST = _mm_setzero_ps();
+  const __m128 HIGHEST = _mm_set1_ps(MAX);
+  __m128i converted[4];
+
+  for (; begin + 16 <= END; begin += 16) {
+    for (int k = 0; k < 4; k++) {
+      const __m128 VALUES = _mm_loadu_ps(&SRC[begin + 4 * k]);
+
+      converted[k] =
+          _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(VALUES, LOWEST), HIGHEST));
+    }
+
+    const __m128i LOW = _mm_packs_epi32(converted[0], converted[1]);
+    const __m128i HIGH = _mm_packs_epi32(converted[2], converted[3]);
+
+    _mm_storeu_si128((__m128i*)&dest[begin], _mm_packus_epi16(LOW, HIGH));
+  }
+#endif
+
+  for (; begin < END; begin++) {
+    // Written so that NaN maps to 0, as with the SSE2 path
+    const float VALUE = SRC[begin] > 0 ? std::min(SRC[begin], MAX) : 0;
+
+    dest[begin] = (int)VALUE;
+  }
+}
+
+/**
+ * Converts the rows in the range [ROW_BEGIN, ROW_END) of an intermediate
+ * image to grey levels.
+ *
+ * @param SRC       Buffer containing intermediate image
+ * @param dest      Destination buffer for grey levels
+ * @param COLS      Number of columns in image
+ * @param ROW_BEGIN First row to convert
+ * @param ROW_END   Row after the last row to convert
+ */
+template <class T>
+static void genClampedImageRows(const T* SRC,
+                                unsigned char* dest,
+                                const int COLS,
+                                const int ROW_BEGIN,
+                                const int ROW_END) {
+  genClampedPixels(SRC, dest, (long)COLS * ROW_BEGIN, (long)COLS * ROW_END);
+}
+
+/**
+ * Converts a 16-bit intermediate image, such as the derivatives of
+ * genSobelGradient or the output of the 16-bit applyLinearFilter, to grey
+ * levels clamped to [0, LEVEL_WHITE]. This is the final stage of pipelines
+ * that keep their intermediate images signed, so that they are clamped only
+ * once.
+ *
+ * @param SRC  Buffer containing intermediate image
+ * @param dest Destination buffer for grey levels
+ * @param ROWS Number of rows in image
+ * @param COLS Number of columns in image
+ */
+void genClampedImage(const short* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS) {
+  genClampedImageRows(SRC, dest, COLS, 0, ROWS);
+}
+
+/**
+ * Produces the same image as the 16-bit genClampedImage, splitting the image
+ * into bands of rows that are converted in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing intermediate image
+ * @param dest     Destination buffer for grey levels
+ * @param ROWS     Number of rows in image
+ * @param COLS     Number of columns in image
+ * @param executor Executor that runs the bands
+ */
+void genClampedImage(const short* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS,
+                     parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    genClampedImageRows(SRC, dest, COLS, ROW_BEGIN, ROW_END);
+  });
+}
+
+/**
+ * Converts a 32-bit intermediate image to grey levels clamped to
+ * [0, LEVEL_WHITE].
+ *
+ * @param SRC  Buffer containing intermediate image
+ * @param dest Destination buffer for grey levels
+ * @param ROWS Number of rows in image
+ * @param COLS Number of columns in image
+ */
+void genClampedImage(const int* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS) {
+  genClampedImageRows(SRC, dest, COLS, 0, ROWS);
+}
+
+/**
+ * Produces the same image as the 32-bit genClampedImage, splitting the image
+ * into bands of rows that are converted in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing intermediate image
+ * @param dest     Destination buffer for grey levels
+ * @param ROWS     Number of rows in image
+ * @param COLS     Number of columns in image
+ * @param executor Executor that runs the bands
+ */
+void genClampedImage(const int* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS,
+                     parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    genClampedImageRows(SRC, dest, COLS, ROW_BEGIN, ROW_END);
+  });
+}
+
+/**
+ * Converts a float intermediate image to grey levels, truncated and clamped to
+ * [0, LEVEL_WHITE] in the same way as the 8-bit filters store their output.
+ *
+ * @param SRC  Buffer containing intermediate image
+ * @param dest Destination buffer for grey levels
+ * @param ROWS Number of rows in image
+ * @param COLS Number of columns in image
+ */
+void genClampedImage(const float* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS) {
+  genClampedImageRows(SRC, dest, COLS, 0, ROWS);
+}
+
+/**
+ * Produces the same image as the float genClampedImage, splitting the image
+ * into bands of rows that are converted in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing intermediate image
+ * @param dest     Destination buffer for grey levels
+ * @param ROWS     Number of rows in image
+ * @param COLS     Number of columns in image
+ * @param executor Executor that runs the bands
+ */
+void genClampedImage(const float* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS,
+                     parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    genClampedImageRows(SRC, dest, COLS, ROW_BEGIN, ROW_END);
+  });
+}
+
+/**
+ * Creates a stream filter. The window and scratch rows are allocated once for
+ * the whole stream.
+ *
+ * @param OPERATION Filter to apply
+ * @param COLS      Number of columns in image
+ * @param RADIUS    Number of rows above and below an output row that it
+ *                  depends on
+ * @param SINK      Receives the output rows
+ */
+StreamFilter::StreamFilter(const StreamOperation OPERATION,
+                           const int COLS,
+                           const int RADIUS,
+                           const RowSink& SINK)
+    : operation(OPERATION),
+      cols(COLS),
+      radius(RADIUS),
+      mask(),
+      weight(0),
+      sink(SINK),
+      window(2 * (2 * RADIUS + 1) * (long)COLS),
+      laplacian(OPERATION == STREAM_LAPLACE_SHARPENING
+                    ? (2 * RADIUS + 1) * (long)COLS
+                    : 0),
+      output((2 * RADIUS + 1) * (long)COLS),
+      colCoarse(OPERATION == STREAM_MEDIAN && RADIUS > MEDIAN_NETWORK_MAX_RADIUS
+                    ? MEDIAN_COARSE_BINS * (long)COLS
+                    : 0),
+      colFine(OPERATION == STREAM_MEDIAN && RADIUS > MEDIAN_NETWORK_MAX_RADIUS
+                  ? LEVELS * (long)COLS
+                  : 0),
+      histogramRow(0),
+      rowsIn(0),
+      rowsOut(0),
+      finished(false) {}
+
+/**
+ * Creates a stream filter that produces the same rows as applyLinearFilter.
+ *
+ * @param COLS Number of columns in image
+ * @param MASK Mask or filter to scan through original image with
+ * @param SINK Receives the output rows
+ * @returns    Stream filter
+ */
+StreamFilter StreamFilter::genLinearFilter(
+    const int COLS,
+    const double MASK[MASK_SIZE][MASK_SIZE],
+    const RowSink& SINK) {
+  StreamFilter filter(STREAM_LINEAR, COLS, MASK_SIZE_HALF, SINK);
+
+  for (int k = 0; k < MASK_SIZE; k++) {
+    for (int l = 0; l < MASK_SIZE; l++) {
+      filter.mask[k][l] = MASK[k][l];
+    }
+  }
+
+  return filter;
+}
+
+/**
+ * Creates a stream filter that produces the same rows as applyMedianFilter
+ * with the given radius.
+ *
+ * @param COLS   Number of columns in image
+ * @param RADIUS Radius of the window
+ * @param SINK   Receives the output rows
+ * @returns      Stream filter
+ */
+StreamFilter StreamFilter::genMedianFilter(const int COLS,
+                                           const int RADIUS,
+                                           const RowSink& SINK) {
+  // Ensure that the window has a valid size
+  if (RADIUS < 0) {
+    throw "ERROR: Median filter radius must not be negative!";
+  }
+
+  return StreamFilter(STREAM_MEDIAN, COLS, RADIUS, SINK);
+}
+
+/**
+ * Creates a stream filter that produces the same rows as genGradient.
+ *
+ * @param COLS Number of columns in image
+ * @param SINK Receives the output rows
+ * @returns    Stream filter
+ */
+StreamFilter StreamFilter::genGradient(const int COLS, const RowSink& SINK) {
+  return StreamFilter(STREAM_GRADIENT, COLS, MASK_SIZE_HALF, SINK);
+}
+
+/**
+ * Creates a stream filter that produces the same rows as
+ * applyLaplaceSharpening with the given weight.
+ *
+ * @param COLS   Number of columns in image
+ * @param WEIGHT Weight w of the Laplacian
+ * @param SINK   Receives the output rows
+ * @returns      Stream filter
+ */
+StreamFilter StreamFilter::genLaplaceSharpening(const int COLS,
+                                                const double WEIGHT,
+                                                const RowSink& SINK) {
+  StreamFilter filter(STREAM_LAPLACE_SHARPENING, COLS, MASK_SIZE_HALF, SINK);
+  filter.weight = WEIGHT;
+
+  return filter;
+}
+
+/**
+ * Adds the next row of the image to the stream, and passes the output row that
+ * it completes to the sink, if any.
+ *
+ * @param ROW Pixels of the next row
+ */
+void StreamFilter::pushRow(const unsigned char* ROW) {
+  // Ensure that the stream is still open
+  if (finished) {
+    throw "ERROR: Cannot push rows to a finished stream filter!";
+  }
+
+  const int K = 2 * radius + 1;
+  const int SLOT = rowsIn % K;
+
+  // The row that the new row replaces in the window is no longer needed
+  if (!colFine.empty()) {
+    dropHistogramRows(rowsIn - K + 1);
+  }
+
+  std::copy(ROW, ROW + cols, &window[(long)cols * SLOT]);
+  std::copy(ROW, ROW + cols, &window[(long)cols * (SLOT + K)]);
+  rowsIn++;
+
+  if (!colFine.empty()) {
+    updateColumnHistograms(ROW, &colCoarse[0], &colFine[0], cols, 1);
+  }
+
+  // The output row radius rows above the new row has all of its window
+  while (rowsOut + radius < rowsIn) {
+    emitRow();
+  }
+}
+
+/**
+ * Ends the stream after its last row, and passes the remaining output rows,
+ * which are at the bottom border of the image, to the sink.
+ */
+void StreamFilter::finish() {
+  finished = true;
+
+  while (rowsOut < rowsIn) {
+    emitRow();
+  }
+}
+
+/**
+ * Removes the rows above the given row from the column histograms of the
+ * median filter.
+ *
+ * @param FIRST First row to keep in the column histograms
+ */
+void StreamFilter::dropHistogramRows(const int FIRST) {
+  const int K = 2 * radius + 1;
+
+  for (; histogramRow < FIRST; histogramRow++) {
+    updateColumnHistograms(&window[(long)cols * (histogramRow % K)],
+                           &colCoarse[0], &colFine[0], cols, -1);
+  }
+}
+
+/**
+ * Filters the next output row and passes it to the sink. The rows of its
+ * window are filtered as an image of their own, which has the same borders as
+ * the whole image where the window is clipped. A median filter too large for
+ * the sorting network instead reads the column histograms that pushRow keeps
+ * up to date with the rows of the window.
+ */
+void StreamFilter::emitRow() {
+  const int K = 2 * radius + 1;
+  const int ROW = rowsOut;
+  const int FIRST = std::max(ROW - radius, 0);
+  const int LAST =
+      finished ? std::min(ROW + radius, rowsIn - 1) : ROW + radius;
+  const int ROWS = LAST - FIRST + 1;
+  const int LOCAL = ROW - FIRST;
+  const unsigned char* SRC = &window[(long)cols * (FIRST % K)];
+  unsigned char* dest = &output[0];
+
+  switch (operation) {
+    case STREAM_LINEAR:
+      applyLinearFilterRows(SRC, mask, dest, ROWS, cols, LOCAL, LOCAL + 1);
+      break;
+    case STREAM_MEDIAN:
+      if (radius <= MEDIAN_NETWORK_MAX_RADIUS) {
+        applyMedianNetwork(SRC, dest, ROWS, cols, radius, LOCAL, LOCAL + 1);
+      } else {
+        dropHistogramRows(FIRST);
+        applyMedianHistogramRow(&colCoarse[0], &colFine[0],
+                                &dest[(long)cols * LOCAL], cols, radius, ROWS);
+      }
+      break;
+    case STREAM_GRADIENT:
+      genGradientRows(SRC, dest, ROWS, cols, LOCAL, LOCAL + 1);
+      break;
+    case STREAM_LAPLACE_SHARPENING:
+      genLaplacianRows(SRC, &laplacian[0], ROWS, cols, LOCAL, LOCAL + 1);
+      applyLaplaceSharpeningRows(SRC, &laplacian[0], &dest, &weight, 1, cols,
+                                 LOCAL, LOCAL + 1);
+      break;
+  }
+
+  rowsOut++;
+  sink(ROW, &output[(long)cols * LOCAL]);
+}
+
+/**
+ * Smooths the rows in the range [ROW_BEGIN, ROW_END) of the image with the
+ * exact bilateral filter. Both weights are looked up in precomputed tables:
+ * the spatial weight by the offset inside the window and the range weight by
+ * the absolute difference of grey levels.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for filtered image
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param RADIUS    Radius of the window
+ * @param SPATIAL   Spatial weights of the (2 * RADIUS + 1)^2 window offsets
+ * @param RANGE     Range weights of the LEVELS grey level differences
+ * @param ROW_BEGIN First row to filter
+ * @param ROW_END   Row after the last row to filter
+ */
+static void applyBilateralFilterRows(const unsigned char* SRC,
+                                     unsigned char* dest,
+                                     const int ROWS,
+                                     const int COLS,
+                                     const int RADIUS,
+                                     const float* SPATIAL,
+                                     const float* RANGE,
+                                     const int ROW_BEGIN,
+                                     const int ROW_END) {
+  const int SIZE = 2 * RADIUS + 1;
+
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
+    // Rows of the window clipped to the image
+    const int FIRST_ROW = std::max(i - RADIUS, 0);
+    const int LAST_ROW = std::min(i + RADIUS, ROWS - 1);
+
+    for (int j = 0; j < COLS; j++) {
+      const int FIRST_COL = std::max(j - RADIUS, 0);
+      const int LAST_COL = std::min(j + RADIUS, COLS - 1);
+      const int CENTER = SRC[COLS * i + j];
+      float sum = 0;
+      float weights = 0;
+
+      for (int k = FIRST_ROW; k <= LAST_ROW; k++) {
+        const unsigned char* ROW = &SRC[COLS * k];
+        const float* SPATIAL_ROW = &SPATIAL[SIZE * (k - i + RADIUS)];
+
+        for (int l = FIRST_COL; l <= LAST_COL; l++) {
+          const int PIXEL = ROW[l];
+          const int DIFFERENCE = PIXEL - CENTER;
+          const float WEIGHT = SPATIAL_ROW[l - j + RADIUS] *
+                               RANGE[DIFFERENCE < 0 ? -DIFFERENCE : DIFFERENCE];
+
+          sum += WEIGHT * PIXEL;
+          weights += WEIGHT;
+        }
+      }
+
+      // The center pixel has a weight of 1, so weights is never 0
+      dest[COLS * i + j] = std::min(sum / weights + 0.5f, (float)LEVEL_WHITE);
+    }
+  }
+}
+
+/**
+ * Produces a new image smoothed with an edge-preserving bilateral filter and
+ * outputs the result to the destination buffer. Each pixel becomes the average
+ * of the pixels in a window of radius ceil(2 * SIGMA_SPACE) around it, weighted
+ * by a Gaussian of their distance and a Gaussian of their difference in grey
+ * level, so pixels across an edge contribute little. Windows are clipped at
+ * the border of the image. The cost per pixel grows with the square of the
+ * radius, so applyBilateralGridFilter is faster for large SIGMA_SPACE.
+ *
+ * @param SRC         Buffer containing original image
+ * @param dest        Destination buffer for filtered image
+ * @param ROWS        Number of rows in original image
+ * @param COLS        Number of columns in original image
+ * @param SIGMA_SPACE Standard deviation of the spatial Gaussian, in pixels
+ * @param SIGMA_RANGE Standard deviation of the range Gaussian, in grey levels
+ */
+void applyBilateralFilter(const unsigned char* SRC,
+                          unsigned char* dest,
+                          const int ROWS,
+                          const int COLS,
+                          const double SIGMA_SPACE,
+                          const double SIGMA_RANGE) {
+  parallel::Executor serial(1);
+
+  applyBilateralFilter(SRC, dest, ROWS, COLS, SIGMA_SPACE, SIGMA_RANGE, serial);
+}
+
+/**
+ * Produces the same image as applyBilateralFilter, splitting the image into
+ * bands of rows that are filtered in parallel by the given executor.
+ *
+ * @param SRC         Buffer containing original image
+ * @param dest        Destination buffer for filtered image
+ * @param ROWS        Number of rows in original image
+ * @param COLS        Number of columns in original image
+ * @param SIGMA_SPACE Standard deviation of the spatial Gaussian, in pixels
+ * @param SIGMA_RANGE Standard deviation of the range Gaussian, in grey levels
+ * @param executor    Executor that runs the bands
+ */
+void applyBilateralFilter(const unsigned char* SRC,
+                          unsigned char* dest,
+                          const int ROWS,
+                          const int COLS,
+                          const double SIGMA_SPACE,
+                          const double SIGMA_RANGE,
+                          parallel::Executor& executor) {
+  // Ensure that the Gaussians are not degenerate
+  if (SIGMA_SPACE <= 0 || SIGMA_RANGE <= 0) {
+    throw "ERROR: Bilateral filter standard deviations must be positive!";
+  }
+
+  const int RADIUS = std::ceil(2 * SIGMA_SPACE);
+  const int SIZE = 2 * RADIUS + 1;
+  std::vector<float> spatial(SIZE * SIZE);
+  std::vector<float> range(LEVELS);
+
+  for (int k = -RADIUS; k <= RADIUS; k++) {
+    for (int l = -RADIUS; l <= RADIUS; l++) {
+      spatial[SIZE * (k + RADIUS) + l + RADIUS] =
+          std::exp(-(k * k + l * l) / (2 * SIGMA_SPACE * SIGMA_SPACE));
+    }
+  }
+
+  for (int d = 0; d < LEVELS; d++) {
+    range[d] = std::exp(-d * d / (2 * SIGMA_RANGE * SIGMA_RANGE));
+  }
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    applyBilateralFilterRows(SRC, dest, ROWS, COLS, RADIUS, &spatial[0],
+                             &range[0], ROW_BEGIN, ROW_END);
+  });
+}
+
+/**
+ * Downsampled 3D grid of a bilateral grid filter, indexed by row, column and
+ * grey level. Each cell holds the sum of the grey levels of the pixels splatted
+ * into it and their count. The grid has PADDING empty cells on every side so
+ * that blurring and interpolation never need bounds checks.
+ */
+struct BilateralGrid {
+  int rows;
+  int cols;
+  int levels;
+  double spaceScale;
+  double rangeScale;
+  float* sums;
+  float* weights;
+
+  long index(const int X, const int Y, const int Z) const {
+    return ((long)X * cols + Y) * levels + Z;
+  }
+};
+
+// Empty cells around the bilateral grid, enough for the blur kernel
+const int BILATERAL_GRID_PADDING = 2;
+// Largest number of cells of a bilateral grid, about 64 MiB per buffer
+const unsigned long BILATERAL_GRID_MAX_CELLS = 1UL << 24;
+// Approximate cost of splatting, blurring and slicing one grid cell relative
+// to visiting one pixel of the window of the exact bilateral filter
+const unsigned long BILATERAL_GRID_CELL_COST = 4;
+
+/**
+ * Blurs the grid cells whose first coordinate is in [X_BEGIN, X_END) along one
+ * axis with the binomial kernel [1 4 6 4 1] / 16, a Gaussian with a standard
+ * deviation of one cell.
+ *
+ * @param SRC     Grid values to blur
+ * @param dest    Destination for the blurred values
+ * @param GRID    Dimensions of the grid
+ * @param AXIS    Axis to blur along, 0 for rows, 1 for columns and 2 for grey
+ *                levels
+ * @param X_BEGIN First grid row to blur
+ * @param X_END   Grid row after the last row to blur
+ */
+static void blurBilateralGrid(const float* SRC,
+                              float* dest,
+                              const BilateralGrid& GRID,
+                              const int AXIS,
+                              const int X_BEGIN,
+                              const int X_END) {
+  const int P = BILATERAL_GRID_PADDING;
+  const long STRIDE = GRID.index(AXIS == 0, AXIS == 1, AXIS == 2);
+  const int SIZE[] = {GRID.rows, GRID.cols, GRID.levels};
+
+  for (int x = X_BEGIN; x < X_END; x++) {
+    for (int y = 0; y < GRID.cols; y++) {
+      for (int z = 0; z < GRID.levels; z++) {
+        const long INDEX = GRID.index(x, y, z);
+        const int POSITION[] = {x, y, z};
+
+        // Cells within the padding of the blurred axis have no full kernel and
+        // stay empty
+        if (POSITION[AXIS] < P || POSITION[AXIS] >= SIZE[AXIS] - P) {
+          dest[INDEX] = 0;
+          continue;
+        }
+
+        dest[INDEX] = (SRC[INDEX - 2 * STRIDE] + SRC[INDEX + 2 * STRIDE] +
+                       4 * (SRC[INDEX - STRIDE] + SRC[INDEX + STRIDE]) +
+                       6 * SRC[INDEX]) /
+                      16;
+      }
+    }
+  }
+}
+
+/**
+ * Produces a new image smoothed with a bilateral filter approximated by a
+ * bilateral grid (Chen, Paris and Durand) and outputs the result to the
+ * destination buffer. Pixels are splatted into a 3D grid downsampled by
+ * SIGMA_SPACE along the rows and columns and by SIGMA_RANGE along the grey
+ * levels, the grid is blurred with a small Gaussian along each axis, and each
+ * pixel is sliced out of the grid with trilinear interpolation. The cost is
+ * linear in the number of pixels plus the number of grid cells, so it does not
+ * grow with SIGMA_SPACE. Small standard deviations need a fine grid, so if the
+ * grid would have more than BILATERAL_GRID_MAX_CELLS cells, or would cost more
+ * than the window of applyBilateralFilter, the exact filter is used instead.
+ *
+ * @param SRC         Buffer containing original image
+ * @param dest        Destination buffer for filtered image
+ * @param ROWS        Number of rows in original image
+ * @param COLS        Number of columns in original image
+ * @param SIGMA_SPACE Standard deviation of the spatial Gaussian, in pixels
+ * @param SIGMA_RANGE Standard deviation of the range Gaussian, in grey levels
+ */
+void applyBilateralGridFilter(const unsigned char* SRC,
+                              unsigned char* dest,
+                              const int ROWS,
+                              const int COLS,
+                              const double SIGMA_SPACE,
+                              const double SIGMA_RANGE) {
+  parallel::Executor serial(1);
+
+  applyBilateralGridFilter(SRC, dest, ROWS, COLS, SIGMA_SPACE, SIGMA_RANGE,
+                           serial);
+}
+
+/**
+ * Produces the same image as applyBilateralGridFilter, splatting, blurring and
+ * slicing bands of the grid and of the image in parallel with the given
+ * executor. Each band of the grid only receives the pixels of the image rows
+ * that map to it, so no two threads write the same cell.
+ *
+ * @param SRC         Buffer containing original image
+ * @param dest        Destination buffer for filtered image
+ * @param ROWS        Number of rows in original image
+ * @param COLS        Number of columns in original image
+ * @param SIGMA_SPACE Standard deviation of the spatial Gaussian, in pixels
+ * @param SIGMA_RANGE Standard deviation of the range Gaussian, in grey levels
+ * @param executor    Executor that runs the bands
+ */
+void applyBilateralGridFilter(const unsigned char* SRC,
+                              unsigned char* dest,
+                              const int ROWS,
+                              const int COLS,
+                              const double SIGMA_SPACE,
+                              const double SIGMA_RANGE,
+                              parallel::Executor& executor) {
+  // Ensure that the grid is no finer than the image
+  if (SIGMA_SPACE < 1 || SIGMA_RANGE < 1) {
+    throw "ERROR: Bilateral grid standard deviations must be at least 1!";
+  }
+
+  if (ROWS <= 0 || COLS <= 0) {
+    return;
+  }
+
+  const int P = BILATERAL_GRID_PADDING;
+  BilateralGrid grid;
+  grid.spaceScale = 1 / SIGMA_SPACE;
+  grid.rangeScale = 1 / SIGMA_RANGE;
+  grid.rows = (int)((ROWS - 1) * grid.spaceScale + 0.5) + 1 + 2 * P;
+  grid.cols = (int)((COLS - 1) * grid.spaceScale + 0.5) + 1 + 2 * P;
+  grid.levels = (int)(LEVEL_WHITE * grid.rangeScale + 0.5) + 1 + 2 * P;
+
+  const unsigned long CELLS =
+      (unsigned long)grid.rows * grid.cols * grid.levels;
+
+  // Number of pixels in the window of the exact filter
+  const unsigned long SIZE = 2 * (unsigned long)std::ceil(2 * SIGMA_SPACE) + 1;
+  const unsigned long WINDOW = SIZE * SIZE;
+
+  // A fine grid may cost more than the window of the exact filter, and may not
+  // fit in memory
+  if (CELLS > BILATERAL_GRID_MAX_CELLS ||
+      BILATERAL_GRID_CELL_COST * CELLS > WINDOW * (unsigned long)ROWS * COLS) {
+    applyBilateralFilter(SRC, dest, ROWS, COLS, SIGMA_SPACE, SIGMA_RANGE,
+                         executor);
+    return;
+  }
+
+  Buffer<float> sums(CELLS);
+  Buffer<float> weights(CELLS);
+  Buffer<float> blurredSums(CELLS);
+  Buffer<float> blurredWeights(CELLS);
+
+  // Splat every pixel into its nearest cell, by bands of grid rows
+  executor.forEachBand(grid.rows, [&](const int X_BEGIN, const int X_END) {
+    std::fill(&sums.get()[grid.index(X_BEGIN, 0, 0)],
+              &sums.get()[grid.index(X_END, 0, 0)], 0.0f);
+    std::fill(&weights.get()[grid.index(X_BEGIN, 0, 0)],
+              &weights.get()[grid.index(X_END, 0, 0)], 0.0f);
+
+    for (int i = 0; i < ROWS; i++) {
+      const int X = (int)(i * grid.spaceScale + 0.5) + P;
+
+      if (X < X_BEGIN || X >= X_END) {
+        continue;
+      }
+
+      for (int j = 0; j < COLS; j++) {
+        const int PIXEL = SRC[(long)COLS * i + j];
+        const long INDEX =
+            grid.index(X, (int)(j * grid.spaceScale + 0.5) + P,
+                       (int)(PIXEL * grid.rangeScale + 0.5) + P);
+
+        sums.get()[INDEX] += PIXEL;
+        weights.get()[INDEX] += 1;
+      }
+    }
+  });
+
+  // Blur along the grey levels, the columns and then the rows, alternating
+  // between the two pairs of buffers
+  float* from[] = {sums.get(), weights.get()};
+  float* to[] = {blurredSums.get(), blurredWeights.get()};
+
+  for (int axis = 2; axis >= 0; axis--) {
+    executor.forEachBand(grid.rows, [&](const int X_BEGIN, const int X_END) {
+      for (int k = 0; k < 2; k++) {
+        blurBilateralGrid(from[k], to[k], grid, axis, X_BEGIN, X_END);
+      }
+    });
+
+    std::swap(from, to);
+  }
+
+  grid.sums = from[0];
+  grid.weights = from[1];
+
+  // Slice every pixel out of the grid with trilinear interpolation
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    for (int i = ROW_BEGIN; i < ROW_END; i++) {
+      const double X = i * grid.spaceScale + P;
+      const int X0 = X;
+      const float FX = X - X0;
+
+      for (int j = 0; j < COLS; j++) {
+        const int PIXEL = SRC[(long)COLS * i + j];
+        const double Y = j * grid.spaceScale + P;
+        const double Z = PIXEL * grid.rangeScale + P;
+        const int Y0 = Y;
+        const int Z0 = Z;
+        const float FY = Y - Y0;
+        const float FZ = Z - Z0;
+        float sum = 0;
+        float weight = 0;
+
+        for (int c = 0; c < 8; c++) {
+          const int DX = c >> 2;
+          const int DY = (c >> 1) & 1;
+          const int DZ = c & 1;
+          const float W = (DX ? FX : 1 - FX) * (DY ? FY : 1 - FY) *
+                          (DZ ? FZ : 1 - FZ);
+          const long INDEX = grid.index(X0 + DX, Y0 + DY, Z0 + DZ);
+
+          sum += W * grid.sums[INDEX];
+          weight += W * grid.weights[INDEX];
+        }
+
+        // Keep the original pixel if no weight reached it
+        const float OUTPUT = weight > 0 ? sum / weight + 0.5f : PIXEL;
+
+        dest[(long)COLS * i + j] = std::min(OUTPUT, (float)LEVEL_WHITE);
+      }
+    }
+  });
+}
+
 }  // namespace image
@@ -1,6 +1,11 @@
 #ifndef IMAGE_FILTER_H
 #define IMAGE_FILTER_H
 
+#include <functional>
+#include <vector>
+
+#include "../parallel/executor.hpp"
+
 namespace image {
 
 // Mask/filter properties
@@ -8,28 +13,381 @@ const int MASK_SIZE = 3;
 const int MASK_SIZE_HALF = (MASK_SIZE - 1) / 2;
 const double MASK_NULL = -1.0;
 
+// Methods of combining horizontal and vertical derivatives into a magnitude
+enum MagnitudeMode {
+  // sqrt(x^2 + y^2)
+  MAGNITUDE_EXACT,
+  // |x| + |y|
+  MAGNITUDE_L1,
+  // Alpha max plus beta min approximation of sqrt(x^2 + y^2)
+  MAGNITUDE_APPROX
+};
+
+/**
+ * Destination buffers for the outputs of genSobelGradient. Outputs with a null
+ * buffer are not computed.
+ */
+struct SobelGradient {
+  // Signed horizontal derivative (d/dx)
+  short* x = nullptr;
+  // Signed vertical derivative (d/dy)
+  short* y = nullptr;
+  // Gradient magnitude clamped to [0, LEVEL_WHITE]
+  unsigned char* magnitude = nullptr;
+  // Gradient magnitude thresholded to LEVEL_BLACK and LEVEL_WHITE
+  unsigned char* edges = nullptr;
+  // Gradient direction, angle in [-pi, pi) mapped to [0, LEVELS)
+  unsigned char* direction = nullptr;
+};
+
+// Largest median filter radius handled by the sorting network fast path
+const int MEDIAN_NETWORK_MAX_RADIUS = 2;
+
+// Filters that can be applied to a stream of rows by a StreamFilter
+enum StreamOperation {
+  STREAM_LINEAR,
+  STREAM_MEDIAN,
+  STREAM_GRADIENT,
+  STREAM_LAPLACE_SHARPENING
+};
+
+/**
+ * Applies a filter to an image that arrives one row at a time, from top to
+ * bottom, keeping only the rows under the filter window in memory. Each output
+ * row is passed to the sink as soon as the rows it depends on have arrived, and
+ * is the same as the respective row of the whole-image filter.
+ */
+class StreamFilter {
+ public:
+  // Receives the index of an output row and its pixels, which are only valid
+  // until the sink returns
+  typedef std::function<void(int, const unsigned char*)> RowSink;
+
+  static StreamFilter genLinearFilter(const int COLS,
+                                      const double MASK[MASK_SIZE][MASK_SIZE],
+                                      const RowSink& SINK);
+
+  static StreamFilter genMedianFilter(const int COLS,
+                                      const int RADIUS,
+                                      const RowSink& SINK);
+
+  static StreamFilter genGradient(const int COLS, const RowSink& SINK);
+
+  static StreamFilter genLaplaceSharpening(const int COLS,
+                                           const double WEIGHT,
+                                           const RowSink& SINK);
+
+  void pushRow(const unsigned char* ROW);
+
+  void finish();
+
+ private:
+  StreamFilter(const StreamOperation OPERATION,
+               const int COLS,
+               const int RADIUS,
+               const RowSink& SINK);
+
+  void dropHistogramRows(const int FIRST);
+
+  void emitRow();
+
+  StreamOperation operation;
+  int cols;
+  // Number of rows above and below an output row that it depends on
+  int radius;
+  double mask[MASK_SIZE][MASK_SIZE];
+  double weight;
+  RowSink sink;
+  // Last 2 * radius + 1 rows, each stored twice so that the rows of a window
+  // are always contiguous
+  std::vector<unsigned char> window;
+  // Scratch rows for the Laplacian and the filtered window
+  std::vector<short> laplacian;
+  std::vector<unsigned char> output;
+  // Coarse and fine column histograms of the rows of the window, for a median
+  // filter too large for the sorting network
+  std::vector<unsigned short> colCoarse;
+  std::vector<unsigned short> colFine;
+  // First row counted in the column histograms
+  int histogramRow;
+  int rowsIn;
+  int rowsOut;
+  bool finished;
+};
+
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS);
+
 void applyLinearFilter(const unsigned char* SRC,
                        const double MASK[MASK_SIZE][MASK_SIZE],
                        unsigned char* dest,
                        const int ROWS,
+                       const int COLS,
+                       parallel::Executor& executor);
+
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       short* dest,
+                       const int ROWS,
+                       const int COLS);
+
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       short* dest,
+                       const int ROWS,
+                       const int COLS,
+                       parallel::Executor& executor);
+
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       int* dest,
+                       const int ROWS,
+                       const int COLS);
+
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       int* dest,
+                       const int ROWS,
+                       const int COLS,
+                       parallel::Executor& executor);
+
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       float* dest,
+                       const int ROWS,
                        const int COLS);
 
+void applyLinearFilter(const unsigned char* SRC,
+                       const double MASK[MASK_SIZE][MASK_SIZE],
+                       float* dest,
+                       const int ROWS,
+                       const int COLS,
+                       parallel::Executor& executor);
+
 void applyMedianFilter(const unsigned char* SRC,
                        unsigned char* dest,
                        const int ROWS,
                        const int COLS);
 
+void applyMedianFilter(const unsigned char* SRC,
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       parallel::Executor& executor);
+
+void applyMedianFilter(const unsigned char* SRC,
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const int RADIUS);
+
+void applyMedianFilter(const unsigned char* SRC,
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const int RADIUS,
+                       parallel::Executor& executor);
+
+void genGradient(const unsigned char* SRC,
+                 unsigned char* dest,
+                 const int ROWS,
+                 const int COLS);
+
 void genGradient(const unsigned char* SRC,
                  unsigned char* dest,
                  const int ROWS,
+                 const int COLS,
+                 parallel::Executor& executor);
+
+void genGradient(const unsigned char* SRC,
+                 float* dest,
+                 const int ROWS,
                  const int COLS);
 
+void genGradient(const unsigned char* SRC,
+                 float* dest,
+                 const int ROWS,
+                 const int COLS,
+                 parallel::Executor& executor);
+
+void genSobelGradient(const unsigned char* SRC,
+                      const SobelGradient& dest,
+                      const int ROWS,
+                      const int COLS,
+                      const MagnitudeMode MODE,
+                      const unsigned char THRESHOLD);
+
+void genSobelGradient(const unsigned char* SRC,
+                      const SobelGradient& dest,
+                      const int ROWS,
+                      const int COLS,
+                      const MagnitudeMode MODE,
+                      const unsigned char THRESHOLD,
+                      parallel::Executor& executor);
+
+void genGradientMagnitude(const short* X,
+                          const short* Y,
+                          unsigned char* dest,
+                          const int ROWS,
+                          const int COLS,
+                          const MagnitudeMode MODE);
+
+void genGradientMagnitude(const short* X,
+                          const short* Y,
+                          unsigned char* dest,
+                          const int ROWS,
+                          const int COLS,
+                          const MagnitudeMode MODE,
+                          parallel::Executor& executor);
+
+void genLaplacian(const unsigned char* SRC,
+                  short* dest,
+                  const int ROWS,
+                  const int COLS);
+
+void genLaplacian(const unsigned char* SRC,
+                  short* dest,
+                  const int ROWS,
+                  const int COLS,
+                  parallel::Executor& executor);
+
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            const short* LAPLACIAN,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS);
+
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            const short* LAPLACIAN,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS,
+                            parallel::Executor& executor);
+
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS);
+
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS,
+                            parallel::Executor& executor);
+
 void applyLaplaceSharpening(const unsigned char* SRC,
                             unsigned char* dest,
                             const int ROWS,
                             const int COLS,
                             const double WEIGHT);
 
+void applyLaplaceSharpening(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const double WEIGHT,
+                            parallel::Executor& executor);
+
+void applyGaussianFilter(const unsigned char* SRC,
+                         unsigned char* dest,
+                         const int ROWS,
+                         const int COLS,
+                         const double SIGMA);
+
+void applyGaussianFilter(const unsigned char* SRC,
+                         unsigned char* dest,
+                         const int ROWS,
+                         const int COLS,
+                         const double SIGMA,
+                         parallel::Executor& executor);
+
+void applyGaussianFilter(const unsigned char* SRC,
+                         float* dest,
+                         const int ROWS,
+                         const int COLS,
+                         const double SIGMA);
+
+void applyGaussianFilter(const unsigned char* SRC,
+                         float* dest,
+                         const int ROWS,
+                         const int COLS,
+                         const double SIGMA,
+                         parallel::Executor& executor);
+
+void genClampedImage(const short* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS);
+
+void genClampedImage(const short* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS,
+                     parallel::Executor& executor);
+
+void genClampedImage(const int* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS);
+
+void genClampedImage(const int* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS,
+                     parallel::Executor& executor);
+
+void genClampedImage(const float* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS);
+
+void genClampedImage(const float* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS,
+                     parallel::Executor& executor);
+
+void applyBilateralFilter(const unsigned char* SRC,
+                          unsigned char* dest,
+                          const int ROWS,
+                          const int COLS,
+                          const double SIGMA_SPACE,
+                          const double SIGMA_RANGE);
+
+void applyBilateralFilter(const unsigned char* SRC,
+                          unsigned char* dest,
+                          const int ROWS,
+                          const int COLS,
+                          const double SIGMA_SPACE,
+                          const double SIGMA_RANGE,
+                          parallel::Executor& executor);
+
+void applyBilateralGridFilter(const unsigned char* SRC,
+                              unsigned char* dest,
+                              const int ROWS,
+                              const int COLS,
+                              const double SIGMA_SPACE,
+                              const double SIGMA_RANGE);
+
+void applyBilateralGridFilter(const unsigned char* SRC,
+                              unsigned char* dest,
+                              const int ROWS,
+                              const int COLS,
+                              const double SIGMA_SPACE,
+                              const double SIGMA_RANGE,
+                              parallel::Executor& executor);
+
 }  // namespace image
 
 #endif  // IMAGE_FILTER_H
@@ -0,0 +1,363 @@
+#include "guided.hpp"
+
+#include <algorithm>
+
+#include "buffer.hpp"
+#include "image.hpp"
+
+namespace image {
+
+/**
+ * Computes the integral image of the values given by VALUE(i, j) for every
+ * pixel of an image. The integral image has ROWS + 1 rows and COLS + 1 columns,
+ * with entry (i, j) holding the sum of the values of the pixels above and to
+ * the left of pixel (i, j). Rows are summed in parallel bands of rows, and then
+ * columns in parallel bands of columns.
+ *
+ * @param integral Destination buffer for the integral image
+ * @param ROWS     Number of rows in image
+ * @param COLS     Number of columns in image
+ * @param VALUE    Value of each pixel
+ * @param executor Executor that runs the bands
+ */
+template <class T, class F>
+static void genIntegralImage(T* integral,
+                             const int ROWS,
+                             const int COLS,
+                             const F& VALUE,
+                             parallel::Executor& executor) {
+  const long STRIDE = COLS + 1;
+
+  std::fill(integral, integral + STRIDE, 0);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    for (int i = ROW_BEGIN; i < ROW_END; i++) {
+      T* row = &integral[STRIDE * (i + 1)];
+      T sum = 0;
+
+      row[0] = 0;
+
+      for (int j = 0; j < COLS; j++) {
+        sum += VALUE(i, j);
+        row[j + 1] = sum;
+      }
+    }
+  });
+
+  executor.forEachBand(COLS, [&](const int COL_BEGIN, const int COL_END) {
+    for (int i = 1; i <= ROWS; i++) {
+      const T* ABOVE = &integral[STRIDE * (i - 1)];
+      T* row = &integral[STRIDE * i];
+
+      for (int j = COL_BEGIN + 1; j <= COL_END; j++) {
+        row[j] += ABOVE[j];
+      }
+    }
+  });
+}
+
+/**
+ * Window of radius RADIUS around a pixel, clipped to the image, used to look
+ * up box sums in an integral image.
+ */
+struct BoxWindow {
+  long topLeft;
+  long topRight;
+  long bottomLeft;
+  long bottomRight;
+  int count;
+
+  BoxWindow(const int ROW,
+            const int COL,
+            const int ROWS,
+            const int COLS,
+            const int RADIUS) {
+    const long STRIDE = COLS + 1;
+    const int TOP = std::max(ROW - RADIUS, 0);
+    const int BOTTOM = std::min(ROW + RADIUS + 1, ROWS);
+    const int LEFT = std::max(COL - RADIUS, 0);
+    const int RIGHT = std::min(COL + RADIUS + 1, COLS);
+
+    topLeft = STRIDE * TOP + LEFT;
+    topRight = STRIDE * TOP + RIGHT;
+    bottomLeft = STRIDE * BOTTOM + LEFT;
+    bottomRight = STRIDE * BOTTOM + RIGHT;
+    count = (BOTTOM - TOP) * (RIGHT - LEFT);
+  }
+
+  template <class T>
+  T sum(const T* INTEGRAL) const {
+    return INTEGRAL[bottomRight] - INTEGRAL[bottomLeft] - INTEGRAL[topRight] +
+           INTEGRAL[topLeft];
+  }
+};
+
+/**
+ * Computes the output of the guided filter, before rounding, into the given
+ * buffer. Every mean over a window is a box sum of an integral image, so the
+ * cost per pixel does not depend on the radius.
+ *
+ * @param GUIDE    Buffer containing guide image
+ * @param SRC      Buffer containing image to filter
+ * @param dest     Destination buffer for the filtered values
+ * @param ROWS     Number of rows in images
+ * @param COLS     Number of columns in images
+ * @param RADIUS   Radius of the window
+ * @param EPSILON  Regularization of the local linear models
+ * @param executor Executor that runs the bands
+ */
+static void genGuidedFilter(const unsigned char* GUIDE,
+                            const unsigned char* SRC,
+                            float* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const int RADIUS,
+                            const double EPSILON,
+                            parallel::Executor& executor) {
+  const unsigned long INTEGRAL_SIZE = (unsigned long)(ROWS + 1) * (COLS + 1);
+  const unsigned long SIZE = (unsigned long)ROWS * COLS;
+
+  // Integral images of I, p, I * I and I * p are exact in 64-bit integers
+  Buffer<long long> sumI(INTEGRAL_SIZE);
+  Buffer<long long> sumP(INTEGRAL_SIZE);
+  Buffer<long long> sumII(INTEGRAL_SIZE);
+  Buffer<long long> sumIP(INTEGRAL_SIZE);
+
+  auto pixelI = [&](const int I, const int J) {
+    return (long long)GUIDE[(long)COLS * I + J];
+  };
+  auto pixelP = [&](const int I, const int J) {
+    return (long long)SRC[(long)COLS * I + J];
+  };
+
+  genIntegralImage(sumI.get(), ROWS, COLS, pixelI, executor);
+  genIntegralImage(sumP.get(), ROWS, COLS, pixelP, executor);
+  genIntegralImage(sumII.get(), ROWS, COLS,
+                   [&](const int I, const int J) {
+                     return pixelI(I, J) * pixelI(I, J);
+                   },
+                   executor);
+  genIntegralImage(sumIP.get(), ROWS, COLS,
+                   [&](const int I, const int J) {
+                     return pixelI(I, J) * pixelP(I, J);
+                   },
+                   executor);
+
+  // Coefficients of the linear model q = a * I + b of every window
+  Buffer<double> a(SIZE);
+  Buffer<double> b(SIZE);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    for (int i = ROW_BEGIN; i < ROW_END; i++) {
+      for (int j = 0; j < COLS; j++) {
+        const BoxWindow WINDOW(i, j, ROWS, COLS, RADIUS);
+        const double N = WINDOW.count;
+        const double MEAN_I = WINDOW.sum(sumI.get()) / N;
+        const double MEAN_P = WINDOW.sum(sumP.get()) / N;
+        const double VARIANCE = WINDOW.sum(sumII.get()) / N - MEAN_I * MEAN_I;
+        const double COVARIANCE =
+            WINDOW.sum(sumIP.get()) / N - MEAN_I * MEAN_P;
+        const double A = COVARIANCE / (VARIANCE + EPSILON);
+
+        a.get()[(long)COLS * i + j] = A;
+        b.get()[(long)COLS * i + j] = MEAN_P - A * MEAN_I;
+      }
+    }
+  });
+
+  // Average the models of all windows that cover each pixel
+  Buffer<double> sumA(INTEGRAL_SIZE);
+  Buffer<double> sumB(INTEGRAL_SIZE);
+
+  genIntegralImage(sumA.get(), ROWS, COLS,
+                   [&](const int I, const int J) {
+                     return a.get()[(long)COLS * I + J];
+                   },
+                   executor);
+  genIntegralImage(sumB.get(), ROWS, COLS,
+                   [&](const int I, const int J) {
+                     return b.get()[(long)COLS * I + J];
+                   },
+                   executor);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    for (int i = ROW_BEGIN; i < ROW_END; i++) {
+      for (int j = 0; j < COLS; j++) {
+        const BoxWindow WINDOW(i, j, ROWS, COLS, RADIUS);
+
+        dest[(long)COLS * i + j] = (WINDOW.sum(sumA.get()) * pixelI(i, j) +
+                                    WINDOW.sum(sumB.get())) /
+                                   WINDOW.count;
+      }
+    }
+  });
+}
+
+/**
+ * Returns the given value rounded and clamped to [0, LEVEL_WHITE].
+ *
+ * @param VALUE Value to convert
+ * @returns     Grey level
+ */
+static unsigned char toGreyLevel(const double VALUE) {
+  const double ROUNDED = VALUE + 0.5;
+
+  return ROUNDED < 0 ? 0 : ROUNDED > LEVEL_WHITE ? LEVEL_WHITE : (int)ROUNDED;
+}
+
+/**
+ * Produces a new image by smoothing the given image with the guided filter of
+ * He et al., using a grayscale guide image, and outputs the result to the
+ * destination buffer. Within every window of (2 * RADIUS + 1) x
+ * (2 * RADIUS + 1) pixels, the output is modelled as a linear function of the
+ * guide, so edges of the guide are preserved. With the image itself as the
+ * guide, this is an edge-preserving smoothing filter. Windows are clipped at
+ * the border of the image.
+ *
+ * The filter is computed with a fixed number of box filters over integral
+ * images, so the cost per pixel does not depend on the radius.
+ *
+ * @param GUIDE   Buffer containing guide image
+ * @param SRC     Buffer containing original image
+ * @param dest    Destination buffer for filtered image
+ * @param ROWS    Number of rows in original image
+ * @param COLS    Number of columns in original image
+ * @param RADIUS  Radius of the window
+ * @param EPSILON Regularization in squared grey levels, edges with a variance
+ *                well above it are preserved
+ */
+void applyGuidedFilter(const unsigned char* GUIDE,
+                       const unsigned char* SRC,
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const int RADIUS,
+                       const double EPSILON) {
+  parallel::Executor serial(1);
+
+  applyGuidedFilter(GUIDE, SRC, dest, ROWS, COLS, RADIUS, EPSILON, serial);
+}
+
+/**
+ * Produces the same image as applyGuidedFilter, splitting every pass into
+ * bands that are processed in parallel by the given executor.
+ *
+ * @param GUIDE    Buffer containing guide image
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param RADIUS   Radius of the window
+ * @param EPSILON  Regularization in squared grey levels
+ * @param executor Executor that runs the bands
+ */
+void applyGuidedFilter(const unsigned char* GUIDE,
+                       const unsigned char* SRC,
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const int RADIUS,
+                       const double EPSILON,
+                       parallel::Executor& executor) {
+  // Ensure that the window and regularization are valid
+  if (RADIUS < 0 || EPSILON <= 0) {
+    throw "ERROR: Guided filter needs RADIUS >= 0 and EPSILON > 0!";
+  }
+
+  if (ROWS <= 0 || COLS <= 0) {
+    return;
+  }
+
+  Buffer<float> filtered((unsigned long)ROWS * COLS);
+
+  genGuidedFilter(GUIDE, SRC, filtered.get(), ROWS, COLS, RADIUS, EPSILON,
+                  executor);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    for (long i = (long)COLS * ROW_BEGIN; i < (long)COLS * ROW_END; i++) {
+      dest[i] = toGreyLevel(filtered.get()[i]);
+    }
+  });
+}
+
+/**
+ * Produces detail-enhanced images for each of the given weights, sharing one
+ * self-guided filter of the original image. The guided filter gives an
+ * edge-preserving base layer q, and each output follows the formula:
+ *
+ *   I' = I + w * (I - q)
+ *
+ * Where I is the original image and w is the weight. Unlike Laplace
+ * sharpening, strong edges are not boosted into halos.
+ *
+ * @param SRC     Buffer containing original image
+ * @param dest    Destination buffers for the enhanced images, one per weight
+ * @param WEIGHTS Weights w of the detail layer
+ * @param COUNT   Number of weights and destination buffers
+ * @param ROWS    Number of rows in original image
+ * @param COLS    Number of columns in original image
+ * @param RADIUS  Radius of the window
+ * @param EPSILON Regularization in squared grey levels
+ */
+void applyDetailEnhancement(const unsigned char* SRC,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS,
+                            const int RADIUS,
+                            const double EPSILON) {
+  parallel::Executor serial(1);
+
+  applyDetailEnhancement(SRC, dest, WEIGHTS, COUNT, ROWS, COLS, RADIUS, EPSILON,
+                         serial);
+}
+
+/**
+ * Produces the same images as applyDetailEnhancement, splitting every pass
+ * into bands that are processed in parallel by the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffers for the enhanced images, one per weight
+ * @param WEIGHTS  Weights w of the detail layer
+ * @param COUNT    Number of weights and destination buffers
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param RADIUS   Radius of the window
+ * @param EPSILON  Regularization in squared grey levels
+ * @param executor Executor that runs the bands
+ */
+void applyDetailEnhancement(const unsigned char* SRC,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS,
+                            const int RADIUS,
+                            const double EPSILON,
+                            parallel::Executor& executor) {
+  // Ensure that the window and regularization are valid
+  if (RADIUS < 0 || EPSILON <= 0) {
+    throw "ERROR: Guided filter needs RADIUS >= 0 and EPSILON > 0!";
+  }
+
+  if (ROWS <= 0 || COLS <= 0) {
+    return;
+  }
+
+  Buffer<float> base((unsigned long)ROWS * COLS);
+
+  genGuidedFilter(SRC, SRC, base.get(), ROWS, COLS, RADIUS, EPSILON, executor);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    for (long i = (long)COLS * ROW_BEGIN; i < (long)COLS * ROW_END; i++) {
+      const double DETAIL = SRC[i] - base.get()[i];
+
+      for (int w = 0; w < COUNT; w++) {
+        dest[w][i] = toGreyLevel(SRC[i] + WEIGHTS[w] * DETAIL);
+      }
+    }
+  });
+}
+
+}  // namespace image
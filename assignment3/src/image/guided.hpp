@@ -0,0 +1,46 @@
+#ifndef IMAGE_GUIDED_H
+#define IMAGE_GUIDED_H
+
+#include "../parallel/executor.hpp"
+
+namespace image {
+
+void applyGuidedFilter(const unsigned char* GUIDE,
+                       const unsigned char* SRC,
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const int RADIUS,
+                       const double EPSILON);
+
+void applyGuidedFilter(const unsigned char* GUIDE,
+                       const unsigned char* SRC,
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const int RADIUS,
+                       const double EPSILON,
+                       parallel::Executor& executor);
+
+void applyDetailEnhancement(const unsigned char* SRC,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS,
+                            const int RADIUS,
+                            const double EPSILON);
+
+void applyDetailEnhancement(const unsigned char* SRC,
+                            unsigned char* const dest[],
+                            const double WEIGHTS[],
+                            const int COUNT,
+                            const int ROWS,
+                            const int COLS,
+                            const int RADIUS,
+                            const double EPSILON,
+                            parallel::Executor& executor);
+
+}  // namespace image
+
+#endif  // IMAGE_GUIDED_H
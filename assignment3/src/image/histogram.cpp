@@ -1,9 +1,109 @@
 #include "histogram.hpp"
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+#include "buffer.hpp"
 #include "image.hpp"
+#include "pointop.hpp"
 
 namespace image {
 
+// Number of fractional bits of the interpolation weights of adaptive
+// equalization
+const int ADAPTIVE_WEIGHT_BITS = 7;
+const int ADAPTIVE_WEIGHT_ONE = 1 << ADAPTIVE_WEIGHT_BITS;
+
+// Number of interleaved sub-histograms, consecutive pixels are counted in
+// different sub-histograms so that runs of equal pixels do not wait on each
+// other's increments of the same bin
+const int HISTOGRAM_LANES = 4;
+// Number of pixels counted per iteration of the unrolled loop
+const int HISTOGRAM_UNROLL = 16;
+// Number of contiguous pixels that a streaming equalizer counts and maps at a
+// time, small enough that the run is still in cache when it is mapped
+const long STREAMING_RUN = 16384;
+
+/**
+ * Counts the grey level frequencies of the given pixels into the given
+ * sub-histograms without clearing them first, so that a caller can count many
+ * runs of pixels before merging once. Pixels are loaded 8 at a time and
+ * counted in HISTOGRAM_LANES interleaved sub-histograms.
+ *
+ * @param SRC   Buffer containing pixels
+ * @param lanes Sub-histograms to add the frequencies to
+ * @param COUNT Number of pixels
+ */
+static void accumulateHistogram(const unsigned char* SRC,
+                                unsigned int lanes[HISTOGRAM_LANES][LEVELS],
+                                const long COUNT) {
+  long i = 0;
+
+  for (; i + HISTOGRAM_UNROLL <= COUNT; i += HISTOGRAM_UNROLL) {
+    std::uint64_t low;
+    std::uint64_t high;
+
+    std::memcpy(&low, &SRC[i], sizeof(low));
+    std::memcpy(&high, &SRC[i + 8], sizeof(high));
+
+    for (int k = 0; k < 8; k += HISTOGRAM_LANES) {
+      lanes[0][(low >> (8 * k)) & 0xFF]++;
+      lanes[1][(low >> (8 * k + 8)) & 0xFF]++;
+      lanes[2][(low >> (8 * k + 16)) & 0xFF]++;
+      lanes[3][(low >> (8 * k + 24)) & 0xFF]++;
+      lanes[0][(high >> (8 * k)) & 0xFF]++;
+      lanes[1][(high >> (8 * k + 8)) & 0xFF]++;
+      lanes[2][(high >> (8 * k + 16)) & 0xFF]++;
+      lanes[3][(high >> (8 * k + 24)) & 0xFF]++;
+    }
+  }
+
+  // Count the remaining pixels
+  for (; i < COUNT; i++) {
+    lanes[i % HISTOGRAM_LANES][SRC[i]]++;
+  }
+}
+
+/**
+ * Adds the sub-histograms filled by accumulateHistogram to the destination
+ * histogram.
+ *
+ * @param LANES Sub-histograms to merge
+ * @param dest  Histogram to add the frequencies to
+ */
+static void mergeHistogram(const unsigned int LANES[HISTOGRAM_LANES][LEVELS],
+                           int dest[]) {
+  for (int level = 0; level < LEVELS; level++) {
+    dest[level] += LANES[0][level] + LANES[1][level] + LANES[2][level] +
+                   LANES[3][level];
+  }
+}
+
+/**
+ * Adds the grey level frequencies of the given pixels to the destination
+ * histogram.
+ *
+ * @param SRC   Buffer containing pixels
+ * @param dest  Histogram to add the frequencies to
+ * @param COUNT Number of pixels
+ */
+static void countHistogram(const unsigned char* SRC,
+                           int dest[],
+                           const long COUNT) {
+  unsigned int lanes[HISTOGRAM_LANES][LEVELS] = {};
+
+  accumulateHistogram(SRC, lanes, COUNT);
+  mergeHistogram(lanes, dest);
+}
+
 /**
  * Produces a histogram of the given image buffer into the destination buffer.
  * The histogram is a single-dimensional array of size LEVELS where the value
@@ -19,18 +119,45 @@ void genHistogram(const unsigned char* SRC,
                   const int ROWS,
                   const int COLS) {
   // Initialize histogram buffer
-  for (int i = 0; i < LEVELS; i++) {
-    dest[i] = 0;
-  }
+  std::fill(dest, dest + LEVELS, 0);
 
-  // Iterate through source image buffer and count grey level frequencies
-  for (int i = 0; i < ROWS * COLS; i++) {
-    // Temporarily store value of current character (pixel)
-    unsigned char character = SRC[i];
+  // Count grey level frequencies in a single pass
+  countHistogram(SRC, dest, (long)ROWS * COLS);
+}
 
-    // Increment frequency of this character in counts buffer
-    dest[character]++;
-  }
+/**
+ * Produces the same histogram as genHistogram, counting bands of rows in
+ * parallel with the given executor. Each band counts into its own histogram,
+ * and the histograms of all bands are summed as they finish.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for histogram
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that counts the bands
+ */
+void genHistogram(const unsigned char* SRC,
+                  int dest[],
+                  const int ROWS,
+                  const int COLS,
+                  parallel::Executor& executor) {
+  std::mutex mutex;
+
+  // Initialize histogram buffer
+  std::fill(dest, dest + LEVELS, 0);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    int bandHistogram[LEVELS] = {};
+
+    countHistogram(&SRC[(long)COLS * ROW_BEGIN], bandHistogram,
+                   (long)COLS * (ROW_END - ROW_BEGIN));
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    for (int i = 0; i < LEVELS; i++) {
+      dest[i] += bandHistogram[i];
+    }
+  });
 }
 
 /**
@@ -75,6 +202,73 @@ void genNormalizedHistogram(const int SRC[], int dest[], const double FACTOR) {
   }
 }
 
+/**
+ * Renders a plot of the given histogram of size LEVELS into a region of
+ * ROWS x COLS pixels of the destination buffer. Each column shows the highest
+ * frequency of the levels it covers as a bar rising from the bottom row, and
+ * the highest bar reaches the top row. Bars only ever widen from one row to
+ * the next one down, so each row is a copy of the row above it with the
+ * columns of the bars that start in that row set, and the plot is written
+ * with one block copy per row instead of a comparison per pixel.
+ *
+ * @param SRC       Buffer containing histogram
+ * @param dest      Destination buffer for the top left pixel of the plot
+ * @param STRIDE    Number of pixels between the starts of rows of dest
+ * @param ROWS      Number of rows of the plot
+ * @param COLS      Number of columns of the plot
+ * @param LOG_SCALE Whether bar heights are proportional to log(1 + frequency)
+ *                  instead of the frequency
+ */
+static void renderHistogram(const int SRC[],
+                            unsigned char* dest,
+                            const long STRIDE,
+                            const int ROWS,
+                            const int COLS,
+                            const bool LOG_SCALE) {
+  const int MAX_COUNT = *std::max_element(SRC, SRC + LEVELS);
+  // Columns of the plot, ordered by the row at which their bar starts
+  std::vector<std::pair<int, int>> bars;
+
+  for (int j = 0; j < COLS; j++) {
+    const int BEGIN = (int)((long)LEVELS * j / COLS);
+    const int END = std::max((int)((long)LEVELS * (j + 1) / COLS), BEGIN + 1);
+    const int COUNT = *std::max_element(&SRC[BEGIN], &SRC[END]);
+
+    if (COUNT == 0) {
+      continue;
+    }
+
+    // Scale the frequency from [0, MAX_COUNT] to [0, ROWS - 1], bars of
+    // height 0 are not drawn
+    const int HEIGHT =
+        LOG_SCALE ? (int)(std::log1p((double)COUNT) / std::log1p(MAX_COUNT) *
+                          (ROWS - 1))
+                  : (int)(COUNT * ((double)(ROWS - 1) / MAX_COUNT));
+
+    if (HEIGHT != 0) {
+      bars.push_back({ROWS - 1 - HEIGHT, j});
+    }
+  }
+
+  std::sort(bars.begin(), bars.end());
+
+  auto bar = bars.begin();
+
+  for (int i = 0; i < ROWS; i++) {
+    unsigned char* row = &dest[STRIDE * i];
+
+    if (i == 0) {
+      std::memset(row, LEVEL_WHITE, COLS);
+    } else {
+      std::memcpy(row, row - STRIDE, COLS);
+    }
+
+    for (; bar != bars.end() && bar->first == i; bar++) {
+      row[bar->second] = LEVEL_BLACK;
+    }
+  }
+}
+
 /**
  * Produces a new image buffer from a given histogram of size LEVELS.
  * The destination buffer must have the dimensions LEVELS x LEVELS. The
@@ -86,59 +280,113 @@ void genNormalizedHistogram(const int SRC[], int dest[], const double FACTOR) {
  * @param dest Destination buffer for histogram image
  */
 void genHistogramImage(const int SRC[], unsigned char* dest) {
-  // Scaled histogram buffer
-  int scaledSrc[LEVELS];
-  // Cursor for destination image buffer
-  unsigned char* ptrDest = dest;
-  // Track maximum frequency
-  int maxCount = 0;
-
-  // Iterate through the histogram buffer to find the maximum value
-  for (int i = 0; i < LEVELS; i++) {
-    // Get the count at this level
-    int count = SRC[i];
+  renderHistogram(SRC, dest, LEVELS, LEVELS, LEVELS, false);
+}
 
-    if (count > maxCount) {
-      maxCount = count;
-    }
-  }
+/**
+ * Produces a new image buffer of the given size from a given histogram of size
+ * LEVELS, as genHistogramImage does for LEVELS x LEVELS images. Plots narrower
+ * than LEVELS show the highest frequency of the levels under each column, and
+ * plots wider than LEVELS repeat columns.
+ *
+ * @param SRC       Buffer containing histogram
+ * @param dest      Destination buffer for histogram image
+ * @param ROWS      Number of rows of the histogram image
+ * @param COLS      Number of columns of the histogram image
+ * @param LOG_SCALE Whether bar heights are proportional to log(1 + frequency)
+ *                  instead of the frequency
+ */
+void genHistogramImage(const int SRC[],
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const bool LOG_SCALE) {
+  renderHistogram(SRC, dest, COLS, ROWS, COLS, LOG_SCALE);
+}
 
-  // Normalize the histogram buffer from range [0, maxCount] to [0, 255]
-  genNormalizedHistogram(SRC, &scaledSrc[0], (double)(LEVELS - 1) / maxCount);
+/**
+ * Produces a contact sheet of plots of the given histograms, such as the
+ * histograms of every image of a dataset. Plots of PLOT_ROWS x PLOT_COLS pixels
+ * are laid out in row major order, SHEET_COLS plots per row, and cells of the
+ * last row without a plot are left blank. The destination buffer must have
+ * ceil(COUNT / SHEET_COLS) * PLOT_ROWS rows and SHEET_COLS * PLOT_COLS
+ * columns.
+ *
+ * @param HISTOGRAMS Buffers containing histograms of size LEVELS
+ * @param COUNT      Number of histograms
+ * @param dest       Destination buffer for contact sheet
+ * @param SHEET_COLS Number of plots per row of the sheet
+ * @param PLOT_ROWS  Number of rows of each plot
+ * @param PLOT_COLS  Number of columns of each plot
+ * @param LOG_SCALE  Whether bar heights are proportional to log(1 + frequency)
+ *                   instead of the frequency
+ */
+void genHistogramSheet(const int* const HISTOGRAMS[],
+                       const int COUNT,
+                       unsigned char* dest,
+                       const int SHEET_COLS,
+                       const int PLOT_ROWS,
+                       const int PLOT_COLS,
+                       const bool LOG_SCALE) {
+  parallel::Executor serial(1);
 
-  // Current row and column in destination image
-  int row = 0;
-  int col = 0;
+  genHistogramSheet(HISTOGRAMS, COUNT, dest, SHEET_COLS, PLOT_ROWS, PLOT_COLS,
+                    LOG_SCALE, serial);
+}
 
-  // Convert character counts to histogram in destination image buffer
-  for (int i = 0; i < LEVELS * LEVELS; i++) {
-    // Use foreground colour if count for current column is equal to or higher
-    // than current row value. Otherwise, use background colour.
-    if (scaledSrc[col] != 0 && scaledSrc[col] >= (LEVELS - 1 - row)) {
-      *ptrDest = LEVEL_BLACK;
-    } else {
-      *ptrDest = LEVEL_WHITE;
-    }
+/**
+ * Produces the same contact sheet as genHistogramSheet, rendering bands of
+ * plots in parallel with the given executor.
+ *
+ * @param HISTOGRAMS Buffers containing histograms of size LEVELS
+ * @param COUNT      Number of histograms
+ * @param dest       Destination buffer for contact sheet
+ * @param SHEET_COLS Number of plots per row of the sheet
+ * @param PLOT_ROWS  Number of rows of each plot
+ * @param PLOT_COLS  Number of columns of each plot
+ * @param LOG_SCALE  Whether bar heights are proportional to log(1 + frequency)
+ *                   instead of the frequency
+ * @param executor   Executor that renders the bands
+ */
+void genHistogramSheet(const int* const HISTOGRAMS[],
+                       const int COUNT,
+                       unsigned char* dest,
+                       const int SHEET_COLS,
+                       const int PLOT_ROWS,
+                       const int PLOT_COLS,
+                       const bool LOG_SCALE,
+                       parallel::Executor& executor) {
+  // Ensure that the sheet has a valid layout
+  if (SHEET_COLS <= 0 || PLOT_ROWS <= 0 || PLOT_COLS <= 0) {
+    throw "ERROR: Contact sheet needs a positive layout!";
+  }
+
+  const int SHEET_ROWS = (COUNT + SHEET_COLS - 1) / SHEET_COLS;
+  const long STRIDE = (long)SHEET_COLS * PLOT_COLS;
 
-    // Increment destination image buffer cursor
-    ptrDest++;
+  executor.forEachBand(SHEET_ROWS * SHEET_COLS, [&](const int CELL_BEGIN,
+                                                    const int CELL_END) {
+    for (int cell = CELL_BEGIN; cell < CELL_END; cell++) {
+      unsigned char* plot = &dest[STRIDE * PLOT_ROWS * (cell / SHEET_COLS) +
+                                  (long)PLOT_COLS * (cell % SHEET_COLS)];
 
-    // Increment column in destination image
-    col++;
+      if (cell < COUNT) {
+        renderHistogram(HISTOGRAMS[cell], plot, STRIDE, PLOT_ROWS, PLOT_COLS,
+                        LOG_SCALE);
+        continue;
+      }
 
-    // Increment row if reached end of current row
-    if (col >= LEVELS) {
-      row++;
-      col = 0;
+      for (int i = 0; i < PLOT_ROWS; i++) {
+        std::memset(&plot[STRIDE * i], LEVEL_WHITE, PLOT_COLS);
+      }
     }
-  }
+  });
 }
 
 /**
- * Produces a new image by equalizing the histogram at the source buffer to the
- * Equalizes a discrete histogram at the source buffer to the destination
- * buffer. The histogram is a single-dimensional array of size LEVELS where the
- * value at each level is the frequency of pixels of that level.
+ * Produces a new image by equalizing the histogram of the source image into
+ * the destination buffer. Each pixel is mapped to the cumulative frequency of
+ * its level, scaled by S = (K - 1) / (M * N).
  *
  * @param SRC  Buffer containing original image
  * @param dest Destination buffer for image with equalized histogram
@@ -151,29 +399,767 @@ void genEqualizedHistogramImage(const unsigned char* SRC,
                                 const int COLS) {
   // Buffer for holding histogram
   int h[LEVELS];
-  // Buffer for holding cumulative histogram
-  int H[LEVELS];
-
-  // Scaling factor is defined as S = (K - 1) / (M * N)
-  double S = (double)(LEVELS - 1) / (ROWS * COLS);
 
   // Computer histogram for original image
   genHistogram(SRC, &h[0], ROWS, COLS);
 
-  // Compute cumulative histogram from the given histogram
-  genCumulativeHistogram(&h[0], &H[0]);
+  // Map each pixel to its scaled cumulative frequency
+  PointOp::genEqualization(&h[0]).apply(SRC, dest, ROWS, COLS);
+}
 
-  // Normalize cumulative histogram with scaling factor
-  genNormalizedHistogram(&H[0], &H[0], S);
+/**
+ * Produces the same image as genEqualizedHistogramImage, counting the
+ * histogram and mapping bands of rows in parallel with the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for image with equalized histogram
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that runs the bands
+ */
+void genEqualizedHistogramImage(const unsigned char* SRC,
+                                unsigned char* dest,
+                                const int ROWS,
+                                const int COLS,
+                                parallel::Executor& executor) {
+  int h[LEVELS];
 
-  for (int i = 0; i < ROWS; i++) {
-    for (int j = 0; j < COLS; j++) {
-      // Using row major order indexing
-      unsigned char pixel = SRC[LEVELS * i + j];
+  genHistogram(SRC, &h[0], ROWS, COLS, executor);
+
+  PointOp::genEqualization(&h[0]).apply(SRC, dest, ROWS, COLS, executor);
+}
+
+/**
+ * Creates a streaming equalizer that has not seen a frame yet.
+ */
+StreamingEqualizer::StreamingEqualizer() : primed(false) {}
+
+/**
+ * Equalizes the next frame of the stream into the destination buffer. The
+ * first frame after creating or resetting the equalizer is equalized with its
+ * own histogram, which takes two passes. Every later frame is mapped with the
+ * equalization of the frame before it, in one pass that also counts the
+ * histogram of the frame.
+ *
+ * @param SRC         Buffer containing frame
+ * @param SRC_STRIDE  Number of pixels between the starts of rows of the frame
+ * @param dest        Destination buffer for equalized frame
+ * @param DEST_STRIDE Number of pixels between the starts of rows of the
+ *                    destination
+ * @param ROWS        Number of rows in frame
+ * @param COLS        Number of columns in frame
+ */
+void StreamingEqualizer::equalize(const unsigned char* SRC,
+                                  const int SRC_STRIDE,
+                                  unsigned char* dest,
+                                  const int DEST_STRIDE,
+                                  const int ROWS,
+                                  const int COLS) {
+  parallel::Executor serial(1);
+
+  equalize(SRC, SRC_STRIDE, dest, DEST_STRIDE, ROWS, COLS, serial);
+}
+
+/**
+ * Equalizes the next frame of the stream in the same way as
+ * StreamingEqualizer::equalize, processing bands of rows in parallel with the
+ * given executor. Each band counts its own histogram, and the histograms of
+ * all bands are summed as they finish.
+ *
+ * @param SRC         Buffer containing frame
+ * @param SRC_STRIDE  Number of pixels between the starts of rows of the frame
+ * @param dest        Destination buffer for equalized frame
+ * @param DEST_STRIDE Number of pixels between the starts of rows of the
+ *                    destination
+ * @param ROWS        Number of rows in frame
+ * @param COLS        Number of columns in frame
+ * @param executor    Executor that runs the bands
+ */
+void StreamingEqualizer::equalize(const unsigned char* SRC,
+                                  const int SRC_STRIDE,
+                                  unsigned char* dest,
+                                  const int DEST_STRIDE,
+                                  const int ROWS,
+                                  const int COLS,
+                                  parallel::Executor& executor) {
+  // Ensure that rows do not overlap
+  if (SRC_STRIDE < COLS || DEST_STRIDE < COLS) {
+    throw "ERROR: Row stride is smaller than the number of columns!";
+  }
+
+  std::mutex mutex;
+  int histogram[LEVELS] = {};
+
+  // Count each run of pixels while it is in cache from being mapped, if there
+  // is a mapping to apply yet
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    unsigned int lanes[HISTOGRAM_LANES][LEVELS] = {};
+
+    if (SRC_STRIDE == COLS && DEST_STRIDE == COLS) {
+      // Contiguous rows are counted and mapped in runs that fit in cache,
+      // however short the rows are
+      const long BEGIN = (long)COLS * ROW_BEGIN;
+      const long END = (long)COLS * ROW_END;
+
+      for (long begin = BEGIN; begin < END; begin += STREAMING_RUN) {
+        const long COUNT = std::min(STREAMING_RUN, END - begin);
+
+        accumulateHistogram(&SRC[begin], lanes, COUNT);
+
+        if (primed) {
+          mapping.apply(&SRC[begin], &dest[begin], 1, (int)COUNT);
+        }
+      }
+    } else {
+      for (int i = ROW_BEGIN; i < ROW_END; i++) {
+        const unsigned char* ROW = &SRC[(long)SRC_STRIDE * i];
+
+        accumulateHistogram(ROW, lanes, COLS);
+
+        if (primed) {
+          mapping.apply(ROW, &dest[(long)DEST_STRIDE * i], 1, COLS);
+        }
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    mergeHistogram(lanes, histogram);
+  });
+
+  const PointOp EQUALIZATION = PointOp::genEqualization(histogram);
+
+  // The first frame has to wait for its own histogram
+  if (!primed) {
+    executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+      if (SRC_STRIDE == COLS && DEST_STRIDE == COLS) {
+        EQUALIZATION.apply(&SRC[(long)COLS * ROW_BEGIN],
+                           &dest[(long)COLS * ROW_BEGIN], ROW_END - ROW_BEGIN,
+                           COLS);
+        return;
+      }
+
+      for (int i = ROW_BEGIN; i < ROW_END; i++) {
+        EQUALIZATION.apply(&SRC[(long)SRC_STRIDE * i],
+                           &dest[(long)DEST_STRIDE * i], 1, COLS);
+      }
+    });
+  }
+
+  mapping = EQUALIZATION;
+  primed = true;
+}
+
+/**
+ * Forgets the previous frame, so that the next frame is equalized with its own
+ * histogram.
+ */
+void StreamingEqualizer::reset() {
+  primed = false;
+}
+
+/**
+ * Produces a new image by matching the histogram of the given image to a
+ * reference histogram, such as the histogram of a golden reference image. The
+ * reference histogram is only read, so it can be computed once with
+ * genHistogram and reused for every image matched to it. The mapping is built
+ * in O(LEVELS) and applied as one PointOp pass over the image.
+ *
+ * @param SRC            Buffer containing original image
+ * @param REFERENCE_HIST Histogram to match the image to
+ * @param dest           Destination buffer for matched image
+ * @param ROWS           Number of rows in original image
+ * @param COLS           Number of columns in original image
+ */
+void genMatchedHistogramImage(const unsigned char* SRC,
+                              const int REFERENCE_HIST[],
+                              unsigned char* dest,
+                              const int ROWS,
+                              const int COLS) {
+  parallel::Executor serial(1);
+
+  genMatchedHistogramImage(SRC, REFERENCE_HIST, dest, ROWS, COLS, serial);
+}
+
+/**
+ * Produces the same image as genMatchedHistogramImage, counting the histogram
+ * and mapping bands of rows in parallel with the given executor.
+ *
+ * @param SRC            Buffer containing original image
+ * @param REFERENCE_HIST Histogram to match the image to
+ * @param dest           Destination buffer for matched image
+ * @param ROWS           Number of rows in original image
+ * @param COLS           Number of columns in original image
+ * @param executor       Executor that runs the bands
+ */
+void genMatchedHistogramImage(const unsigned char* SRC,
+                              const int REFERENCE_HIST[],
+                              unsigned char* dest,
+                              const int ROWS,
+                              const int COLS,
+                              parallel::Executor& executor) {
+  int histogram[LEVELS];
+
+  genHistogram(SRC, histogram, ROWS, COLS, executor);
+
+  PointOp::genMatching(histogram, REFERENCE_HIST)
+      .apply(SRC, dest, ROWS, COLS, executor);
+}
+
+/**
+ * Clips the frequencies of a histogram to the given limit and redistributes
+ * the clipped pixels evenly over all levels. Pixels that do not divide evenly
+ * are spread over levels at regular steps.
+ *
+ * @param histogram Histogram to clip
+ * @param LIMIT     Largest frequency of a level before redistribution
+ */
+static void clipHistogram(int histogram[], const int LIMIT) {
+  int clipped = 0;
+
+  for (int i = 0; i < LEVELS; i++) {
+    if (histogram[i] > LIMIT) {
+      clipped += histogram[i] - LIMIT;
+      histogram[i] = LIMIT;
+    }
+  }
+
+  const int BATCH = clipped / LEVELS;
+  int residual = clipped - BATCH * LEVELS;
+  const int STEP = residual > 0 ? std::max(LEVELS / residual, 1) : LEVELS;
+
+  for (int i = 0; i < LEVELS; i++) {
+    histogram[i] += BATCH;
+  }
+
+  for (int i = 0; i < LEVELS && residual > 0; i += STEP, residual--) {
+    histogram[i]++;
+  }
+}
+
+/**
+ * Interpolation between the two nearest tile centres along one axis of an
+ * image, at every pixel of that axis.
+ */
+struct TileInterpolation {
+  // First tile of each pixel
+  std::vector<int> first;
+  // Second tile of each pixel, equal to the first at the borders
+  std::vector<int> second;
+  // Weight of the second tile, in units of 1 / ADAPTIVE_WEIGHT_ONE
+  std::vector<short> weight;
+
+  TileInterpolation(const int SIZE, const int TILES)
+      : first(SIZE), second(SIZE), weight(SIZE) {
+    int tile = 0;
+
+    for (int i = 0; i < SIZE; i++) {
+      // Advance to the last tile whose centre is at or before this pixel
+      while (tile + 1 < TILES && getCentre(SIZE, TILES, tile + 1) <= i) {
+        tile++;
+      }
+
+      const double CENTRE = getCentre(SIZE, TILES, tile);
+
+      if (i < CENTRE || tile + 1 == TILES) {
+        first[i] = second[i] = tile;
+        weight[i] = 0;
+      } else {
+        const double NEXT = getCentre(SIZE, TILES, tile + 1);
+        const double FRACTION = (i - CENTRE) / (NEXT - CENTRE);
+
+        first[i] = tile;
+        second[i] = tile + 1;
+        weight[i] = (short)(FRACTION * ADAPTIVE_WEIGHT_ONE + 0.5);
+      }
+    }
+  }
+
+  // Returns the first pixel of the given tile
+  static int getBegin(const int SIZE, const int TILES, const int TILE) {
+    return (int)((long)SIZE * TILE / TILES);
+  }
+
+  // Returns the centre of the given tile
+  static double getCentre(const int SIZE, const int TILES, const int TILE) {
+    const int BEGIN = getBegin(SIZE, TILES, TILE);
+    const int END = getBegin(SIZE, TILES, TILE + 1);
+
+    return (BEGIN + END - 1) / 2.0;
+  }
+};
+
+/**
+ * Blends four rows of mapped pixels bilinearly into the destination row:
+ *
+ *   ((A * (1 - wx) + B * wx) * (1 - wy) + (C * (1 - wx) + D * wx) * wy)
+ *
+ * Weights are in units of 1 / ADAPTIVE_WEIGHT_ONE, and 8 pixels are blended at
+ * a time when SSE2 is available.
+ *
+ * @param A           Pixels mapped by the first tile of the first tile row
+ * @param B           Pixels mapped by the second tile of the first tile row
+ * @param C           Pixels mapped by the first tile of the second tile row
+ * @param D           Pixels mapped by the second tile of the second tile row
+ * @param COL_WEIGHTS Weight wx of each pixel
+ * @param ROW_WEIGHT  Weight wy of the row
+ * @param dest        Destination buffer for blended pixels
+ * @param COUNT       Number of pixels
+ */
+static void blendTileRows(const unsigned char* A,
+                          const unsigned char* B,
+                          const unsigned char* C,
+                          const unsigned char* D,
+                          const short* COL_WEIGHTS,
+                          const int ROW_WEIGHT,
+                          unsigned char* dest,
+                          const int COUNT) {
+  const int ROUNDING = 1 << (2 * ADAPTIVE_WEIGHT_BITS - 1);
+  int j = 0;
+
+#ifdef __SSE2__
+  const __m128i ZERO = _mm_setzero_si128();
+  const __m128i ONE = _mm_set1_epi16(ADAPTIVE_WEIGHT_ONE);
+  const __m128i ROW_WEIGHTS =
+      _mm_set1_epi32((ROW_WEIGHT << 16) | (ADAPTIVE_WEIGHT_ONE - ROW_WEIGHT));
+  const __m128i ROUND = _mm_set1_epi32(ROUNDING);
+
+  for (; j + 8 <= COUNT; j += 8) {
+    const __m128i WX = _mm_loadu_si128((const __m128i*)&COL_WEIGHTS[j]);
+    const __m128i W1 = _mm_sub_epi16(ONE, WX);
+    auto load = [&](const unsigned char* ROW) {
+      return _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)&ROW[j]), ZERO);
+    };
+
+    // Horizontal blends fit in 16 bits, vertical blends in 32 bits
+    const __m128i TOP = _mm_add_epi16(_mm_mullo_epi16(load(A), W1),
+                                      _mm_mullo_epi16(load(B), WX));
+    const __m128i BOTTOM = _mm_add_epi16(_mm_mullo_epi16(load(C), W1),
+                                         _mm_mullo_epi16(load(D), WX));
+    const __m128i LOW = _mm_srai_epi32(
+        _mm_add_epi32(
+            _mm_madd_epi16(_mm_unpacklo_epi16(TOP, BOTTOM), ROW_WEIGHTS),
+            ROUND),
+        2 * ADAPTIVE_WEIGHT_BITS);
+    const __m128i HIGH = _mm_srai_epi32(
+        _mm_add_epi32(
+            _mm_madd_epi16(_mm_unpackhi_epi16(TOP, BOTTOM), ROW_WEIGHTS),
+            ROUND),
+        2 * ADAPTIVE_WEIGHT_BITS);
+
+    _mm_storel_epi64((__m128i*)&dest[j],
+                     _mm_packus_epi16(_mm_packs_epi32(LOW, HIGH), ZERO));
+  }
+#endif
+
+  // Blend the remaining pixels
+  for (; j < COUNT; j++) {
+    const int WX = COL_WEIGHTS[j];
+    const int TOP = A[j] * (ADAPTIVE_WEIGHT_ONE - WX) + B[j] * WX;
+    const int BOTTOM = C[j] * (ADAPTIVE_WEIGHT_ONE - WX) + D[j] * WX;
+
+    dest[j] = (TOP * (ADAPTIVE_WEIGHT_ONE - ROW_WEIGHT) +
+               BOTTOM * ROW_WEIGHT + ROUNDING) >>
+              (2 * ADAPTIVE_WEIGHT_BITS);
+  }
+}
+
+/**
+ * Produces a new image by contrast-limited adaptive histogram equalization
+ * (CLAHE) of the given image. The image is divided into TILE_ROWS x TILE_COLS
+ * tiles, and each tile is equalized with its own histogram, clipped so that no
+ * level holds more than CLIP_LIMIT times the average frequency of a level. The
+ * clipped pixels are redistributed over all levels, which limits how much
+ * noise in flat regions is amplified. Each pixel is then mapped by bilinear
+ * interpolation between the mappings of the four nearest tile centres, so that
+ * no seams appear between tiles.
+ *
+ * @param SRC        Buffer containing original image
+ * @param dest       Destination buffer for equalized image
+ * @param ROWS       Number of rows in original image
+ * @param COLS       Number of columns in original image
+ * @param TILE_ROWS  Number of rows of tiles
+ * @param TILE_COLS  Number of columns of tiles
+ * @param CLIP_LIMIT Clip limit relative to the average frequency of a level,
+ *                   or 0 to equalize tiles without clipping
+ */
+void genAdaptiveEqualizedImage(const unsigned char* SRC,
+                               unsigned char* dest,
+                               const int ROWS,
+                               const int COLS,
+                               const int TILE_ROWS,
+                               const int TILE_COLS,
+                               const double CLIP_LIMIT) {
+  parallel::Executor serial(1);
+
+  genAdaptiveEqualizedImage(SRC, dest, ROWS, COLS, TILE_ROWS, TILE_COLS,
+                            CLIP_LIMIT, serial);
+}
+
+/**
+ * Produces the same image as genAdaptiveEqualizedImage, equalizing tiles and
+ * interpolating bands of rows in parallel with the given executor.
+ *
+ * @param SRC        Buffer containing original image
+ * @param dest       Destination buffer for equalized image
+ * @param ROWS       Number of rows in original image
+ * @param COLS       Number of columns in original image
+ * @param TILE_ROWS  Number of rows of tiles
+ * @param TILE_COLS  Number of columns of tiles
+ * @param CLIP_LIMIT Clip limit relative to the average frequency of a level,
+ *                   or 0 to equalize tiles without clipping
+ * @param executor   Executor that runs the bands
+ */
+void genAdaptiveEqualizedImage(const unsigned char* SRC,
+                               unsigned char* dest,
+                               const int ROWS,
+                               const int COLS,
+                               const int TILE_ROWS,
+                               const int TILE_COLS,
+                               const double CLIP_LIMIT,
+                               parallel::Executor& executor) {
+  // Ensure that every tile holds at least one pixel
+  if (TILE_ROWS <= 0 || TILE_COLS <= 0 || TILE_ROWS > ROWS ||
+      TILE_COLS > COLS) {
+    throw "ERROR: Tile grid does not fit in image!";
+  }
+
+  if (CLIP_LIMIT < 0) {
+    throw "ERROR: Clip limit must not be negative!";
+  }
+
+  // Mapping of each tile, in row major order
+  std::vector<PointOp> mappings(TILE_ROWS * TILE_COLS);
+
+  executor.forEachBand(TILE_ROWS * TILE_COLS, [&](const int TILE_BEGIN,
+                                                  const int TILE_END) {
+    for (int tile = TILE_BEGIN; tile < TILE_END; tile++) {
+      const int TILE_ROW = tile / TILE_COLS;
+      const int TILE_COL = tile % TILE_COLS;
+      const int TOP = TileInterpolation::getBegin(ROWS, TILE_ROWS, TILE_ROW);
+      const int BOTTOM =
+          TileInterpolation::getBegin(ROWS, TILE_ROWS, TILE_ROW + 1);
+      const int LEFT = TileInterpolation::getBegin(COLS, TILE_COLS, TILE_COL);
+      const int RIGHT =
+          TileInterpolation::getBegin(COLS, TILE_COLS, TILE_COL + 1);
+      unsigned int lanes[HISTOGRAM_LANES][LEVELS] = {};
+      int histogram[LEVELS] = {};
+
+      for (int i = TOP; i < BOTTOM; i++) {
+        accumulateHistogram(&SRC[(long)COLS * i + LEFT], lanes, RIGHT - LEFT);
+      }
+
+      mergeHistogram(lanes, histogram);
+
+      if (CLIP_LIMIT > 0) {
+        const long AREA = (long)(BOTTOM - TOP) * (RIGHT - LEFT);
+
+        // No bin can exceed the area of the tile, so clamp the limit before
+        // converting it so that a large limit cannot overflow
+        clipHistogram(
+            histogram,
+            std::max((int)std::min(CLIP_LIMIT * AREA / LEVELS, (double)AREA),
+                     1));
+      }
+
+      mappings[tile] = PointOp::genEqualization(histogram);
+    }
+  });
+
+  const TileInterpolation VERTICAL(ROWS, TILE_ROWS);
+  const TileInterpolation HORIZONTAL(COLS, TILE_COLS);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    // Rows of the pixels of a run of columns mapped by each of the four tiles
+    Buffer<unsigned char> mapped(4 * (unsigned long)COLS);
+    unsigned char* const A = mapped.get();
+    unsigned char* const B = A + COLS;
+    unsigned char* const C = B + COLS;
+    unsigned char* const D = C + COLS;
+
+    for (int i = ROW_BEGIN; i < ROW_END; i++) {
+      const unsigned char* ROW = &SRC[(long)COLS * i];
+      const int FIRST_ROW = VERTICAL.first[i] * TILE_COLS;
+      const int SECOND_ROW = VERTICAL.second[i] * TILE_COLS;
+
+      // Map each run of columns between two tile centres by its four tiles
+      for (int begin = 0, end = 0; begin < COLS; begin = end) {
+        const int FIRST_COL = HORIZONTAL.first[begin];
+        const int SECOND_COL = HORIZONTAL.second[begin];
+
+        while (end < COLS && HORIZONTAL.first[end] == FIRST_COL &&
+               HORIZONTAL.second[end] == SECOND_COL) {
+          end++;
+        }
+
+        mappings[FIRST_ROW + FIRST_COL].apply(&ROW[begin], &A[begin], 1,
+                                              end - begin);
+        mappings[FIRST_ROW + SECOND_COL].apply(&ROW[begin], &B[begin], 1,
+                                               end - begin);
+        mappings[SECOND_ROW + FIRST_COL].apply(&ROW[begin], &C[begin], 1,
+                                               end - begin);
+        mappings[SECOND_ROW + SECOND_COL].apply(&ROW[begin], &D[begin], 1,
+                                                end - begin);
+      }
+
+      blendTileRows(A, B, C, D, HORIZONTAL.weight.data(), VERTICAL.weight[i],
+                    &dest[(long)COLS * i], COLS);
+    }
+  });
+}
+
+/**
+ * Returns the shard of the calling thread, creating it on the first call from
+ * that thread. Shards are never moved, so a thread can keep counting into its
+ * shard while other threads create theirs.
+ *
+ * @returns Frequencies of the shard
+ */
+long long* HistogramAccumulator::getShard() {
+  std::lock_guard<std::mutex> lock(mutex);
+  std::unique_ptr<long long[]>& shard = shards[std::this_thread::get_id()];
+
+  if (!shard) {
+    shard.reset(new long long[LEVELS]());
+  }
+
+  return shard.get();
+}
+
+/**
+ * Adds the histogram of the given image to the accumulated histogram.
+ *
+ * @param SRC  Buffer containing image
+ * @param ROWS Number of rows in image
+ * @param COLS Number of columns in image
+ */
+void HistogramAccumulator::add(const unsigned char* SRC,
+                               const int ROWS,
+                               const int COLS) {
+  int histogram[LEVELS] = {};
+
+  countHistogram(SRC, histogram, (long)ROWS * COLS);
+  addHistogram(histogram);
+}
+
+/**
+ * Adds the histogram of the given image to the accumulated histogram, counting
+ * bands of rows in parallel with the given executor. Each band is added to the
+ * shard of the thread that counted it.
+ *
+ * @param SRC      Buffer containing image
+ * @param ROWS     Number of rows in image
+ * @param COLS     Number of columns in image
+ * @param executor Executor that counts the bands
+ */
+void HistogramAccumulator::add(const unsigned char* SRC,
+                               const int ROWS,
+                               const int COLS,
+                               parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    add(&SRC[(long)COLS * ROW_BEGIN], ROW_END - ROW_BEGIN, COLS);
+  });
+}
+
+/**
+ * Adds the given histogram of LEVELS levels to the accumulated histogram.
+ *
+ * @param HISTOGRAM Histogram to add
+ */
+void HistogramAccumulator::addHistogram(const int HISTOGRAM[]) {
+  long long* shard = getShard();
+
+  for (int i = 0; i < LEVELS; i++) {
+    shard[i] += HISTOGRAM[i];
+  }
+}
+
+/**
+ * Adds the histogram accumulated by another accumulator to this one, such as
+ * the histogram of another part of a dataset.
+ *
+ * @param OTHER Accumulator to merge
+ */
+void HistogramAccumulator::merge(const HistogramAccumulator& OTHER) {
+  long long histogram[LEVELS];
+
+  OTHER.getHistogram(histogram);
+
+  long long* shard = getShard();
+
+  for (int i = 0; i < LEVELS; i++) {
+    shard[i] += histogram[i];
+  }
+}
+
+/**
+ * Empties the accumulated histogram.
+ */
+void HistogramAccumulator::reset() {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  shards.clear();
+}
+
+/**
+ * Produces the accumulated histogram into the destination buffer by summing
+ * the shards.
+ *
+ * @param dest Destination buffer for histogram
+ */
+void HistogramAccumulator::getHistogram(long long dest[]) const {
+  std::lock_guard<std::mutex> lock(mutex);
+
+  std::fill(dest, dest + LEVELS, 0);
+
+  for (const auto& SHARD : shards) {
+    for (int i = 0; i < LEVELS; i++) {
+      dest[i] += SHARD.second[i];
+    }
+  }
+}
+
+/**
+ * Produces the cumulative histogram of the accumulated histogram into the
+ * destination buffer.
+ *
+ * @param dest Destination buffer for cumulative histogram
+ */
+void HistogramAccumulator::genCumulativeHistogram(long long dest[]) const {
+  getHistogram(dest);
+
+  for (int i = 1; i < LEVELS; i++) {
+    dest[i] += dest[i - 1];
+  }
+}
+
+/**
+ * Returns the number of pixels accumulated so far.
+ *
+ * @returns Number of pixels
+ */
+long long HistogramAccumulator::getTotal() const {
+  long long histogram[LEVELS];
+  long long total = 0;
+
+  getHistogram(histogram);
+
+  for (int i = 0; i < LEVELS; i++) {
+    total += histogram[i];
+  }
+
+  return total;
+}
+
+/**
+ * Returns the mean level of the pixels accumulated so far.
+ *
+ * @returns Mean grey level, or 0 if no pixels were accumulated
+ */
+double HistogramAccumulator::getMean() const {
+  long long histogram[LEVELS];
+  double total = 0;
+  double sum = 0;
+
+  getHistogram(histogram);
+
+  for (int i = 0; i < LEVELS; i++) {
+    total += histogram[i];
+    sum += (double)histogram[i] * i;
+  }
 
-      dest[LEVELS * i + j] = H[pixel];
+  return total > 0 ? sum / total : 0;
+}
+
+/**
+ * Returns the variance of the levels of the pixels accumulated so far.
+ *
+ * @returns Variance of grey levels, or 0 if no pixels were accumulated
+ */
+double HistogramAccumulator::getVariance() const {
+  long long histogram[LEVELS];
+  double total = 0;
+  double sum = 0;
+
+  getHistogram(histogram);
+
+  for (int i = 0; i < LEVELS; i++) {
+    total += histogram[i];
+    sum += (double)histogram[i] * i;
+  }
+
+  if (total == 0) {
+    return 0;
+  }
+
+  const double MEAN = sum / total;
+  double variance = 0;
+
+  for (int i = 0; i < LEVELS; i++) {
+    variance += histogram[i] * (i - MEAN) * (i - MEAN);
+  }
+
+  return variance / total;
+}
+
+/**
+ * Returns the level at the given percentile of the pixels accumulated so far,
+ * with the same ranks as getPercentile.
+ *
+ * @param PERCENTILE Percentile in [0, 1]
+ * @returns          Grey level at the percentile
+ */
+unsigned char HistogramAccumulator::getPercentile(
+    const double PERCENTILE) const {
+  // Ensure that the percentile is valid
+  if (PERCENTILE < 0 || PERCENTILE > 1) {
+    throw "ERROR: Percentile out of range!";
+  }
+
+  long long cumulative[LEVELS];
+
+  genCumulativeHistogram(cumulative);
+
+  if (cumulative[LEVELS - 1] == 0) {
+    return LEVEL_BLACK;
+  }
+
+  const long long RANK =
+      (long long)(PERCENTILE * (cumulative[LEVELS - 1] - 1) + 0.5);
+
+  for (int i = 0; i < LEVELS; i++) {
+    if (cumulative[i] > RANK) {
+      return i;
     }
   }
+
+  return LEVEL_WHITE;
+}
+
+/**
+ * Returns the equalization of the pixels accumulated so far, which maps every
+ * image of a dataset in the same way as PointOp::genEqualization maps a single
+ * image.
+ *
+ * @returns Point operation
+ */
+PointOp HistogramAccumulator::genEqualization() const {
+  long long cumulative[LEVELS];
+  unsigned char table[LEVELS];
+
+  genCumulativeHistogram(cumulative);
+
+  if (cumulative[LEVELS - 1] == 0) {
+    return PointOp();
+  }
+
+  const double S = (double)(LEVELS - 1) / cumulative[LEVELS - 1];
+
+  for (int i = 0; i < LEVELS; i++) {
+    table[i] = (int)(cumulative[i] * S);
+  }
+
+  return PointOp::genTable(table);
 }
 
 }  // namespace image
@@ -1,6 +1,14 @@
 #ifndef IMAGE_HISTOGRAM_H
 #define IMAGE_HISTOGRAM_H
 
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+#include "../parallel/executor.hpp"
+#include "pointop.hpp"
+
 namespace image {
 
 void genHistogram(const unsigned char* SRC,
@@ -8,17 +16,168 @@ void genHistogram(const unsigned char* SRC,
                   const int ROWS,
                   const int COLS);
 
+void genHistogram(const unsigned char* SRC,
+                  int dest[],
+                  const int ROWS,
+                  const int COLS,
+                  parallel::Executor& executor);
+
 void genCumulativeHistogram(const int SRC[], int dest[]);
 
 void genNormalizedHistogram(const int SRC[], int dest[], const double FACTOR);
 
 void genHistogramImage(const int SRC[], unsigned char* dest);
 
+void genHistogramImage(const int SRC[],
+                       unsigned char* dest,
+                       const int ROWS,
+                       const int COLS,
+                       const bool LOG_SCALE);
+
+void genHistogramSheet(const int* const HISTOGRAMS[],
+                       const int COUNT,
+                       unsigned char* dest,
+                       const int SHEET_COLS,
+                       const int PLOT_ROWS,
+                       const int PLOT_COLS,
+                       const bool LOG_SCALE);
+
+void genHistogramSheet(const int* const HISTOGRAMS[],
+                       const int COUNT,
+                       unsigned char* dest,
+                       const int SHEET_COLS,
+                       const int PLOT_ROWS,
+                       const int PLOT_COLS,
+                       const bool LOG_SCALE,
+                       parallel::Executor& executor);
+
 void genEqualizedHistogramImage(const unsigned char* SRC,
                                 unsigned char* dest,
                                 const int ROWS,
                                 const int COLS);
 
+void genEqualizedHistogramImage(const unsigned char* SRC,
+                                unsigned char* dest,
+                                const int ROWS,
+                                const int COLS,
+                                parallel::Executor& executor);
+
+/**
+ * Equalizes a stream of frames, such as the frames of a video, in a single
+ * pass over each frame. Each frame is mapped with the equalization of the
+ * previous frame while its own histogram is counted, row by row, for the next
+ * frame. Frames may have any size and row stride.
+ */
+class StreamingEqualizer {
+ public:
+  StreamingEqualizer();
+
+  void equalize(const unsigned char* SRC,
+                const int SRC_STRIDE,
+                unsigned char* dest,
+                const int DEST_STRIDE,
+                const int ROWS,
+                const int COLS);
+
+  void equalize(const unsigned char* SRC,
+                const int SRC_STRIDE,
+                unsigned char* dest,
+                const int DEST_STRIDE,
+                const int ROWS,
+                const int COLS,
+                parallel::Executor& executor);
+
+  void reset();
+
+ private:
+  // Equalization of the previous frame
+  PointOp mapping;
+  // Set once a frame has been equalized
+  bool primed;
+};
+
+void genMatchedHistogramImage(const unsigned char* SRC,
+                              const int REFERENCE_HIST[],
+                              unsigned char* dest,
+                              const int ROWS,
+                              const int COLS);
+
+void genMatchedHistogramImage(const unsigned char* SRC,
+                              const int REFERENCE_HIST[],
+                              unsigned char* dest,
+                              const int ROWS,
+                              const int COLS,
+                              parallel::Executor& executor);
+
+void genAdaptiveEqualizedImage(const unsigned char* SRC,
+                               unsigned char* dest,
+                               const int ROWS,
+                               const int COLS,
+                               const int TILE_ROWS,
+                               const int TILE_COLS,
+                               const double CLIP_LIMIT);
+
+void genAdaptiveEqualizedImage(const unsigned char* SRC,
+                               unsigned char* dest,
+                               const int ROWS,
+                               const int COLS,
+                               const int TILE_ROWS,
+                               const int TILE_COLS,
+                               const double CLIP_LIMIT,
+                               parallel::Executor& executor);
+
+/**
+ * Histogram accumulated over many images, such as the frames of a dataset or
+ * the tiles of a large image, without storing or re-reading them. Every thread
+ * that adds images counts into its own shard, so counting needs no atomics or
+ * locks, and shards are only summed when the histogram is queried.
+ *
+ * Images may be added from several threads at once, but queries must not run
+ * concurrently with additions.
+ */
+class HistogramAccumulator {
+ public:
+  HistogramAccumulator() = default;
+
+  HistogramAccumulator(const HistogramAccumulator&) = delete;
+  HistogramAccumulator& operator=(const HistogramAccumulator&) = delete;
+
+  void add(const unsigned char* SRC, const int ROWS, const int COLS);
+
+  void add(const unsigned char* SRC,
+           const int ROWS,
+           const int COLS,
+           parallel::Executor& executor);
+
+  void addHistogram(const int HISTOGRAM[]);
+
+  void merge(const HistogramAccumulator& OTHER);
+
+  void reset();
+
+  void getHistogram(long long dest[]) const;
+
+  void genCumulativeHistogram(long long dest[]) const;
+
+  long long getTotal() const;
+
+  double getMean() const;
+
+  double getVariance() const;
+
+  unsigned char getPercentile(const double PERCENTILE) const;
+
+  PointOp genEqualization() const;
+
+ private:
+  long long* getShard();
+
+  // Frequencies counted by each thread
+  std::map<std::thread::id, std::unique_ptr<long long[]>> shards;
+  // Guards the map of shards, but not their frequencies
+  mutable std::mutex mutex;
+};
+
 }  // namespace image
 
 #endif  // IMAGE_HISTOGRAM_H
@@ -1,6 +1,7 @@
 #include "image.hpp"
 
 #include "../util/util.hpp"
+#include "pointop.hpp"
 
 namespace image {
 
@@ -87,25 +88,28 @@ void genReducedQuantizationImage(const unsigned char* SRC,
                                  const int ROWS,
                                  const int COLS,
                                  const int UNSET_BIT_COUNT) {
-  // Ensure that no more bits are unset than are available in a character
-  if (UNSET_BIT_COUNT >= sizeof(char) * 8) {
-    throw "ERROR: Bit position out of range!";
-  }
-
-  // Loop through the entire source image pixel by pixel
-  for (int i = 0; i < ROWS * COLS; i++) {
-    // Temporarily store value of current character (pixel)
-    unsigned char character = SRC[i];
-
-    // Unset the lowest order N bits from the source image buffer and store in
-    // destination image buffer at the same location
-    for (int j = 0; j < UNSET_BIT_COUNT; j++) {
-      character = util::unsetBit<unsigned char>(character, j);
-    }
+  PointOp::genQuantization(UNSET_BIT_COUNT).apply(SRC, dest, ROWS, COLS);
+}
 
-    // Set character with unset bits
-    dest[i] = character;
-  }
+/**
+ * Produces the same image as genReducedQuantizationImage, mapping bands of rows
+ * in parallel with the given executor.
+ *
+ * @param SRC             Buffer containing original image
+ * @param dest            Destination buffer for reduced quantization image
+ * @param ROWS            Number of rows in original image
+ * @param COLS            Number of columns in original image
+ * @param UNSET_BIT_COUNT Number of lowest order bits to unset
+ * @param executor        Executor that maps the bands
+ */
+void genReducedQuantizationImage(const unsigned char* SRC,
+                                 unsigned char* dest,
+                                 const int ROWS,
+                                 const int COLS,
+                                 const int UNSET_BIT_COUNT,
+                                 parallel::Executor& executor) {
+  PointOp::genQuantization(UNSET_BIT_COUNT)
+      .apply(SRC, dest, ROWS, COLS, executor);
 }
 
 /**
@@ -130,12 +134,34 @@ void applyThreshold(const unsigned char* SRC,
                     const unsigned char NEW_LOW,
                     const unsigned char NEW_HIGH,
                     const unsigned char THRESHOLD) {
-  // Loop through the entire source image pixel by pixel
-  for (int i = 0; i < ROWS * COLS; i++) {
-    // Set each pixel in the destination buffer to its new value based on a
-    // comparison against the given threshold
-    dest[i] = (SRC[i] < THRESHOLD) ? NEW_LOW : NEW_HIGH;
-  }
+  PointOp::genThreshold(NEW_LOW, NEW_HIGH, THRESHOLD)
+      .apply(SRC, dest, ROWS, COLS);
+}
+
+/**
+ * Produces the same image as applyThreshold, mapping bands of rows in parallel
+ * with the given executor.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for thresholded image
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param NEW_LOW   New value for pixels with intensities below threshold
+ * @param NEW_HIGH  New value for pixels with intensities greater than or equal
+ *                  to the threshold value
+ * @param THRESHOLD Chosen threshold intensity value
+ * @param executor  Executor that maps the bands
+ */
+void applyThreshold(const unsigned char* SRC,
+                    unsigned char* dest,
+                    const int ROWS,
+                    const int COLS,
+                    const unsigned char NEW_LOW,
+                    const unsigned char NEW_HIGH,
+                    const unsigned char THRESHOLD,
+                    parallel::Executor& executor) {
+  PointOp::genThreshold(NEW_LOW, NEW_HIGH, THRESHOLD)
+      .apply(SRC, dest, ROWS, COLS, executor);
 }
 
 }  // namespace image
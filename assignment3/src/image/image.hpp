@@ -1,6 +1,8 @@
 #ifndef IMAGE_H
 #define IMAGE_H
 
+#include "../parallel/executor.hpp"
+
 namespace image {
 
 // Colours/grey levels
@@ -20,6 +22,13 @@ void genReducedQuantizationImage(const unsigned char* SRC,
                                  const int COLS,
                                  const int UNSET_BIT_COUNT);
 
+void genReducedQuantizationImage(const unsigned char* SRC,
+                                 unsigned char* dest,
+                                 const int ROWS,
+                                 const int COLS,
+                                 const int UNSET_BIT_COUNT,
+                                 parallel::Executor& executor);
+
 void applyThreshold(const unsigned char* SRC,
                     unsigned char* dest,
                     const int ROWS,
@@ -28,6 +37,15 @@ void applyThreshold(const unsigned char* SRC,
                     const unsigned char NEW_HIGH,
                     const unsigned char THRESHOLD);
 
+void applyThreshold(const unsigned char* SRC,
+                    unsigned char* dest,
+                    const int ROWS,
+                    const int COLS,
+                    const unsigned char NEW_LOW,
+                    const unsigned char NEW_HIGH,
+                    const unsigned char THRESHOLD,
+                    parallel::Executor& executor);
+
 }  // namespace image
 
 #endif  // IMAGE_H
@@ -0,0 +1,398 @@
+#include "local.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+namespace image {
+
+// Number of fractional bits of the fixed point information of a window
+const int LOCAL_INFORMATION_BITS = 32;
+
+/**
+ * Creates a local histogram of the given image with an empty window. Windows
+ * are filled by LocalHistogram::scan.
+ *
+ * @param SRC    Buffer containing image
+ * @param ROWS   Number of rows in image
+ * @param COLS   Number of columns in image
+ * @param RADIUS Radius of the window
+ */
+LocalHistogram::LocalHistogram(const unsigned char* SRC,
+                               const int ROWS,
+                               const int COLS,
+                               const int RADIUS)
+    : src(SRC),
+      rows(ROWS),
+      cols(COLS),
+      radius(RADIUS),
+      fine(),
+      coarse(),
+      count(0),
+      information(0) {
+  // Ensure that the window is valid
+  if (RADIUS < 0) {
+    throw "ERROR: Window radius must not be negative!";
+  }
+
+  const int SIZE = 2 * RADIUS + 1;
+  const long MAX_COUNT = (long)std::min(SIZE, ROWS) * std::min(SIZE, COLS);
+
+  // Information is summed in fixed point, so that it is exact and does not
+  // drift however many times the window moves
+  informationTable.resize(std::max(MAX_COUNT, 0L) + 1);
+
+  for (long h = 1; h <= MAX_COUNT; h++) {
+    informationTable[h] = std::llround(h * std::log2((double)h) *
+                                       (1LL << LOCAL_INFORMATION_BITS));
+  }
+}
+
+/**
+ * Returns the number of pixels in the window.
+ *
+ * @returns Number of pixels
+ */
+int LocalHistogram::getCount() const {
+  return count;
+}
+
+/**
+ * Returns the number of pixels of the given level in the window.
+ *
+ * @param LEVEL Grey level
+ * @returns     Frequency of the level
+ */
+int LocalHistogram::getFrequency(const unsigned char LEVEL) const {
+  return fine[LEVEL];
+}
+
+/**
+ * Returns the number of pixels in the window with a level lower than or equal
+ * to the given level, which is the cumulative histogram at that level.
+ *
+ * @param LEVEL Grey level
+ * @returns     Number of pixels up to the level
+ */
+int LocalHistogram::getRank(const unsigned char LEVEL) const {
+  const int GROUP = LEVEL / LOCAL_COARSE_SIZE;
+  int rank = 0;
+
+  for (int i = 0; i < GROUP; i++) {
+    rank += coarse[i];
+  }
+
+  for (int i = GROUP * LOCAL_COARSE_SIZE; i <= LEVEL; i++) {
+    rank += fine[i];
+  }
+
+  return rank;
+}
+
+/**
+ * Returns the level of the pixel at the given rank of the window, counting the
+ * darkest pixel as rank 0. The coarse bins are searched first, so a query
+ * looks at no more than 2 * LEVELS / LOCAL_COARSE_SIZE bins on average.
+ *
+ * @param RANK Rank in [0, getCount())
+ * @returns    Grey level of the pixel at that rank
+ */
+unsigned char LocalHistogram::getLevel(const int RANK) const {
+  int remaining = RANK;
+  int group = 0;
+
+  while (group + 1 < LEVELS / LOCAL_COARSE_SIZE && remaining >= coarse[group]) {
+    remaining -= coarse[group];
+    group++;
+  }
+
+  int level = group * LOCAL_COARSE_SIZE;
+
+  while (level + 1 < LEVELS && remaining >= fine[level]) {
+    remaining -= fine[level];
+    level++;
+  }
+
+  return level;
+}
+
+/**
+ * Returns the Shannon entropy of the levels in the window, in bits:
+ *
+ *   H = -sum((h / N) * log2(h / N)) = log2(N) - sum(h * log2(h)) / N
+ *
+ * Where h is the frequency of each level and N is the number of pixels.
+ *
+ * @returns Entropy of the window
+ */
+double LocalHistogram::getEntropy() const {
+  if (count == 0) {
+    return 0;
+  }
+
+  return std::log2((double)count) -
+         std::ldexp((double)information, -LOCAL_INFORMATION_BITS) / count;
+}
+
+/**
+ * Empties the histogram and fills it with the window around the first pixel
+ * of the given row.
+ *
+ * @param ROW Row of the pixel
+ */
+void LocalHistogram::reset(const int ROW) {
+  std::fill(fine, fine + LEVELS, 0);
+  std::fill(coarse, coarse + LEVELS / LOCAL_COARSE_SIZE, 0);
+  count = 0;
+  information = 0;
+
+  const int TOP = std::max(ROW - radius, 0);
+  const int BOTTOM = std::min(ROW + radius, rows - 1);
+  const int RIGHT = std::min(radius, cols - 1);
+
+  for (int i = TOP; i <= BOTTOM; i++) {
+    for (int j = 0; j <= RIGHT; j++) {
+      add(src[(long)cols * i + j]);
+    }
+  }
+}
+
+/**
+ * Moves the window from the pixel at the given row and column to its
+ * neighbour in the same row, removing the column that leaves the window and
+ * adding the column that enters it.
+ *
+ * @param ROW  Row of the pixel
+ * @param COL  Column of the pixel
+ * @param STEP 1 to move right, or -1 to move left
+ */
+void LocalHistogram::moveAcross(const int ROW, const int COL, const int STEP) {
+  const int TOP = std::max(ROW - radius, 0);
+  const int BOTTOM = std::min(ROW + radius, rows - 1);
+  const int LEAVING = COL - STEP * radius;
+  const int ENTERING = COL + STEP * (radius + 1);
+
+  if (LEAVING >= 0 && LEAVING < cols) {
+    for (int i = TOP; i <= BOTTOM; i++) {
+      remove(src[(long)cols * i + LEAVING]);
+    }
+  }
+
+  if (ENTERING >= 0 && ENTERING < cols) {
+    for (int i = TOP; i <= BOTTOM; i++) {
+      add(src[(long)cols * i + ENTERING]);
+    }
+  }
+}
+
+/**
+ * Moves the window from the pixel at the given row and column to the pixel
+ * below it, removing the row that leaves the window and adding the row that
+ * enters it.
+ *
+ * @param ROW Row of the pixel
+ * @param COL Column of the pixel
+ */
+void LocalHistogram::moveDown(const int ROW, const int COL) {
+  const int LEFT = std::max(COL - radius, 0);
+  const int RIGHT = std::min(COL + radius, cols - 1);
+  const int LEAVING = ROW - radius;
+  const int ENTERING = ROW + radius + 1;
+
+  if (LEAVING >= 0) {
+    for (int j = LEFT; j <= RIGHT; j++) {
+      remove(src[(long)cols * LEAVING + j]);
+    }
+  }
+
+  if (ENTERING < rows) {
+    for (int j = LEFT; j <= RIGHT; j++) {
+      add(src[(long)cols * ENTERING + j]);
+    }
+  }
+}
+
+/**
+ * Adds a pixel of the given level to the window.
+ *
+ * @param LEVEL Grey level of the pixel
+ */
+void LocalHistogram::add(const unsigned char LEVEL) {
+  const int FREQUENCY = fine[LEVEL]++;
+
+  information += informationTable[FREQUENCY + 1] - informationTable[FREQUENCY];
+  coarse[LEVEL / LOCAL_COARSE_SIZE]++;
+  count++;
+}
+
+/**
+ * Removes a pixel of the given level from the window.
+ *
+ * @param LEVEL Grey level of the pixel
+ */
+void LocalHistogram::remove(const unsigned char LEVEL) {
+  const int FREQUENCY = fine[LEVEL]--;
+
+  information += informationTable[FREQUENCY - 1] - informationTable[FREQUENCY];
+  coarse[LEVEL / LOCAL_COARSE_SIZE]--;
+  count--;
+}
+
+/**
+ * Produces a new image by equalizing every pixel with the histogram of the
+ * (2 * RADIUS + 1) x (2 * RADIUS + 1) window around it, clipped to the image.
+ * Each pixel is mapped in the same way as genEqualizedHistogramImage maps it
+ * with the histogram of the whole image.
+ *
+ * @param SRC    Buffer containing original image
+ * @param dest   Destination buffer for equalized image
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param RADIUS Radius of the window
+ */
+void applyLocalEqualization(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const int RADIUS) {
+  parallel::Executor serial(1);
+
+  applyLocalEqualization(SRC, dest, ROWS, COLS, RADIUS, serial);
+}
+
+/**
+ * Produces the same image as applyLocalEqualization, scanning bands of rows in
+ * parallel with the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for equalized image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param RADIUS   Radius of the window
+ * @param executor Executor that scans the bands
+ */
+void applyLocalEqualization(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const int RADIUS,
+                            parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    LocalHistogram histogram(SRC, ROWS, COLS, RADIUS);
+
+    histogram.scan(ROW_BEGIN, ROW_END, [&](const int I, const int J) {
+      const long INDEX = (long)COLS * I + J;
+      const double S = (double)(LEVELS - 1) / histogram.getCount();
+
+      dest[INDEX] = (int)(histogram.getRank(SRC[INDEX]) * S);
+    });
+  });
+}
+
+/**
+ * Produces a new image by replacing every pixel with the pixel at the given
+ * percentile of the (2 * RADIUS + 1) x (2 * RADIUS + 1) window around it,
+ * clipped to the image. A percentile of 0 is the minimum, 0.5 the median and
+ * 1 the maximum of the window. The cost per pixel grows linearly with the
+ * radius, rather than with the area of the window.
+ *
+ * @param SRC        Buffer containing original image
+ * @param dest       Destination buffer for filtered image
+ * @param ROWS       Number of rows in original image
+ * @param COLS       Number of columns in original image
+ * @param RADIUS     Radius of the window
+ * @param PERCENTILE Percentile in [0, 1]
+ */
+void applyRankFilter(const unsigned char* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS,
+                     const int RADIUS,
+                     const double PERCENTILE) {
+  parallel::Executor serial(1);
+
+  applyRankFilter(SRC, dest, ROWS, COLS, RADIUS, PERCENTILE, serial);
+}
+
+/**
+ * Produces the same image as applyRankFilter, scanning bands of rows in
+ * parallel with the given executor.
+ *
+ * @param SRC        Buffer containing original image
+ * @param dest       Destination buffer for filtered image
+ * @param ROWS       Number of rows in original image
+ * @param COLS       Number of columns in original image
+ * @param RADIUS     Radius of the window
+ * @param PERCENTILE Percentile in [0, 1]
+ * @param executor   Executor that scans the bands
+ */
+void applyRankFilter(const unsigned char* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS,
+                     const int RADIUS,
+                     const double PERCENTILE,
+                     parallel::Executor& executor) {
+  // Ensure that the percentile is valid
+  if (PERCENTILE < 0 || PERCENTILE > 1) {
+    throw "ERROR: Percentile out of range!";
+  }
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    LocalHistogram histogram(SRC, ROWS, COLS, RADIUS);
+
+    histogram.scan(ROW_BEGIN, ROW_END, [&](const int I, const int J) {
+      const int RANK = (int)(PERCENTILE * (histogram.getCount() - 1) + 0.5);
+
+      dest[(long)COLS * I + J] = histogram.getLevel(RANK);
+    });
+  });
+}
+
+/**
+ * Produces a map of the Shannon entropy, in bits, of the levels in the
+ * (2 * RADIUS + 1) x (2 * RADIUS + 1) window around every pixel, clipped to
+ * the image. Entropy is high in textured regions and 0 in flat ones.
+ *
+ * @param SRC    Buffer containing original image
+ * @param dest   Destination buffer for entropy map
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param RADIUS Radius of the window
+ */
+void genLocalEntropy(const unsigned char* SRC,
+                     float* dest,
+                     const int ROWS,
+                     const int COLS,
+                     const int RADIUS) {
+  parallel::Executor serial(1);
+
+  genLocalEntropy(SRC, dest, ROWS, COLS, RADIUS, serial);
+}
+
+/**
+ * Produces the same map as genLocalEntropy, scanning bands of rows in parallel
+ * with the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for entropy map
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param RADIUS   Radius of the window
+ * @param executor Executor that scans the bands
+ */
+void genLocalEntropy(const unsigned char* SRC,
+                     float* dest,
+                     const int ROWS,
+                     const int COLS,
+                     const int RADIUS,
+                     parallel::Executor& executor) {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    LocalHistogram histogram(SRC, ROWS, COLS, RADIUS);
+
+    histogram.scan(ROW_BEGIN, ROW_END, [&](const int I, const int J) {
+      dest[(long)COLS * I + J] = histogram.getEntropy();
+    });
+  });
+}
+
+}  // namespace image
@@ -0,0 +1,143 @@
+#ifndef IMAGE_LOCAL_H
+#define IMAGE_LOCAL_H
+
+#include <vector>
+
+#include "../parallel/executor.hpp"
+#include "image.hpp"
+
+namespace image {
+
+// Number of levels summed by each coarse bin of a LocalHistogram
+const int LOCAL_COARSE_SIZE = 16;
+
+/**
+ * Histogram of the (2 * RADIUS + 1) x (2 * RADIUS + 1) window around a pixel,
+ * clipped to the image, that is updated incrementally as the window slides
+ * over the image. Pixels are visited in serpentine order, so every step only
+ * adds the row or column of pixels entering the window and removes the one
+ * leaving it, instead of recounting the whole window.
+ */
+class LocalHistogram {
+ public:
+  LocalHistogram(const unsigned char* SRC,
+                 const int ROWS,
+                 const int COLS,
+                 const int RADIUS);
+
+  /**
+   * Visits every pixel of the rows in [ROW_BEGIN, ROW_END) in serpentine
+   * order, calling VISIT(row, col) while the histogram holds the window
+   * around that pixel.
+   *
+   * @param ROW_BEGIN First row to visit
+   * @param ROW_END   Row after the last row to visit
+   * @param VISIT     Function called for each pixel
+   */
+  template <class F>
+  void scan(const int ROW_BEGIN, const int ROW_END, const F& VISIT) {
+    if (ROW_BEGIN >= ROW_END) {
+      return;
+    }
+
+    reset(ROW_BEGIN);
+
+    for (int i = ROW_BEGIN; i < ROW_END; i++) {
+      const bool FORWARD = (i - ROW_BEGIN) % 2 == 0;
+      const int STEP = FORWARD ? 1 : -1;
+      int j = FORWARD ? 0 : cols - 1;
+
+      for (int k = 0; k < cols; k++, j += STEP) {
+        VISIT(i, j);
+
+        if (k + 1 < cols) {
+          moveAcross(i, j, STEP);
+        }
+      }
+
+      if (i + 1 < ROW_END) {
+        moveDown(i, j - STEP);
+      }
+    }
+  }
+
+  int getCount() const;
+
+  int getFrequency(const unsigned char LEVEL) const;
+
+  int getRank(const unsigned char LEVEL) const;
+
+  unsigned char getLevel(const int RANK) const;
+
+  double getEntropy() const;
+
+ private:
+  void reset(const int ROW);
+
+  void moveAcross(const int ROW, const int COL, const int STEP);
+
+  void moveDown(const int ROW, const int COL);
+
+  void add(const unsigned char LEVEL);
+
+  void remove(const unsigned char LEVEL);
+
+  const unsigned char* src;
+  int rows;
+  int cols;
+  int radius;
+  // Frequency of each level, and of each run of LOCAL_COARSE_SIZE levels
+  int fine[LEVELS];
+  int coarse[LEVELS / LOCAL_COARSE_SIZE];
+  // Number of pixels in the window
+  int count;
+  // Sum of h * log2(h) over all frequencies h, in fixed point
+  long long information;
+  // Fixed point h * log2(h) of every frequency h a window can hold
+  std::vector<long long> informationTable;
+};
+
+void applyLocalEqualization(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const int RADIUS);
+
+void applyLocalEqualization(const unsigned char* SRC,
+                            unsigned char* dest,
+                            const int ROWS,
+                            const int COLS,
+                            const int RADIUS,
+                            parallel::Executor& executor);
+
+void applyRankFilter(const unsigned char* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS,
+                     const int RADIUS,
+                     const double PERCENTILE);
+
+void applyRankFilter(const unsigned char* SRC,
+                     unsigned char* dest,
+                     const int ROWS,
+                     const int COLS,
+                     const int RADIUS,
+                     const double PERCENTILE,
+                     parallel::Executor& executor);
+
+void genLocalEntropy(const unsigned char* SRC,
+                     float* dest,
+                     const int ROWS,
+                     const int COLS,
+                     const int RADIUS);
+
+void genLocalEntropy(const unsigned char* SRC,
+                     float* dest,
+                     const int ROWS,
+                     const int COLS,
+                     const int RADIUS,
+                     parallel::Executor& executor);
+
+}  // namespace image
+
+#endif  // IMAGE_LOCAL_H
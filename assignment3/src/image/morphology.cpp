@@ -0,0 +1,555 @@
+#include "morphology.hpp"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include <vector>
+
+#include "buffer.hpp"
+#include "image.hpp"
+
+namespace image {
+
+/**
+ * Minimum of grey levels, used for erosion. LEVEL_WHITE is the identity, so
+ * pixels outside of the image never affect the result.
+ */
+struct MinOperator {
+  static constexpr unsigned char IDENTITY = LEVEL_WHITE;
+
+  static unsigned char apply(const unsigned char A, const unsigned char B) {
+    return A < B ? A : B;
+  }
+
+#ifdef __SSE2__
+  static __m128i apply(const __m128i A, const __m128i B) {
+    return _mm_min_epu8(A, B);
+  }
+#endif
+};
+
+/**
+ * Maximum of grey levels, used for dilation. LEVEL_BLACK is the identity, so
+ * pixels outside of the image never affect the result.
+ */
+struct MaxOperator {
+  static constexpr unsigned char IDENTITY = LEVEL_BLACK;
+
+  static unsigned char apply(const unsigned char A, const unsigned char B) {
+    return A > B ? A : B;
+  }
+
+#ifdef __SSE2__
+  static __m128i apply(const __m128i A, const __m128i B) {
+    return _mm_max_epu8(A, B);
+  }
+#endif
+};
+
+/**
+ * Combines two rows of pixels element by element with the given operator,
+ * 16 pixels at a time when SSE2 is available.
+ *
+ * @param A     First row
+ * @param B     Second row
+ * @param dest  Destination row, may be A or B
+ * @param WIDTH Number of pixels in each row
+ */
+template <class Op>
+static void combineRows(const unsigned char* A,
+                        const unsigned char* B,
+                        unsigned char* dest,
+                        const int WIDTH) {
+  int j = 0;
+
+#ifdef __SSE2__
+  for (; j + 16 <= WIDTH; j += 16) {
+    const __m128i VALUE = Op::apply(_mm_loadu_si128((const __m128i*)&A[j]),
+                                    _mm_loadu_si128((const __m128i*)&B[j]));
+
+    _mm_storeu_si128((__m128i*)&dest[j], VALUE);
+  }
+#endif
+
+  for (; j < WIDTH; j++) {
+    dest[j] = Op::apply(A[j], B[j]);
+  }
+}
+
+/**
+ * Returns the number of elements of a signal of the given length once it is
+ * padded with BEFORE identity elements on one side and SIZE - 1 - BEFORE on
+ * the other, and rounded up to a whole number of blocks of SIZE elements.
+ *
+ * @param LENGTH Length of the signal
+ * @param SIZE   Size of the window
+ * @returns      Length of the padded signal
+ */
+static int padLength(const int LENGTH, const int SIZE) {
+  return (LENGTH + SIZE - 1 + SIZE - 1) / SIZE * SIZE;
+}
+
+/**
+ * Applies the van Herk/Gil-Werman algorithm along each of the rows in the range
+ * [ROW_BEGIN, ROW_END). The padded row is split into blocks of WIDTH pixels.
+ * Within each block, a prefix g and a suffix h are accumulated with the
+ * operator, so that the result for any window of WIDTH pixels is
+ * h[first] op g[last], for about 3 comparisons per pixel.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for filtered image
+ * @param COLS      Number of columns in original image
+ * @param WIDTH     Width of the structuring element
+ * @param BEFORE    Number of pixels of the window to the left of its anchor
+ * @param ROW_BEGIN First row to filter
+ * @param ROW_END   Row after the last row to filter
+ */
+template <class Op>
+static void applyVanHerkRows(const unsigned char* SRC,
+                             unsigned char* dest,
+                             const int COLS,
+                             const int WIDTH,
+                             const int BEFORE,
+                             const int ROW_BEGIN,
+                             const int ROW_END) {
+  const int LENGTH = padLength(COLS, WIDTH);
+  std::vector<unsigned char> padded(LENGTH, Op::IDENTITY);
+  std::vector<unsigned char> g(LENGTH);
+  std::vector<unsigned char> h(LENGTH);
+
+  for (int i = ROW_BEGIN; i < ROW_END; i++) {
+    const unsigned char* ROW = &SRC[(long)COLS * i];
+
+    for (int j = 0; j < COLS; j++) {
+      padded[BEFORE + j] = ROW[j];
+    }
+
+    // Accumulate prefixes and suffixes within each block
+    for (int b = 0; b < LENGTH; b += WIDTH) {
+      g[b] = padded[b];
+      h[b + WIDTH - 1] = padded[b + WIDTH - 1];
+
+      for (int k = 1; k < WIDTH; k++) {
+        g[b + k] = Op::apply(g[b + k - 1], padded[b + k]);
+        h[b + WIDTH - 1 - k] =
+            Op::apply(h[b + WIDTH - k], padded[b + WIDTH - 1 - k]);
+      }
+    }
+
+    // The window of pixel j covers padded elements [j, j + WIDTH - 1]
+    unsigned char* out = &dest[(long)COLS * i];
+
+    for (int j = 0; j < COLS; j++) {
+      out[j] = Op::apply(h[j], g[j + WIDTH - 1]);
+    }
+  }
+}
+
+/**
+ * Applies the van Herk/Gil-Werman algorithm down the columns in the range
+ * [COL_BEGIN, COL_END). The algorithm is the same as for rows, but every step
+ * combines whole rows of the column band at once.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for filtered image
+ * @param ROWS      Number of rows in original image
+ * @param COLS      Number of columns in original image
+ * @param HEIGHT    Height of the structuring element
+ * @param BEFORE    Number of pixels of the window above its anchor
+ * @param COL_BEGIN First column to filter
+ * @param COL_END   Column after the last column to filter
+ */
+template <class Op>
+static void applyVanHerkColumns(const unsigned char* SRC,
+                                unsigned char* dest,
+                                const int ROWS,
+                                const int COLS,
+                                const int HEIGHT,
+                                const int BEFORE,
+                                const int COL_BEGIN,
+                                const int COL_END) {
+  const int LENGTH = padLength(ROWS, HEIGHT);
+  const int BAND = COL_END - COL_BEGIN;
+  const std::vector<unsigned char> IDENTITY(BAND, Op::IDENTITY);
+  Buffer<unsigned char> g((unsigned long)LENGTH * BAND);
+  Buffer<unsigned char> h((unsigned long)LENGTH * BAND);
+
+  // Returns padded row p of the column band
+  auto padded = [&](const int p) {
+    const int ROW = p - BEFORE;
+
+    return ROW >= 0 && ROW < ROWS ? &SRC[(long)COLS * ROW + COL_BEGIN]
+                                  : &IDENTITY[0];
+  };
+
+  // Accumulate prefixes and suffixes of rows within each block
+  for (int b = 0; b < LENGTH; b += HEIGHT) {
+    unsigned char* gFirst = &g.get()[(long)BAND * b];
+    unsigned char* hLast = &h.get()[(long)BAND * (b + HEIGHT - 1)];
+    const unsigned char* FIRST = padded(b);
+    const unsigned char* LAST = padded(b + HEIGHT - 1);
+
+    for (int j = 0; j < BAND; j++) {
+      gFirst[j] = FIRST[j];
+      hLast[j] = LAST[j];
+    }
+
+    for (int k = 1; k < HEIGHT; k++) {
+      combineRows<Op>(&g.get()[(long)BAND * (b + k - 1)], padded(b + k),
+                      &g.get()[(long)BAND * (b + k)], BAND);
+      combineRows<Op>(&h.get()[(long)BAND * (b + HEIGHT - k)],
+                      padded(b + HEIGHT - 1 - k),
+                      &h.get()[(long)BAND * (b + HEIGHT - 1 - k)], BAND);
+    }
+  }
+
+  // The window of row i covers padded rows [i, i + HEIGHT - 1]
+  for (int i = 0; i < ROWS; i++) {
+    combineRows<Op>(&h.get()[(long)BAND * i],
+                    &g.get()[(long)BAND * (i + HEIGHT - 1)],
+                    &dest[(long)COLS * i + COL_BEGIN], BAND);
+  }
+}
+
+/**
+ * Applies a flat rectangular structuring element of HEIGHT x WIDTH pixels with
+ * the given operator, separably along rows and then along columns. Windows are
+ * clipped at the border of the image.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for filtered image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param HEIGHT   Height of the structuring element
+ * @param WIDTH    Width of the structuring element
+ * @param REFLECT  Whether to anchor the element at its reflected center
+ * @param executor Executor that runs the bands
+ */
+template <class Op>
+static void applyRectangle(const unsigned char* SRC,
+                           unsigned char* dest,
+                           const int ROWS,
+                           const int COLS,
+                           const int HEIGHT,
+                           const int WIDTH,
+                           const bool REFLECT,
+                           parallel::Executor& executor) {
+  // Ensure that the structuring element is not empty
+  if (HEIGHT <= 0 || WIDTH <= 0) {
+    throw "ERROR: Structuring element must not be empty!";
+  }
+
+  // Number of pixels of the element above and to the left of its anchor. For
+  // even sizes, the reflected element has its extra pixel on the other side.
+  const int ABOVE = REFLECT ? HEIGHT / 2 : (HEIGHT - 1) / 2;
+  const int LEFT = REFLECT ? WIDTH / 2 : (WIDTH - 1) / 2;
+
+  Buffer<unsigned char> horizontal((unsigned long)ROWS * COLS);
+
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    applyVanHerkRows<Op>(SRC, horizontal.get(), COLS, WIDTH, LEFT, ROW_BEGIN,
+                         ROW_END);
+  });
+
+  executor.forEachBand(COLS, [&](const int COL_BEGIN, const int COL_END) {
+    applyVanHerkColumns<Op>(horizontal.get(), dest, ROWS, COLS, HEIGHT, ABOVE,
+                            COL_BEGIN, COL_END);
+  });
+}
+
+/**
+ * Produces a new image where every pixel is the minimum of the pixels under a
+ * flat rectangular structuring element of HEIGHT x WIDTH pixels centered on it,
+ * and outputs the result to the destination buffer. The cost per pixel does
+ * not depend on the size of the structuring element.
+ *
+ * @param SRC    Buffer containing original image
+ * @param dest   Destination buffer for eroded image
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param HEIGHT Height of the structuring element
+ * @param WIDTH  Width of the structuring element
+ */
+void applyErosion(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH) {
+  parallel::Executor serial(1);
+
+  applyErosion(SRC, dest, ROWS, COLS, HEIGHT, WIDTH, serial);
+}
+
+/**
+ * Produces the same image as applyErosion, processing bands of rows and then
+ * bands of columns in parallel on the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for eroded image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param HEIGHT   Height of the structuring element
+ * @param WIDTH    Width of the structuring element
+ * @param executor Executor that runs the bands
+ */
+void applyErosion(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH,
+                  parallel::Executor& executor) {
+  applyRectangle<MinOperator>(SRC, dest, ROWS, COLS, HEIGHT, WIDTH, false,
+                              executor);
+}
+
+/**
+ * Produces a new image where every pixel is the maximum of the pixels under a
+ * flat rectangular structuring element of HEIGHT x WIDTH pixels centered on it,
+ * and outputs the result to the destination buffer. For even sizes the element
+ * is reflected, so that dilation is the adjoint of applyErosion.
+ *
+ * @param SRC    Buffer containing original image
+ * @param dest   Destination buffer for dilated image
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param HEIGHT Height of the structuring element
+ * @param WIDTH  Width of the structuring element
+ */
+void applyDilation(const unsigned char* SRC,
+                   unsigned char* dest,
+                   const int ROWS,
+                   const int COLS,
+                   const int HEIGHT,
+                   const int WIDTH) {
+  parallel::Executor serial(1);
+
+  applyDilation(SRC, dest, ROWS, COLS, HEIGHT, WIDTH, serial);
+}
+
+/**
+ * Produces the same image as applyDilation, processing bands of rows and then
+ * bands of columns in parallel on the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for dilated image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param HEIGHT   Height of the structuring element
+ * @param WIDTH    Width of the structuring element
+ * @param executor Executor that runs the bands
+ */
+void applyDilation(const unsigned char* SRC,
+                   unsigned char* dest,
+                   const int ROWS,
+                   const int COLS,
+                   const int HEIGHT,
+                   const int WIDTH,
+                   parallel::Executor& executor) {
+  applyRectangle<MaxOperator>(SRC, dest, ROWS, COLS, HEIGHT, WIDTH, true,
+                              executor);
+}
+
+/**
+ * Produces the opening of the given image, an erosion followed by a dilation
+ * with the same rectangular structuring element. Opening removes bright
+ * details smaller than the structuring element.
+ *
+ * @param SRC    Buffer containing original image
+ * @param dest   Destination buffer for opened image
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param HEIGHT Height of the structuring element
+ * @param WIDTH  Width of the structuring element
+ */
+void applyOpening(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH) {
+  parallel::Executor serial(1);
+
+  applyOpening(SRC, dest, ROWS, COLS, HEIGHT, WIDTH, serial);
+}
+
+/**
+ * Produces the same image as applyOpening, running each step in parallel on
+ * the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for opened image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param HEIGHT   Height of the structuring element
+ * @param WIDTH    Width of the structuring element
+ * @param executor Executor that runs the bands
+ */
+void applyOpening(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH,
+                  parallel::Executor& executor) {
+  Buffer<unsigned char> eroded((unsigned long)ROWS * COLS);
+
+  applyErosion(SRC, eroded.get(), ROWS, COLS, HEIGHT, WIDTH, executor);
+  applyDilation(eroded.get(), dest, ROWS, COLS, HEIGHT, WIDTH, executor);
+}
+
+/**
+ * Produces the closing of the given image, a dilation followed by an erosion
+ * with the same rectangular structuring element. Closing removes dark details
+ * smaller than the structuring element.
+ *
+ * @param SRC    Buffer containing original image
+ * @param dest   Destination buffer for closed image
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param HEIGHT Height of the structuring element
+ * @param WIDTH  Width of the structuring element
+ */
+void applyClosing(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH) {
+  parallel::Executor serial(1);
+
+  applyClosing(SRC, dest, ROWS, COLS, HEIGHT, WIDTH, serial);
+}
+
+/**
+ * Produces the same image as applyClosing, running each step in parallel on
+ * the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for closed image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param HEIGHT   Height of the structuring element
+ * @param WIDTH    Width of the structuring element
+ * @param executor Executor that runs the bands
+ */
+void applyClosing(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH,
+                  parallel::Executor& executor) {
+  Buffer<unsigned char> dilated((unsigned long)ROWS * COLS);
+
+  applyDilation(SRC, dilated.get(), ROWS, COLS, HEIGHT, WIDTH, executor);
+  applyErosion(dilated.get(), dest, ROWS, COLS, HEIGHT, WIDTH, executor);
+}
+
+/**
+ * Produces the white top-hat of the given image, the difference between the
+ * image and its opening. The result keeps the bright details that are smaller
+ * than the structuring element.
+ *
+ * @param SRC    Buffer containing original image
+ * @param dest   Destination buffer for top-hat image
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param HEIGHT Height of the structuring element
+ * @param WIDTH  Width of the structuring element
+ */
+void applyTopHat(const unsigned char* SRC,
+                 unsigned char* dest,
+                 const int ROWS,
+                 const int COLS,
+                 const int HEIGHT,
+                 const int WIDTH) {
+  parallel::Executor serial(1);
+
+  applyTopHat(SRC, dest, ROWS, COLS, HEIGHT, WIDTH, serial);
+}
+
+/**
+ * Produces the same image as applyTopHat, running each step in parallel on the
+ * given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for top-hat image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param HEIGHT   Height of the structuring element
+ * @param WIDTH    Width of the structuring element
+ * @param executor Executor that runs the bands
+ */
+void applyTopHat(const unsigned char* SRC,
+                 unsigned char* dest,
+                 const int ROWS,
+                 const int COLS,
+                 const int HEIGHT,
+                 const int WIDTH,
+                 parallel::Executor& executor) {
+  applyOpening(SRC, dest, ROWS, COLS, HEIGHT, WIDTH, executor);
+
+  // The opening is never brighter than the image
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    for (long i = (long)COLS * ROW_BEGIN; i < (long)COLS * ROW_END; i++) {
+      dest[i] = SRC[i] - dest[i];
+    }
+  });
+}
+
+/**
+ * Produces the black top-hat of the given image, the difference between the
+ * closing of the image and the image. The result keeps the dark details that
+ * are smaller than the structuring element.
+ *
+ * @param SRC    Buffer containing original image
+ * @param dest   Destination buffer for bottom-hat image
+ * @param ROWS   Number of rows in original image
+ * @param COLS   Number of columns in original image
+ * @param HEIGHT Height of the structuring element
+ * @param WIDTH  Width of the structuring element
+ */
+void applyBottomHat(const unsigned char* SRC,
+                    unsigned char* dest,
+                    const int ROWS,
+                    const int COLS,
+                    const int HEIGHT,
+                    const int WIDTH) {
+  parallel::Executor serial(1);
+
+  applyBottomHat(SRC, dest, ROWS, COLS, HEIGHT, WIDTH, serial);
+}
+
+/**
+ * Produces the same image as applyBottomHat, running each step in parallel on
+ * the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for bottom-hat image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param HEIGHT   Height of the structuring element
+ * @param WIDTH    Width of the structuring element
+ * @param executor Executor that runs the bands
+ */
+void applyBottomHat(const unsigned char* SRC,
+                    unsigned char* dest,
+                    const int ROWS,
+                    const int COLS,
+                    const int HEIGHT,
+                    const int WIDTH,
+                    parallel::Executor& executor) {
+  applyClosing(SRC, dest, ROWS, COLS, HEIGHT, WIDTH, executor);
+
+  // The closing is never darker than the image
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    for (long i = (long)COLS * ROW_BEGIN; i < (long)COLS * ROW_END; i++) {
+      dest[i] = dest[i] - SRC[i];
+    }
+  });
+}
+
+}  // namespace image
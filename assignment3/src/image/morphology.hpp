@@ -0,0 +1,100 @@
+#ifndef IMAGE_MORPHOLOGY_H
+#define IMAGE_MORPHOLOGY_H
+
+#include "../parallel/executor.hpp"
+
+namespace image {
+
+void applyErosion(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH);
+
+void applyErosion(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH,
+                  parallel::Executor& executor);
+
+void applyDilation(const unsigned char* SRC,
+                   unsigned char* dest,
+                   const int ROWS,
+                   const int COLS,
+                   const int HEIGHT,
+                   const int WIDTH);
+
+void applyDilation(const unsigned char* SRC,
+                   unsigned char* dest,
+                   const int ROWS,
+                   const int COLS,
+                   const int HEIGHT,
+                   const int WIDTH,
+                   parallel::Executor& executor);
+
+void applyOpening(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH);
+
+void applyOpening(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH,
+                  parallel::Executor& executor);
+
+void applyClosing(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH);
+
+void applyClosing(const unsigned char* SRC,
+                  unsigned char* dest,
+                  const int ROWS,
+                  const int COLS,
+                  const int HEIGHT,
+                  const int WIDTH,
+                  parallel::Executor& executor);
+
+void applyTopHat(const unsigned char* SRC,
+                 unsigned char* dest,
+                 const int ROWS,
+                 const int COLS,
+                 const int HEIGHT,
+                 const int WIDTH);
+
+void applyTopHat(const unsigned char* SRC,
+                 unsigned char* dest,
+                 const int ROWS,
+                 const int COLS,
+                 const int HEIGHT,
+                 const int WIDTH,
+                 parallel::Executor& executor);
+
+void applyBottomHat(const unsigned char* SRC,
+                    unsigned char* dest,
+                    const int ROWS,
+                    const int COLS,
+                    const int HEIGHT,
+                    const int WIDTH);
+
+void applyBottomHat(const unsigned char* SRC,
+                    unsigned char* dest,
+                    const int ROWS,
+                    const int COLS,
+                    const int HEIGHT,
+                    const int WIDTH,
+                    parallel::Executor& executor);
+
+}  // namespace image
+
+#endif  // IMAGE_MORPHOLOGY_H
@@ -0,0 +1,335 @@
+#include "pipeline.hpp"
+
+#include <algorithm>
+#include <mutex>
+
+namespace image {
+
+/**
+ * Returns the identity lookup table.
+ *
+ * @returns Table mapping every grey level to itself
+ */
+static std::vector<unsigned char> genIdentityTable() {
+  std::vector<unsigned char> table(LEVELS);
+
+  for (int i = 0; i < LEVELS; i++) {
+    table[i] = i;
+  }
+
+  return table;
+}
+
+/**
+ * Creates an empty pipeline for images of the given dimensions, which copies
+ * its source to its destination.
+ *
+ * @param ROWS Number of rows in image
+ * @param COLS Number of columns in image
+ */
+Pipeline::Pipeline(const int ROWS, const int COLS)
+    : rows(ROWS), cols(COLS), inputTable(genIdentityTable()) {}
+
+/**
+ * Appends a filter stage with an identity table to the pipeline.
+ *
+ * @param STAGE Filter to append
+ */
+void Pipeline::addFilter(const Stage& STAGE) {
+  stages.push_back(STAGE);
+  stages.back().table = genIdentityTable();
+}
+
+/**
+ * Appends applyLinearFilter with the given mask to the pipeline.
+ *
+ * @param MASK Mask or filter to scan through the image with
+ * @returns    This pipeline
+ */
+Pipeline& Pipeline::addLinearFilter(const double MASK[MASK_SIZE][MASK_SIZE]) {
+  Stage stage = {STREAM_LINEAR, {}, MASK_SIZE_HALF, 0, {}};
+
+  for (int k = 0; k < MASK_SIZE; k++) {
+    for (int l = 0; l < MASK_SIZE; l++) {
+      stage.mask[k][l] = MASK[k][l];
+    }
+  }
+
+  addFilter(stage);
+
+  return *this;
+}
+
+/**
+ * Appends applyMedianFilter with the given radius to the pipeline.
+ *
+ * @param RADIUS Radius of the window
+ * @returns      This pipeline
+ */
+Pipeline& Pipeline::addMedianFilter(const int RADIUS) {
+  // Ensure that the window has a valid size
+  if (RADIUS < 0) {
+    throw "ERROR: Median filter radius must not be negative!";
+  }
+
+  addFilter({STREAM_MEDIAN, {}, RADIUS, 0, {}});
+
+  return *this;
+}
+
+/**
+ * Appends genGradient to the pipeline.
+ *
+ * @returns This pipeline
+ */
+Pipeline& Pipeline::addGradient() {
+  addFilter({STREAM_GRADIENT, {}, MASK_SIZE_HALF, 0, {}});
+
+  return *this;
+}
+
+/**
+ * Appends applyLaplaceSharpening with the given weight to the pipeline.
+ *
+ * @param WEIGHT Weight w of the Laplacian
+ * @returns      This pipeline
+ */
+Pipeline& Pipeline::addLaplaceSharpening(const double WEIGHT) {
+  addFilter({STREAM_LAPLACE_SHARPENING, {}, MASK_SIZE_HALF, WEIGHT, {}});
+
+  return *this;
+}
+
+/**
+ * Appends a point operation that maps every grey level through the given
+ * table. Consecutive point operations are composed into a single table, so
+ * they cost one lookup per pixel.
+ *
+ * @param TABLE New grey level of each grey level
+ * @returns     This pipeline
+ */
+Pipeline& Pipeline::addLookupTable(const unsigned char TABLE[LEVELS]) {
+  std::vector<unsigned char>& table =
+      stages.empty() ? inputTable : stages.back().table;
+
+  for (int i = 0; i < LEVELS; i++) {
+    table[i] = TABLE[table[i]];
+  }
+
+  return *this;
+}
+
+/**
+ * Appends the given point operation to the pipeline.
+ *
+ * @param OP Point operation
+ * @returns  This pipeline
+ */
+Pipeline& Pipeline::addPointOp(const PointOp& OP) {
+  return addLookupTable(OP.getTable());
+}
+
+/**
+ * Appends applyThreshold with the given levels and threshold to the pipeline.
+ *
+ * @param NEW_LOW   New value for pixels with intensities below threshold
+ * @param NEW_HIGH  New value for pixels with intensities greater than or equal
+ *                  to the threshold value
+ * @param THRESHOLD Chosen threshold intensity value
+ * @returns         This pipeline
+ */
+Pipeline& Pipeline::addThreshold(const unsigned char NEW_LOW,
+                                 const unsigned char NEW_HIGH,
+                                 const unsigned char THRESHOLD) {
+  return addPointOp(PointOp::genThreshold(NEW_LOW, NEW_HIGH, THRESHOLD));
+}
+
+/**
+ * Returns the number of rows above and below an output row of the pipeline
+ * that it depends on, which is the sum of the radii of its filters.
+ *
+ * @returns Number of halo rows
+ */
+int Pipeline::getHalo() const {
+  int halo = 0;
+
+  for (const Stage& STAGE : stages) {
+    halo += STAGE.radius;
+  }
+
+  return halo;
+}
+
+/**
+ * Runs the pipeline for the output rows in the range [ROW_BEGIN, ROW_END). The
+ * rows of the band and up to getHalo() rows above and below it are streamed
+ * through a chain of stream filters. Halo rows that are not at the border of
+ * the image are filtered as if they were, but the error only reaches as far as
+ * the halo, so it never reaches the rows of the band.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for the output image, or null
+ * @param histogram Histogram to add the output rows to, or null
+ * @param ROW_BEGIN First row to output
+ * @param ROW_END   Row after the last row to output
+ */
+void Pipeline::runRows(const unsigned char* SRC,
+                       unsigned char* dest,
+                       int histogram[],
+                       const int ROW_BEGIN,
+                       const int ROW_END) const {
+  const int HALO = getHalo();
+  const int FIRST = std::max(ROW_BEGIN - HALO, 0);
+  const int LAST = std::min(ROW_END + HALO, rows);
+  const int COUNT = stages.size();
+
+  // Output rows of the last stage, and of every other stage after their point
+  // operations are applied
+  StreamFilter::RowSink output = [&](const int ROW,
+                                     const unsigned char* PIXELS) {
+    const int I = FIRST + ROW;
+
+    if (I < ROW_BEGIN || I >= ROW_END) {
+      return;
+    }
+
+    const std::vector<unsigned char>& TABLE =
+        COUNT == 0 ? inputTable : stages[COUNT - 1].table;
+
+    for (int j = 0; j < cols; j++) {
+      const unsigned char PIXEL = TABLE[PIXELS[j]];
+
+      if (dest != nullptr) {
+        dest[(long)cols * I + j] = PIXEL;
+      }
+
+      if (histogram != nullptr) {
+        histogram[PIXEL]++;
+      }
+    }
+  };
+
+  // Build the chain from the last filter to the first, so that each sink can
+  // refer to the next filter. The filters are stored in that order, and the
+  // reserved capacity keeps their addresses fixed.
+  std::vector<StreamFilter> filters;
+  std::vector<unsigned char> scratch((long)COUNT * cols);
+  filters.reserve(COUNT);
+
+  for (int k = COUNT - 1; k >= 0; k--) {
+    const Stage& STAGE = stages[k];
+    StreamFilter::RowSink sink = output;
+
+    if (k < COUNT - 1) {
+      StreamFilter* next = &filters.back();
+      unsigned char* row = &scratch[(long)cols * k];
+
+      sink = [&, next, row, k](const int, const unsigned char* PIXELS) {
+        for (int j = 0; j < cols; j++) {
+          row[j] = stages[k].table[PIXELS[j]];
+        }
+
+        next->pushRow(row);
+      };
+    }
+
+    switch (STAGE.operation) {
+      case STREAM_LINEAR:
+        filters.push_back(
+            StreamFilter::genLinearFilter(cols, STAGE.mask, sink));
+        break;
+      case STREAM_MEDIAN:
+        filters.push_back(
+            StreamFilter::genMedianFilter(cols, STAGE.radius, sink));
+        break;
+      case STREAM_GRADIENT:
+        filters.push_back(StreamFilter::genGradient(cols, sink));
+        break;
+      case STREAM_LAPLACE_SHARPENING:
+        filters.push_back(
+            StreamFilter::genLaplaceSharpening(cols, STAGE.weight, sink));
+        break;
+    }
+  }
+
+  // Feed the source rows to the first filter after the point operations that
+  // come before it
+  std::vector<unsigned char> row(cols);
+
+  for (int i = FIRST; i < LAST; i++) {
+    const unsigned char* PIXELS = &SRC[(long)cols * i];
+
+    if (COUNT == 0) {
+      output(i - FIRST, PIXELS);
+      continue;
+    }
+
+    for (int j = 0; j < cols; j++) {
+      row[j] = inputTable[PIXELS[j]];
+    }
+
+    filters.back().pushRow(&row[0]);
+  }
+
+  // Flush the filters from the first to the last, each finish passing the
+  // bottom rows on to the next filter before it is finished itself
+  for (int k = COUNT - 1; k >= 0; k--) {
+    filters[k].finish();
+  }
+}
+
+/**
+ * Runs the pipeline over the given image, writing the output image and adding
+ * up its histogram.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for the output image, or null
+ * @param histogram Destination buffer for the histogram of the output image,
+ *                  or null
+ */
+void Pipeline::run(const unsigned char* SRC,
+                   unsigned char* dest,
+                   int histogram[]) {
+  parallel::Executor serial(1);
+
+  run(SRC, dest, histogram, serial);
+}
+
+/**
+ * Runs the pipeline over the given image in bands of rows that are processed
+ * in parallel by the given executor. Each band keeps its own histogram, and
+ * the histograms are summed once the band is done.
+ *
+ * @param SRC       Buffer containing original image
+ * @param dest      Destination buffer for the output image, or null
+ * @param histogram Destination buffer for the histogram of the output image,
+ *                  or null
+ * @param executor  Executor that runs the bands
+ */
+void Pipeline::run(const unsigned char* SRC,
+                   unsigned char* dest,
+                   int histogram[],
+                   parallel::Executor& executor) {
+  std::mutex mutex;
+
+  if (histogram != nullptr) {
+    std::fill(histogram, histogram + LEVELS, 0);
+  }
+
+  executor.forEachBand(rows, [&](const int ROW_BEGIN, const int ROW_END) {
+    int bandHistogram[LEVELS] = {};
+
+    runRows(SRC, dest, histogram != nullptr ? bandHistogram : nullptr,
+            ROW_BEGIN, ROW_END);
+
+    if (histogram != nullptr) {
+      std::lock_guard<std::mutex> lock(mutex);
+
+      for (int i = 0; i < LEVELS; i++) {
+        histogram[i] += bandHistogram[i];
+      }
+    }
+  });
+}
+
+}  // namespace image
@@ -0,0 +1,81 @@
+#ifndef IMAGE_PIPELINE_H
+#define IMAGE_PIPELINE_H
+
+#include <vector>
+
+#include "../parallel/executor.hpp"
+#include "filter.hpp"
+#include "image.hpp"
+#include "pointop.hpp"
+
+namespace image {
+
+/**
+ * Chain of filters and point operations that is run over an image in bands of
+ * rows, instead of one whole-image pass per operation. Each band streams its
+ * rows, and the halo rows around it that the filters need, through all of the
+ * operations, so intermediate images only ever hold a few rows and the source
+ * and destination are each swept once.
+ */
+class Pipeline {
+ public:
+  Pipeline(const int ROWS, const int COLS);
+
+  Pipeline& addLinearFilter(const double MASK[MASK_SIZE][MASK_SIZE]);
+
+  Pipeline& addMedianFilter(const int RADIUS);
+
+  Pipeline& addGradient();
+
+  Pipeline& addLaplaceSharpening(const double WEIGHT);
+
+  Pipeline& addLookupTable(const unsigned char TABLE[LEVELS]);
+
+  Pipeline& addPointOp(const PointOp& OP);
+
+  Pipeline& addThreshold(const unsigned char NEW_LOW,
+                         const unsigned char NEW_HIGH,
+                         const unsigned char THRESHOLD);
+
+  int getHalo() const;
+
+  void run(const unsigned char* SRC, unsigned char* dest, int histogram[]);
+
+  void run(const unsigned char* SRC,
+           unsigned char* dest,
+           int histogram[],
+           parallel::Executor& executor);
+
+ private:
+  struct Stage;
+
+  void addFilter(const Stage& STAGE);
+
+  void runRows(const unsigned char* SRC,
+               unsigned char* dest,
+               int histogram[],
+               const int ROW_BEGIN,
+               const int ROW_END) const;
+
+  int rows;
+  int cols;
+  // Point operations applied to the source, composed into one table
+  std::vector<unsigned char> inputTable;
+  std::vector<Stage> stages;
+};
+
+/**
+ * Filter of a pipeline, followed by the point operations applied to its output
+ * composed into one table.
+ */
+struct Pipeline::Stage {
+  StreamOperation operation;
+  double mask[MASK_SIZE][MASK_SIZE];
+  int radius;
+  double weight;
+  std::vector<unsigned char> table;
+};
+
+}  // namespace image
+
+#endif  // IMAGE_PIPELINE_H
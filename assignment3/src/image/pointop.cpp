@@ -0,0 +1,484 @@
+#include "pointop.hpp"
+
+// The SIMD table lookups are compiled for AVX2 and SSSE3 regardless of the
+// compiler flags, and chosen at run time by what the processor supports
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define POINTOP_SIMD
+#include <immintrin.h>
+#endif
+
+#include <cmath>
+
+#include "histogram.hpp"
+
+namespace image {
+
+// Number of grey levels in each sub-table of a SIMD table lookup
+const int SUBTABLE_SIZE = 16;
+// Number of sub-tables, and number of sub-tables in each half of the table
+const int SUBTABLE_COUNT = LEVELS / SUBTABLE_SIZE;
+const int SUBTABLE_HALF = SUBTABLE_COUNT / 2;
+
+/**
+ * Creates the identity point operation, which maps every grey level to itself.
+ */
+PointOp::PointOp() {
+  for (int i = 0; i < LEVELS; i++) {
+    table[i] = i;
+  }
+}
+
+/**
+ * Creates a point operation from a table of the new grey level of each grey
+ * level.
+ *
+ * @param TABLE New grey level of each grey level
+ * @returns     Point operation
+ */
+PointOp PointOp::genTable(const unsigned char TABLE[LEVELS]) {
+  PointOp op;
+
+  for (int i = 0; i < LEVELS; i++) {
+    op.table[i] = TABLE[i];
+  }
+
+  return op;
+}
+
+/**
+ * Creates a point operation that maps pixels with an intensity lower than the
+ * threshold to NEW_LOW, and all other pixels to NEW_HIGH.
+ *
+ * @param NEW_LOW   New value for pixels with intensities below threshold
+ * @param NEW_HIGH  New value for pixels with intensities greater than or equal
+ *                  to the threshold value
+ * @param THRESHOLD Chosen threshold intensity value
+ * @returns         Point operation
+ */
+PointOp PointOp::genThreshold(const unsigned char NEW_LOW,
+                              const unsigned char NEW_HIGH,
+                              const unsigned char THRESHOLD) {
+  PointOp op;
+
+  for (int i = 0; i < LEVELS; i++) {
+    op.table[i] = i < THRESHOLD ? NEW_LOW : NEW_HIGH;
+  }
+
+  return op;
+}
+
+/**
+ * Creates a point operation that reduces the quantization of pixels by
+ * unsetting their N lowest order bits.
+ *
+ * @param UNSET_BIT_COUNT Number of lowest order bits to unset
+ * @returns               Point operation
+ */
+PointOp PointOp::genQuantization(const int UNSET_BIT_COUNT) {
+  // Ensure that no more bits are unset than are available in a character
+  if (UNSET_BIT_COUNT < 0 || UNSET_BIT_COUNT >= 8) {
+    throw "ERROR: Bit position out of range!";
+  }
+
+  PointOp op;
+
+  for (int i = 0; i < LEVELS; i++) {
+    op.table[i] = i & ~((1 << UNSET_BIT_COUNT) - 1);
+  }
+
+  return op;
+}
+
+/**
+ * Creates a point operation that equalizes an image with the given histogram.
+ * Each grey level is mapped to its cumulative frequency scaled by
+ * S = (K - 1) / (M * N), where M * N is the total of the histogram.
+ *
+ * @param HISTOGRAM Histogram of the image to equalize
+ * @returns         Point operation
+ */
+PointOp PointOp::genEqualization(const int HISTOGRAM[]) {
+  PointOp op;
+  long total = 0;
+
+  for (int i = 0; i < LEVELS; i++) {
+    total += HISTOGRAM[i];
+  }
+
+  // An empty histogram has nothing to equalize
+  if (total == 0) {
+    return op;
+  }
+
+  const double S = (double)(LEVELS - 1) / total;
+  long cumulative = 0;
+
+  for (int i = 0; i < LEVELS; i++) {
+    cumulative += HISTOGRAM[i];
+    op.table[i] = (int)(cumulative * S);
+  }
+
+  return op;
+}
+
+/**
+ * Creates a point operation that matches the histogram of an image to a
+ * reference histogram. Each grey level is mapped to the lowest reference level
+ * whose normalized cumulative frequency is at least that of the grey level,
+ * which inverts the cumulative histogram of the reference. Both cumulative
+ * histograms are compared by cross-multiplication, so the histograms may have
+ * different totals and no rounding is involved.
+ *
+ * @param HISTOGRAM Histogram of the image to match
+ * @param REFERENCE Reference histogram to match it to
+ * @returns         Point operation
+ */
+PointOp PointOp::genMatching(const int HISTOGRAM[], const int REFERENCE[]) {
+  int cumulative[LEVELS];
+  int referenceCumulative[LEVELS];
+
+  genCumulativeHistogram(HISTOGRAM, cumulative);
+  genCumulativeHistogram(REFERENCE, referenceCumulative);
+
+  const long long TOTAL = cumulative[LEVELS - 1];
+  const long long REFERENCE_TOTAL = referenceCumulative[LEVELS - 1];
+
+  if (REFERENCE_TOTAL == 0) {
+    throw "ERROR: Reference histogram is empty!";
+  }
+
+  PointOp op;
+  int level = 0;
+
+  // Both cumulative histograms increase, so the reference level only ever
+  // moves forward
+  for (int i = 0; i < LEVELS; i++) {
+    const long long TARGET = cumulative[i] * REFERENCE_TOTAL;
+
+    while (level < LEVELS - 1 && referenceCumulative[level] * TOTAL < TARGET) {
+      level++;
+    }
+
+    op.table[i] = level;
+  }
+
+  return op;
+}
+
+/**
+ * Creates a point operation that applies gamma correction, mapping each grey
+ * level r to (K - 1) * (r / (K - 1)) ^ GAMMA rounded to the nearest level.
+ *
+ * @param GAMMA Exponent of the correction, must be positive
+ * @returns     Point operation
+ */
+PointOp PointOp::genGamma(const double GAMMA) {
+  if (GAMMA <= 0) {
+    throw "ERROR: Gamma must be positive!";
+  }
+
+  PointOp op;
+
+  for (int i = 0; i < LEVELS; i++) {
+    const double CORRECTED = std::pow((double)i / LEVEL_WHITE, GAMMA);
+
+    op.table[i] = (int)(LEVEL_WHITE * CORRECTED + 0.5);
+  }
+
+  return op;
+}
+
+/**
+ * Creates a point operation that inverts grey levels, producing the negative
+ * of an image.
+ *
+ * @returns Point operation
+ */
+PointOp PointOp::genInversion() {
+  PointOp op;
+
+  for (int i = 0; i < LEVELS; i++) {
+    op.table[i] = LEVEL_WHITE - i;
+  }
+
+  return op;
+}
+
+/**
+ * Creates a point operation that linearly stretches the grey levels in
+ * [LOW, HIGH] to the full range of grey levels. Levels below LOW become
+ * LEVEL_BLACK, and levels above HIGH become LEVEL_WHITE.
+ *
+ * @param LOW  Grey level that is mapped to LEVEL_BLACK
+ * @param HIGH Grey level that is mapped to LEVEL_WHITE
+ * @returns    Point operation
+ */
+PointOp PointOp::genContrastStretch(const unsigned char LOW,
+                                    const unsigned char HIGH) {
+  if (LOW >= HIGH) {
+    throw "ERROR: Contrast stretch needs LOW < HIGH!";
+  }
+
+  PointOp op;
+
+  for (int i = 0; i < LEVELS; i++) {
+    if (i <= LOW) {
+      op.table[i] = LEVEL_BLACK;
+    } else if (i >= HIGH) {
+      op.table[i] = LEVEL_WHITE;
+    } else {
+      op.table[i] = (LEVEL_WHITE * (i - LOW) + (HIGH - LOW) / 2) / (HIGH - LOW);
+    }
+  }
+
+  return op;
+}
+
+/**
+ * Returns the point operation that applies this operation followed by the
+ * given operation.
+ *
+ * @param NEXT Operation to apply to the output of this operation
+ * @returns    Composed point operation
+ */
+PointOp PointOp::then(const PointOp& NEXT) const {
+  PointOp op;
+
+  for (int i = 0; i < LEVELS; i++) {
+    op.table[i] = NEXT.table[table[i]];
+  }
+
+  return op;
+}
+
+/**
+ * Returns the table of the new grey level of each grey level.
+ *
+ * @returns Table of LEVELS entries
+ */
+const unsigned char* PointOp::getTable() const {
+  return table;
+}
+
+#ifdef POINTOP_SIMD
+/**
+ * Returns sub-table K of the given table for a SIMD table lookup. Lookups
+ * shuffle the sub-tables of each half of the table in order, with indices
+ * that are lowered by 16 after every sub-table. A shuffle outputs 0 wherever
+ * the index is negative, so a pixel in sub-table H receives the outputs of the
+ * sub-tables from the start of its half up to H. Storing each sub-table XORed
+ * with the previous one of its half makes those outputs XOR to the entry of
+ * the pixel.
+ *
+ * @param TABLE Table of LEVELS entries, aligned to 16 bytes
+ * @param K     Index of the sub-table
+ * @returns     Sub-table of SUBTABLE_SIZE entries
+ */
+__attribute__((target("ssse3"))) static __m128i loadSubtable(
+    const unsigned char TABLE[LEVELS],
+    const int K) {
+  const __m128i ENTRIES =
+      _mm_load_si128((const __m128i*)&TABLE[SUBTABLE_SIZE * K]);
+
+  if (K % SUBTABLE_HALF == 0) {
+    return ENTRIES;
+  }
+
+  return _mm_xor_si128(
+      ENTRIES,
+      _mm_load_si128((const __m128i*)&TABLE[SUBTABLE_SIZE * (K - 1)]));
+}
+
+/**
+ * Maps pixels through the given table 32 at a time with AVX2, as described at
+ * applyTable, and returns the number of pixels that were mapped.
+ *
+ * @param TABLE Table of LEVELS entries, aligned to 16 bytes
+ * @param SRC   Buffer containing pixels
+ * @param dest  Destination buffer for mapped pixels
+ * @param COUNT Number of pixels
+ * @returns     Number of pixels mapped, a multiple of 32
+ */
+__attribute__((target("avx2"))) static long applyTableAvx2(
+    const unsigned char TABLE[LEVELS],
+    const unsigned char* SRC,
+    unsigned char* dest,
+    const long COUNT) {
+  const __m256i STEP = _mm256_set1_epi8(SUBTABLE_SIZE);
+  const __m256i HIGH_BIT = _mm256_set1_epi8((char)0x80);
+  __m256i subtables[SUBTABLE_COUNT];
+  long i = 0;
+
+  for (int k = 0; k < SUBTABLE_COUNT; k++) {
+    subtables[k] = _mm256_broadcastsi128_si256(loadSubtable(TABLE, k));
+  }
+
+  for (; i + 32 <= COUNT; i += 32) {
+    const __m256i PIXELS = _mm256_loadu_si256((const __m256i*)&SRC[i]);
+    __m256i lowIndex = PIXELS;
+    __m256i highIndex = _mm256_xor_si256(PIXELS, HIGH_BIT);
+    __m256i low = _mm256_setzero_si256();
+    __m256i high = _mm256_setzero_si256();
+
+    for (int k = 0; k < SUBTABLE_HALF; k++) {
+      low = _mm256_xor_si256(low, _mm256_shuffle_epi8(subtables[k], lowIndex));
+      high = _mm256_xor_si256(
+          high, _mm256_shuffle_epi8(subtables[SUBTABLE_HALF + k], highIndex));
+      lowIndex = _mm256_sub_epi8(lowIndex, STEP);
+      highIndex = _mm256_sub_epi8(highIndex, STEP);
+    }
+
+    _mm256_storeu_si256((__m256i*)&dest[i],
+                        _mm256_blendv_epi8(low, high, PIXELS));
+  }
+
+  return i;
+}
+
+/**
+ * Maps pixels through the given table 16 at a time with SSSE3, as described at
+ * applyTable, and returns the number of pixels that were mapped.
+ *
+ * @param TABLE Table of LEVELS entries, aligned to 16 bytes
+ * @param SRC   Buffer containing pixels
+ * @param dest  Destination buffer for mapped pixels
+ * @param COUNT Number of pixels
+ * @returns     Number of pixels mapped, a multiple of 16
+ */
+__attribute__((target("ssse3"))) static long applyTableSsse3(
+    const unsigned char TABLE[LEVELS],
+    const unsigned char* SRC,
+    unsigned char* dest,
+    const long COUNT) {
+  const __m128i STEP = _mm_set1_epi8(SUBTABLE_SIZE);
+  const __m128i HIGH_BIT = _mm_set1_epi8((char)0x80);
+  __m128i subtables[SUBTABLE_COUNT];
+  long i = 0;
+
+  for (int k = 0; k < SUBTABLE_COUNT; k++) {
+    subtables[k] = loadSubtable(TABLE, k);
+  }
+
+  for (; i + 16 <= COUNT; i += 16) {
+    const __m128i PIXELS = _mm_loadu_si128((const __m128i*)&SRC[i]);
+    const __m128i IS_HIGH = _mm_cmplt_epi8(PIXELS, _mm_setzero_si128());
+    __m128i lowIndex = PIXELS;
+    __m128i highIndex = _mm_xor_si128(PIXELS, HIGH_BIT);
+    __m128i low = _mm_setzero_si128();
+    __m128i high = _mm_setzero_si128();
+
+    for (int k = 0; k < SUBTABLE_HALF; k++) {
+      low = _mm_xor_si128(low, _mm_shuffle_epi8(subtables[k], lowIndex));
+      high = _mm_xor_si128(
+          high, _mm_shuffle_epi8(subtables[SUBTABLE_HALF + k], highIndex));
+      lowIndex = _mm_sub_epi8(lowIndex, STEP);
+      highIndex = _mm_sub_epi8(highIndex, STEP);
+    }
+
+    _mm_storeu_si128(
+        (__m128i*)&dest[i],
+        _mm_or_si128(_mm_and_si128(IS_HIGH, high),
+                     _mm_andnot_si128(IS_HIGH, low)));
+  }
+
+  return i;
+}
+
+// Instruction sets that a table lookup can use
+enum SimdLevel { SIMD_NONE, SIMD_SSSE3, SIMD_AVX2 };
+
+/**
+ * Returns the widest instruction set for table lookups that the processor
+ * supports.
+ *
+ * @returns Supported instruction set
+ */
+static SimdLevel getSimdLevel() {
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx2")) {
+    return SIMD_AVX2;
+  }
+
+  if (__builtin_cpu_supports("ssse3")) {
+    return SIMD_SSSE3;
+  }
+
+  return SIMD_NONE;
+}
+#endif
+
+/**
+ * Maps COUNT pixels through the given table. On processors with AVX2 or
+ * SSSE3, 32 or 16 pixels are looked up at a time by byte shuffles of the 16
+ * sub-tables of 16 entries, as described at loadSubtable. The two halves of
+ * the table are looked up separately and the result is selected by the
+ * highest bit of each pixel.
+ *
+ * @param TABLE Table of LEVELS entries, aligned to 16 bytes
+ * @param SRC   Buffer containing pixels
+ * @param dest  Destination buffer for mapped pixels
+ * @param COUNT Number of pixels
+ */
+static void applyTable(const unsigned char TABLE[LEVELS],
+                       const unsigned char* SRC,
+                       unsigned char* dest,
+                       const long COUNT) {
+  long i = 0;
+
+#ifdef POINTOP_SIMD
+  static const SimdLevel LEVEL = getSimdLevel();
+
+  if (LEVEL == SIMD_AVX2) {
+    i = applyTableAvx2(TABLE, SRC, dest, COUNT);
+  } else if (LEVEL == SIMD_SSSE3) {
+    i = applyTableSsse3(TABLE, SRC, dest, COUNT);
+  }
+#endif
+
+  // Map the remaining pixels
+  for (; i < COUNT; i++) {
+    dest[i] = TABLE[SRC[i]];
+  }
+}
+
+/**
+ * Applies the point operation to every pixel of the given image, outputting
+ * the result to the destination buffer. The destination may be the source.
+ *
+ * @param SRC  Buffer containing original image
+ * @param dest Destination buffer for mapped image
+ * @param ROWS Number of rows in original image
+ * @param COLS Number of columns in original image
+ */
+void PointOp::apply(const unsigned char* SRC,
+                    unsigned char* dest,
+                    const int ROWS,
+                    const int COLS) const {
+  applyTable(table, SRC, dest, (long)ROWS * COLS);
+}
+
+/**
+ * Produces the same image as PointOp::apply, mapping bands of rows in parallel
+ * with the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for mapped image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param executor Executor that maps the bands
+ */
+void PointOp::apply(const unsigned char* SRC,
+                    unsigned char* dest,
+                    const int ROWS,
+                    const int COLS,
+                    parallel::Executor& executor) const {
+  executor.forEachBand(ROWS, [&](const int ROW_BEGIN, const int ROW_END) {
+    const long BEGIN = (long)COLS * ROW_BEGIN;
+
+    applyTable(table, &SRC[BEGIN], &dest[BEGIN],
+               (long)COLS * (ROW_END - ROW_BEGIN));
+  });
+}
+
+}  // namespace image
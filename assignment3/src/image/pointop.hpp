@@ -0,0 +1,61 @@
+#ifndef IMAGE_POINTOP_H
+#define IMAGE_POINTOP_H
+
+#include "../parallel/executor.hpp"
+#include "image.hpp"
+
+namespace image {
+
+/**
+ * Operation that maps every grey level of an image to a new grey level,
+ * independently of the other pixels. Any such operation, and any chain of
+ * them, is stored as a single table of LEVELS entries, so applying it costs
+ * one lookup per pixel and one pass over the image.
+ */
+class PointOp {
+ public:
+  PointOp();
+
+  static PointOp genTable(const unsigned char TABLE[LEVELS]);
+
+  static PointOp genThreshold(const unsigned char NEW_LOW,
+                              const unsigned char NEW_HIGH,
+                              const unsigned char THRESHOLD);
+
+  static PointOp genQuantization(const int UNSET_BIT_COUNT);
+
+  static PointOp genEqualization(const int HISTOGRAM[]);
+
+  static PointOp genMatching(const int HISTOGRAM[], const int REFERENCE[]);
+
+  static PointOp genGamma(const double GAMMA);
+
+  static PointOp genInversion();
+
+  static PointOp genContrastStretch(const unsigned char LOW,
+                                    const unsigned char HIGH);
+
+  PointOp then(const PointOp& NEXT) const;
+
+  const unsigned char* getTable() const;
+
+  void apply(const unsigned char* SRC,
+             unsigned char* dest,
+             const int ROWS,
+             const int COLS) const;
+
+  void apply(const unsigned char* SRC,
+             unsigned char* dest,
+             const int ROWS,
+             const int COLS,
+             parallel::Executor& executor) const;
+
+ private:
+  // New grey level of each grey level, aligned so that each run of 16 entries
+  // can be loaded as one SIMD register
+  alignas(16) unsigned char table[LEVELS];
+};
+
+}  // namespace image
+
+#endif  // IMAGE_POINTOP_H
@@ -0,0 +1,297 @@
+#include "statistics.hpp"
+
+#include <vector>
+
+#include "histogram.hpp"
+#include "pointop.hpp"
+
+namespace image {
+
+/**
+ * Produces the statistics of the given image. The image is read once, to
+ * count its histogram, and every other statistic is derived from the
+ * histogram in O(LEVELS).
+ *
+ * @param SRC  Buffer containing image
+ * @param ROWS Number of rows in image
+ * @param COLS Number of columns in image
+ * @returns    Statistics of the image
+ */
+ImageStatistics genStatistics(const unsigned char* SRC,
+                              const int ROWS,
+                              const int COLS) {
+  parallel::Executor serial(1);
+
+  return genStatistics(SRC, ROWS, COLS, serial);
+}
+
+/**
+ * Produces the same statistics as genStatistics, counting the histogram in
+ * parallel with the given executor.
+ *
+ * @param SRC      Buffer containing image
+ * @param ROWS     Number of rows in image
+ * @param COLS     Number of columns in image
+ * @param executor Executor that counts the histogram
+ * @returns        Statistics of the image
+ */
+ImageStatistics genStatistics(const unsigned char* SRC,
+                              const int ROWS,
+                              const int COLS,
+                              parallel::Executor& executor) {
+  ImageStatistics statistics;
+
+  genHistogram(SRC, statistics.histogram, ROWS, COLS, executor);
+
+  statistics.count = 0;
+  statistics.min = LEVEL_WHITE;
+  statistics.max = LEVEL_BLACK;
+
+  // Sums of levels and squared levels are exact in 64-bit integers
+  long long sum = 0;
+  long long squaredSum = 0;
+
+  for (int i = 0; i < LEVELS; i++) {
+    const long FREQUENCY = statistics.histogram[i];
+
+    if (FREQUENCY == 0) {
+      continue;
+    }
+
+    if (statistics.count == 0) {
+      statistics.min = i;
+    }
+
+    statistics.max = i;
+    statistics.count += FREQUENCY;
+    sum += FREQUENCY * i;
+    squaredSum += FREQUENCY * i * i;
+  }
+
+  if (statistics.count == 0) {
+    statistics.min = statistics.max = LEVEL_BLACK;
+    statistics.mean = statistics.variance = 0;
+
+    return statistics;
+  }
+
+  statistics.mean = (double)sum / statistics.count;
+  statistics.variance = (double)squaredSum / statistics.count -
+                        statistics.mean * statistics.mean;
+
+  return statistics;
+}
+
+/**
+ * Returns the level at the given percentile of a histogram. A percentile of 0
+ * is the minimum, 0.5 the median and 1 the maximum level, with the same ranks
+ * as applyRankFilter.
+ *
+ * @param HISTOGRAM  Histogram of LEVELS levels
+ * @param PERCENTILE Percentile in [0, 1]
+ * @returns          Grey level at the percentile
+ */
+unsigned char getPercentile(const int HISTOGRAM[], const double PERCENTILE) {
+  // Ensure that the percentile is valid
+  if (PERCENTILE < 0 || PERCENTILE > 1) {
+    throw "ERROR: Percentile out of range!";
+  }
+
+  long count = 0;
+
+  for (int i = 0; i < LEVELS; i++) {
+    count += HISTOGRAM[i];
+  }
+
+  if (count == 0) {
+    return LEVEL_BLACK;
+  }
+
+  const long RANK = (long)(PERCENTILE * (count - 1) + 0.5);
+  long cumulative = 0;
+
+  for (int i = 0; i < LEVELS; i++) {
+    cumulative += HISTOGRAM[i];
+
+    if (cumulative > RANK) {
+      return i;
+    }
+  }
+
+  return LEVEL_WHITE;
+}
+
+/**
+ * Returns the threshold chosen by Otsu's method for the given histogram, which
+ * splits the levels into the two classes with the largest between-class
+ * variance. Pixels with an intensity lower than the threshold form the first
+ * class, as in applyThreshold. Takes a single sweep over the levels.
+ *
+ * @param HISTOGRAM Histogram of LEVELS levels
+ * @returns         Threshold intensity value
+ */
+unsigned char genOtsuThreshold(const int HISTOGRAM[]) {
+  double total = 0;
+  double totalSum = 0;
+
+  for (int i = 0; i < LEVELS; i++) {
+    total += HISTOGRAM[i];
+    totalSum += (double)HISTOGRAM[i] * i;
+  }
+
+  // Count and sum of levels of the first class
+  double count = 0;
+  double sum = 0;
+  double bestVariance = -1;
+  int threshold = 1;
+
+  for (int i = 0; i < LEVELS - 1; i++) {
+    count += HISTOGRAM[i];
+    sum += (double)HISTOGRAM[i] * i;
+
+    if (count == 0 || count == total) {
+      continue;
+    }
+
+    // Between-class variance, scaled by total^2
+    const double DIFFERENCE = total * sum - totalSum * count;
+    const double VARIANCE =
+        DIFFERENCE * DIFFERENCE / (count * (total - count));
+
+    if (VARIANCE > bestVariance) {
+      bestVariance = VARIANCE;
+      threshold = i + 1;
+    }
+  }
+
+  return threshold;
+}
+
+/**
+ * Produces the CLASSES - 1 thresholds of multi-level Otsu's method for the
+ * given histogram into the destination buffer, in increasing order. The
+ * thresholds split the levels into the CLASSES classes with the largest
+ * between-class variance, where class k holds the levels in
+ * [dest[k - 1], dest[k]). The optimal split is found by dynamic programming
+ * over prefix sums of the histogram, in O(CLASSES * LEVELS^2) time instead of
+ * the O(LEVELS^(CLASSES - 1)) of an exhaustive search. With 2 classes the
+ * threshold is that of genOtsuThreshold.
+ *
+ * @param HISTOGRAM Histogram of LEVELS levels
+ * @param dest      Destination buffer for CLASSES - 1 thresholds
+ * @param CLASSES   Number of classes, in [2, LEVELS]
+ */
+void genOtsuThresholds(const int HISTOGRAM[],
+                       unsigned char dest[],
+                       const int CLASSES) {
+  // Ensure that every class can hold at least one level
+  if (CLASSES < 2 || CLASSES > LEVELS) {
+    throw "ERROR: Number of classes out of range!";
+  }
+
+  // Count and sum of levels of the levels below each level
+  std::vector<double> counts(LEVELS + 1, 0);
+  std::vector<double> sums(LEVELS + 1, 0);
+
+  for (int i = 0; i < LEVELS; i++) {
+    counts[i + 1] = counts[i] + HISTOGRAM[i];
+    sums[i + 1] = sums[i] + (double)HISTOGRAM[i] * i;
+  }
+
+  // Between-class variance is maximized by maximizing the sum of
+  // sum^2 / count over all classes, the other terms do not depend on the split
+  auto getScore = [&](const int BEGIN, const int END) {
+    const double COUNT = counts[END] - counts[BEGIN];
+    const double SUM = sums[END] - sums[BEGIN];
+
+    return COUNT > 0 ? SUM * SUM / COUNT : 0;
+  };
+
+  // best[k][i] is the best score of splitting the levels below i into k + 1
+  // classes, and split[k][i] is where its last class begins
+  std::vector<std::vector<double>> best(CLASSES,
+                                        std::vector<double>(LEVELS + 1, -1));
+  std::vector<std::vector<int>> split(CLASSES, std::vector<int>(LEVELS + 1, 0));
+
+  for (int i = 1; i <= LEVELS; i++) {
+    best[0][i] = getScore(0, i);
+  }
+
+  for (int k = 1; k < CLASSES; k++) {
+    for (int i = k + 1; i <= LEVELS; i++) {
+      for (int j = k; j < i; j++) {
+        const double SCORE = best[k - 1][j] + getScore(j, i);
+
+        if (SCORE > best[k][i]) {
+          best[k][i] = SCORE;
+          split[k][i] = j;
+        }
+      }
+    }
+  }
+
+  // Follow the splits back from the last class
+  for (int k = CLASSES - 1, end = LEVELS; k > 0; k--) {
+    end = split[k][end];
+    dest[k - 1] = end;
+  }
+}
+
+/**
+ * Produces a new image by thresholding the given image at the threshold chosen
+ * by Otsu's method, as applyThreshold does with a given threshold.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for thresholded image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param NEW_LOW  New value for pixels with intensities below threshold
+ * @param NEW_HIGH New value for pixels with intensities greater than or equal
+ *                 to the threshold value
+ * @returns        Chosen threshold intensity value
+ */
+unsigned char applyAutoThreshold(const unsigned char* SRC,
+                                 unsigned char* dest,
+                                 const int ROWS,
+                                 const int COLS,
+                                 const unsigned char NEW_LOW,
+                                 const unsigned char NEW_HIGH) {
+  parallel::Executor serial(1);
+
+  return applyAutoThreshold(SRC, dest, ROWS, COLS, NEW_LOW, NEW_HIGH, serial);
+}
+
+/**
+ * Produces the same image as applyAutoThreshold, counting the histogram and
+ * thresholding bands of rows in parallel with the given executor.
+ *
+ * @param SRC      Buffer containing original image
+ * @param dest     Destination buffer for thresholded image
+ * @param ROWS     Number of rows in original image
+ * @param COLS     Number of columns in original image
+ * @param NEW_LOW  New value for pixels with intensities below threshold
+ * @param NEW_HIGH New value for pixels with intensities greater than or equal
+ *                 to the threshold value
+ * @param executor Executor that runs the bands
+ * @returns        Chosen threshold intensity value
+ */
+unsigned char applyAutoThreshold(const unsigned char* SRC,
+                                 unsigned char* dest,
+                                 const int ROWS,
+                                 const int COLS,
+                                 const unsigned char NEW_LOW,
+                                 const unsigned char NEW_HIGH,
+                                 parallel::Executor& executor) {
+  int histogram[LEVELS];
+
+  genHistogram(SRC, histogram, ROWS, COLS, executor);
+
+  const unsigned char THRESHOLD = genOtsuThreshold(histogram);
+
+  PointOp::genThreshold(NEW_LOW, NEW_HIGH, THRESHOLD)
+      .apply(SRC, dest, ROWS, COLS, executor);
+
+  return THRESHOLD;
+}
+
+}  // namespace image
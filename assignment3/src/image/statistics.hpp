@@ -0,0 +1,55 @@
+#ifndef IMAGE_STATISTICS_H
+#define IMAGE_STATISTICS_H
+
+#include "../parallel/executor.hpp"
+#include "image.hpp"
+
+namespace image {
+
+/**
+ * Statistics of the grey levels of an image, produced by genStatistics.
+ */
+struct ImageStatistics {
+  int histogram[LEVELS];
+  long count;
+  unsigned char min;
+  unsigned char max;
+  double mean;
+  double variance;
+};
+
+ImageStatistics genStatistics(const unsigned char* SRC,
+                              const int ROWS,
+                              const int COLS);
+
+ImageStatistics genStatistics(const unsigned char* SRC,
+                              const int ROWS,
+                              const int COLS,
+                              parallel::Executor& executor);
+
+unsigned char getPercentile(const int HISTOGRAM[], const double PERCENTILE);
+
+unsigned char genOtsuThreshold(const int HISTOGRAM[]);
+
+void genOtsuThresholds(const int HISTOGRAM[],
+                       unsigned char dest[],
+                       const int CLASSES);
+
+unsigned char applyAutoThreshold(const unsigned char* SRC,
+                                 unsigned char* dest,
+                                 const int ROWS,
+                                 const int COLS,
+                                 const unsigned char NEW_LOW,
+                                 const unsigned char NEW_HIGH);
+
+unsigned char applyAutoThreshold(const unsigned char* SRC,
+                                 unsigned char* dest,
+                                 const int ROWS,
+                                 const int COLS,
+                                 const unsigned char NEW_LOW,
+                                 const unsigned char NEW_HIGH,
+                                 parallel::Executor& executor);
+
+}  // namespace image
+
+#endif  // IMAGE_STATISTICS_H
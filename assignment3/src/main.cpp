@@ -4,6 +4,7 @@
 
 #include "file/file.hpp"
 #include "image/filter.hpp"
+#include "parallel/executor.hpp"
 #include "util/util.hpp"
 
 ////////////////////////////////////////////////////////////////////////////////
@@ -43,35 +44,29 @@ void program1() {
   unsigned char imageGradient[ROWS][COLS];
   unsigned char imageThresGradient[ROWS][COLS];
 
-  // Buffers for holding image filter masks
-  const double FILTER_SOBEL_HORZ[image::MASK_SIZE][image::MASK_SIZE] = {
-      -1, -2, -1, 0, 0, 0, 1, 2, 1};
-  const double FILTER_SOBEL_VERT[image::MASK_SIZE][image::MASK_SIZE] = {
-      -1, 0, 1, -2, 0, 2, -1, 0, 1};
+  // Buffers for holding signed horizontal and vertical derivatives
+  short gradientX[ROWS][COLS];
+  short gradientY[ROWS][COLS];
 
   // Read input file into buffer
   file::read(FILE_PATH_IN, (char*)&imageIn[0][0], ROWS * COLS);
 
-  // Compute horizontal edge image using Sobel filter
-  image::applyLinearFilter(&imageIn[0][0], FILTER_SOBEL_HORZ,
-                           &imageSobelHorz[0][0], ROWS, COLS);
-
-  // Compute vertical edge image using Sobel filter
-  image::applyLinearFilter(&imageIn[0][0], FILTER_SOBEL_VERT,
-                           &imageSobelVert[0][0], ROWS, COLS);
-
-  // Compute gradient image using magnitude of horizontal and vertical Sobel
-  // filtered images
-  for (int i = 0; i < ROWS; i++) {
-    for (int j = 0; j < COLS; j++) {
-      imageGradient[i][j] =
-          util::magnitude(imageSobelHorz[i][j], imageSobelVert[i][j]);
-    }
-  }
+  // Compute Sobel derivatives, gradient image and thresholded gradient image
+  // using Te = 128 in a single pass, in parallel on the shared executor
+  image::SobelGradient gradient;
+  gradient.x = &gradientX[0][0];
+  gradient.y = &gradientY[0][0];
+  gradient.magnitude = &imageGradient[0][0];
+  gradient.edges = &imageThresGradient[0][0];
+
+  image::genSobelGradient(&imageIn[0][0], gradient, ROWS, COLS,
+                          image::MAGNITUDE_EXACT, 128,
+                          parallel::Executor::shared());
 
-  // Apply threshold to gradient using Te = 128
-  image::applyThreshold(&imageGradient[0][0], &imageThresGradient[0][0], ROWS,
-                        COLS, image::LEVEL_BLACK, image::LEVEL_WHITE, 128);
+  // Compute horizontal and vertical edge images by clamping the vertical and
+  // horizontal derivatives, respectively
+  image::genClampedImage(&gradientY[0][0], &imageSobelHorz[0][0], ROWS, COLS);
+  image::genClampedImage(&gradientX[0][0], &imageSobelVert[0][0], ROWS, COLS);
 
   // Write output buffers to files
   file::write(FILE_PATH_OUT_1, (char*)&imageSobelHorz[0][0], ROWS * COLS);
@@ -113,15 +108,14 @@ void program2() {
   // Read input file into buffer
   file::read(FILE_PATH_IN, (char*)&imageIn[0][0], ROWS * COLS);
 
-  // Apply Laplace sharpening with w = 0.5
-  image::applyLaplaceSharpening(&imageIn[0][0], &imageOutW05[0][0], ROWS, COLS,
-                                0.5);
-  // Apply Laplace sharpening with w = 1.0
-  image::applyLaplaceSharpening(&imageIn[0][0], &imageOutW1[0][0], ROWS, COLS,
-                                1.0);
-  // Apply Laplace sharpening with w = 2.0
-  image::applyLaplaceSharpening(&imageIn[0][0], &imageOutW2[0][0], ROWS, COLS,
-                                2.0);
+  // Apply Laplace sharpening with w = 0.5, 1.0 and 2.0, computing the
+  // Laplacian only once
+  const double WEIGHTS[] = {0.5, 1.0, 2.0};
+  unsigned char* const IMAGES_OUT[] = {&imageOutW05[0][0], &imageOutW1[0][0],
+                                       &imageOutW2[0][0]};
+
+  image::applyLaplaceSharpening(&imageIn[0][0], IMAGES_OUT, WEIGHTS, 3, ROWS,
+                                COLS, parallel::Executor::shared());
 
   // Write output buffers to files
   file::write(FILE_PATH_OUT_1, (char*)&imageOutW05[0][0], ROWS * COLS);
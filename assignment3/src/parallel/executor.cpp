@@ -0,0 +1,215 @@
+#include "executor.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+
+namespace parallel {
+
+/**
+ * A single call to forEachBand shared between the calling thread and the
+ * workers. Bands are claimed by incrementing nextBand.
+ */
+struct Executor::Job {
+  const std::function<void(int, int)>* task;
+  int rows;
+  int bandRows;
+  int bands;
+  std::atomic<int> nextBand;
+  std::atomic<int> remainingBands;
+  // Set once a band has thrown, later bands are skipped
+  std::atomic<bool> failed;
+  // First exception thrown by a band, guarded by mutex
+  std::exception_ptr error;
+  std::mutex mutex;
+  std::condition_variable done;
+};
+
+// Set on threads that are processing bands of a job, both workers and the
+// posting thread, so that nested calls run inline instead of waiting on the
+// pool they are running in
+static thread_local bool isWorkerThread = false;
+
+/**
+ * Creates an executor with the given total number of threads, including the
+ * thread that calls forEachBand. An executor with a single thread runs every
+ * task serially on the calling thread.
+ *
+ * @param THREADS Total number of threads, must be at least 1
+ */
+Executor::Executor(const int THREADS) : generation(0), stopping(false) {
+  if (THREADS < 1) {
+    throw "ERROR: Executor requires at least one thread!";
+  }
+
+  for (int i = 1; i < THREADS; i++) {
+    workers.emplace_back(&Executor::runWorker, this);
+  }
+}
+
+/**
+ * Stops and joins all worker threads.
+ */
+Executor::~Executor() {
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    stopping = true;
+  }
+
+  wake.notify_all();
+
+  for (std::thread& worker : workers) {
+    worker.join();
+  }
+}
+
+/**
+ * Returns the total number of threads used by the executor, including the
+ * calling thread.
+ *
+ * @returns Number of threads
+ */
+int Executor::getThreadCount() const {
+  return workers.size() + 1;
+}
+
+/**
+ * Splits the rows [0, ROWS) into contiguous bands and calls the task once per
+ * band with the first row and the row after the last row of the band. Bands
+ * are processed in parallel by the worker threads and the calling thread.
+ * Returns once every band has been processed. If a band throws, the remaining
+ * bands are skipped and the first exception is rethrown on the calling thread
+ * once no thread is running the task any more.
+ *
+ * @param ROWS Number of rows to split into bands
+ * @param TASK Function called as TASK(ROW_BEGIN, ROW_END) for each band
+ */
+void Executor::forEachBand(const int ROWS,
+                           const std::function<void(int, int)>& TASK) {
+  if (ROWS <= 0) {
+    return;
+  }
+
+  // Run serially if there is nothing to share or if called from a worker
+  if (workers.empty() || isWorkerThread || ROWS < 2 * BAND_MIN_ROWS) {
+    TASK(0, ROWS);
+    return;
+  }
+
+  std::lock_guard<std::mutex> postLock(postMutex);
+
+  std::shared_ptr<Job> current = std::make_shared<Job>();
+  const int MAX_BANDS = getThreadCount() * BANDS_PER_THREAD;
+
+  current->task = &TASK;
+  current->rows = ROWS;
+  current->bands = std::max(1, std::min(MAX_BANDS, ROWS / BAND_MIN_ROWS));
+  current->bandRows = (ROWS + current->bands - 1) / current->bands;
+  current->bands = (ROWS + current->bandRows - 1) / current->bandRows;
+  current->nextBand = 0;
+  current->remainingBands = current->bands;
+  current->failed = false;
+
+  // Post the job to the workers
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    job = current;
+    generation++;
+  }
+
+  wake.notify_all();
+
+  // Help process the bands, then wait for bands claimed by workers. Nested
+  // calls from the bands run here must run inline like those of workers.
+  const bool WAS_WORKER_THREAD = isWorkerThread;
+
+  isWorkerThread = true;
+  runBands(*current);
+  isWorkerThread = WAS_WORKER_THREAD;
+
+  std::unique_lock<std::mutex> lock(current->mutex);
+  current->done.wait(lock, [&] { return current->remainingBands == 0; });
+
+  if (current->error) {
+    std::rethrow_exception(current->error);
+  }
+}
+
+/**
+ * Returns an executor shared by the whole program, with one thread per
+ * hardware thread.
+ *
+ * @returns Shared executor
+ */
+Executor& Executor::shared() {
+  static Executor executor(
+      std::max(1, (int)std::thread::hardware_concurrency()));
+
+  return executor;
+}
+
+/**
+ * Main loop of a worker thread. Waits for a new job to be posted and helps
+ * process its bands.
+ */
+void Executor::runWorker() {
+  isWorkerThread = true;
+
+  unsigned long seenGeneration = 0;
+
+  while (true) {
+    std::shared_ptr<Job> current;
+
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      wake.wait(lock, [&] { return stopping || generation != seenGeneration; });
+
+      if (stopping) {
+        return;
+      }
+
+      seenGeneration = generation;
+      current = job;
+    }
+
+    runBands(*current);
+  }
+}
+
+/**
+ * Claims and processes bands of the given job until none are left. An
+ * exception thrown by a band is stored in the job instead of escaping the
+ * thread.
+ *
+ * @param job Job to process
+ */
+void Executor::runBands(Job& job) {
+  int band;
+
+  while ((band = job.nextBand++) < job.bands) {
+    const int ROW_BEGIN = band * job.bandRows;
+    const int ROW_END = std::min(ROW_BEGIN + job.bandRows, job.rows);
+
+    if (!job.failed) {
+      try {
+        (*job.task)(ROW_BEGIN, ROW_END);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(job.mutex);
+
+        if (!job.error) {
+          job.error = std::current_exception();
+        }
+
+        job.failed = true;
+      }
+    }
+
+    // Wake the posting thread once the last band is complete
+    if (--job.remainingBands == 0) {
+      std::lock_guard<std::mutex> lock(job.mutex);
+      job.done.notify_all();
+    }
+  }
+}
+
+}  // namespace parallel
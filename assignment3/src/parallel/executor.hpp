@@ -0,0 +1,62 @@
+#ifndef PARALLEL_EXECUTOR_H
+#define PARALLEL_EXECUTOR_H
+
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace parallel {
+
+// Minimum number of rows in a band dispatched to a worker thread
+const int BAND_MIN_ROWS = 16;
+// Number of bands per thread, more bands balance uneven work between threads
+const int BANDS_PER_THREAD = 4;
+
+/**
+ * Pool of worker threads that processes an image split into bands of rows.
+ * Each band is processed by exactly one thread, so a task that only writes the
+ * rows of its own band produces the same result as a serial loop.
+ */
+class Executor {
+ public:
+  explicit Executor(const int THREADS);
+  ~Executor();
+
+  Executor(const Executor&) = delete;
+  Executor& operator=(const Executor&) = delete;
+
+  int getThreadCount() const;
+
+  void forEachBand(const int ROWS,
+                   const std::function<void(int, int)>& TASK);
+
+  static Executor& shared();
+
+ private:
+  struct Job;
+
+  void runWorker();
+
+  static void runBands(Job& job);
+
+  // Worker threads, the calling thread is counted as an additional worker
+  std::vector<std::thread> workers;
+  // Job currently being processed, if any
+  std::shared_ptr<Job> job;
+  // Incremented every time a new job is posted
+  unsigned long generation;
+  // Set when the workers should exit
+  bool stopping;
+  // Serializes jobs posted from different threads
+  std::mutex postMutex;
+  // Guards job, generation and stopping
+  std::mutex mutex;
+  std::condition_variable wake;
+};
+
+}  // namespace parallel
+
+#endif  // PARALLEL_EXECUTOR_H